@@ -0,0 +1,450 @@
+// Microbenchmarks for the engine's hot kernels. Fixtures are synthetic MP3s written at
+// build time by walkk_make_fixtures; WALKK_BENCH_FIXTURES overrides their directory.
+//
+//   walkk_bench --benchmark_format=json > bench.json
+//
+// --perf (or WALKK_BENCH_PERF=1) adds hardware counters per output frame to the
+// interpolation, decode, sink and mixer kernels where perf_event_open is usable.
+//
+// BM_GrainEnvelope checks the per-voice envelope budget; walkk_bench exits 1 if any
+// shape or ramp length goes over it.
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "grain_envelope.h"
+#include "minimp3_ex.h"
+#include "mixer.h"
+#include "pa_sink.h"
+#include "perf_counters.h"
+#include "walkk.h"
+#include "wav_writer.h"
+
+namespace {
+
+bool perfEnabled = false;
+bool budgetExceeded = false;
+
+// Envelope cost allowed per 200 ms grain voice: 0.05% of the grain's own duration, so even
+// a full mixer of Hann grains spends under 2% of one core on envelopes
+constexpr double kEnvelopeBudgetNsPerVoice = 100000.0;
+
+// Counts hardware events over a benchmark's timed loop and reports them per frame
+struct PerfScope {
+    benchmark::State &state;
+    PerfCounters counters;
+    bool active = false;
+
+    explicit PerfScope(benchmark::State &s) : state(s) {
+        std::string error;
+        active = perfEnabled && counters.open(error);
+        if (active) counters.start();
+    }
+
+    void finish(double framesPerIteration) {
+        if (!active) return;
+        counters.stop();
+        const double frames = framesPerIteration * (double)state.iterations();
+        if (frames <= 0.0) return;
+        for (int e = 0; e < PerfCounters::kEvents; e++) {
+            if (counters.available(e)) {
+                state.counters[std::string(PerfCounters::name(e)) + "_per_frame"] = (double)counters.value(e) / frames;
+            }
+        }
+        if (counters.available(PerfCounters::Cycles) && counters.available(PerfCounters::Instructions) &&
+            counters.value(PerfCounters::Cycles) > 0) {
+            state.counters["ipc"] = (double)counters.value(PerfCounters::Instructions) /
+                                    (double)counters.value(PerfCounters::Cycles);
+        }
+    }
+};
+
+const char *fixtureDir() {
+    const char *env = std::getenv("WALKK_BENCH_FIXTURES");
+    return env && *env ? env : WALKK_BENCH_FIXTURE_DIR;
+}
+
+std::string fixtureName(int rate, int channels) {
+    return "fixture_" + std::to_string(rate) + (channels == 1 ? "_mono.mp3" : "_stereo.mp3");
+}
+
+// Fixture library, loaded once and shared by every benchmark
+Walkk &library() {
+    static std::unique_ptr<Walkk> walkk = [] {
+        auto w = std::make_unique<Walkk>((size_t)Walkk::kSampleRate * Walkk::kChannels);
+        w->consoleLog = false;
+        loadDirectoryMp3s(fixtureDir(), *w, false);
+        return w;
+    }();
+    return *walkk;
+}
+
+StreamedFile *findFixture(int rate, int channels) {
+    const std::string name = fixtureName(rate, channels);
+    for (StreamedFile &f : library().files) {
+        if (f.relPath == name) return &f;
+    }
+    return nullptr;
+}
+
+enum GrainMode { Linear = 0, Loop = 1, Reverse = 2 };
+
+GrainParams makeGrain(const StreamedFile &file, int mode, std::mt19937 &rng) {
+    GrainParams grain{};
+    grain.durationFrames = Walkk::kSampleRate / 5; // 200 ms
+    grain.amplitude = 0.5f;
+    std::uniform_int_distribution<size_t> pos(0, file.totalFrames - grain.durationFrames * 2);
+    grain.startFrame = pos(rng);
+    if (mode == Loop) {
+        grain.loopEnabled = true;
+        grain.loopWindowFrames = (size_t)file.sampleRate / 20; // 50 ms window
+        grain.loopDragFrames = file.sampleRate / 200;
+    }
+    grain.reversePlayback = mode == Reverse;
+    grain.attackFrames = grain.releaseFrames = Walkk::kSampleRate / 100;
+    return grain;
+}
+
+const char *modeName(int mode) {
+    return mode == Loop ? "loop" : mode == Reverse ? "reverse" : "linear";
+}
+
+// args: source rate, channels, mode. Opens and closes the decoder per grain like the producer does.
+void BM_ReadGrain(benchmark::State &state) {
+    const int rate = (int)state.range(0), channels = (int)state.range(1), mode = (int)state.range(2);
+    StreamedFile *file = findFixture(rate, channels);
+    if (!file) {
+        state.SkipWithError("fixture missing");
+        return;
+    }
+    std::mt19937 rng(1234);
+    ProducerStats stats;
+    std::vector<float> out;
+    for (auto _ : state) {
+        GrainParams grain = makeGrain(*file, mode, rng);
+        if (!readGrain(*file, grain, out, Walkk::kSampleRate, stats)) {
+            state.SkipWithError("readGrain failed");
+            return;
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)(Walkk::kSampleRate / 5));
+    state.SetLabel(std::string(modeName(mode)) + (channels == 1 ? " mono " : " stereo ") + std::to_string(rate));
+}
+BENCHMARK(BM_ReadGrain)
+    ->ArgsProduct({{44100, 48000}, {1, 2}, {Linear, Loop, Reverse}})
+    ->Unit(benchmark::kMicrosecond);
+
+// Same grain read with the decoder already open: seek + decode + resample only
+void BM_ReadGrainWarm(benchmark::State &state) {
+    const int rate = (int)state.range(0), channels = (int)state.range(1);
+    StreamedFile *file = findFixture(rate, channels);
+    if (!file || mp3dec_ex_open(&file->decoder, file->path.c_str(), MP3D_SEEK_TO_SAMPLE) != 0) {
+        state.SkipWithError("fixture missing");
+        return;
+    }
+    file->isOpen = true;
+    std::mt19937 rng(1234);
+    ProducerStats stats;
+    std::vector<float> out;
+    for (auto _ : state) {
+        GrainParams grain = makeGrain(*file, Linear, rng);
+        readGrain(*file, grain, out, Walkk::kSampleRate, stats);
+        benchmark::DoNotOptimize(out.data());
+    }
+    mp3dec_ex_close(&file->decoder);
+    file->isOpen = false;
+    state.SetItemsProcessed(state.iterations() * (int64_t)(Walkk::kSampleRate / 5));
+}
+BENCHMARK(BM_ReadGrainWarm)->ArgsProduct({{44100, 48000}, {1, 2}})->Unit(benchmark::kMicrosecond);
+
+// readGrain's interpolation loop alone, on a slice decoded once up front. args: rate, channels, mode
+void BM_Interpolate(benchmark::State &state) {
+    const int rate = (int)state.range(0), channels = (int)state.range(1), mode = (int)state.range(2);
+    StreamedFile *file = findFixture(rate, channels);
+    if (!file) {
+        state.SkipWithError("fixture missing");
+        return;
+    }
+    std::mt19937 rng(1234);
+    GrainParams grain = makeGrain(*file, mode, rng);
+    const double rateRatio = (double)file->sampleRate / Walkk::kSampleRate;
+    const size_t spanFrames = (size_t)(grain.durationFrames * rateRatio) + 2;
+
+    mp3dec_ex_t dec;
+    if (mp3dec_ex_open(&dec, file->path.c_str(), MP3D_SEEK_TO_SAMPLE) != 0) {
+        state.SkipWithError("open failed");
+        return;
+    }
+    std::vector<mp3d_sample_t> src(spanFrames * 2 * (size_t)channels);
+    mp3dec_ex_seek(&dec, (uint64_t)grain.startFrame * (uint64_t)channels);
+    const size_t framesRead = mp3dec_ex_read(&dec, src.data(), src.size()) / (size_t)channels;
+    mp3dec_ex_close(&dec);
+    const size_t windowLen = grain.loopEnabled ? grain.loopWindowFrames : spanFrames;
+
+    std::vector<float> out(grain.durationFrames * Walkk::kChannels);
+    PerfScope perf(state);
+    for (auto _ : state) {
+        interpolateGrain(src.data(), framesRead, channels, (int64_t)grain.startFrame, file->totalFrames, rateRatio,
+                         windowLen, grain, out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    perf.finish((double)grain.durationFrames);
+    state.SetItemsProcessed(state.iterations() * (int64_t)grain.durationFrames);
+    state.SetLabel(std::string(modeName(mode)) + (channels == 1 ? " mono " : " stereo ") + std::to_string(rate));
+}
+BENCHMARK(BM_Interpolate)->ArgsProduct({{44100, 48000}, {1, 2}, {Linear, Loop, Reverse}});
+
+// minimp3's seek + decode loop on an open decoder, 200 ms per iteration. args: rate, channels
+void BM_Decode(benchmark::State &state) {
+    const int rate = (int)state.range(0), channels = (int)state.range(1);
+    StreamedFile *file = findFixture(rate, channels);
+    mp3dec_ex_t dec;
+    if (!file || mp3dec_ex_open(&dec, file->path.c_str(), MP3D_SEEK_TO_SAMPLE) != 0) {
+        state.SkipWithError("fixture missing");
+        return;
+    }
+    const size_t frames = (size_t)rate / 5;
+    std::vector<mp3d_sample_t> pcm(frames * (size_t)channels);
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<size_t> pos(0, file->totalFrames - frames);
+    size_t decoded = 0;
+    PerfScope perf(state);
+    for (auto _ : state) {
+        mp3dec_ex_seek(&dec, (uint64_t)pos(rng) * (uint64_t)channels);
+        decoded += mp3dec_ex_read(&dec, pcm.data(), pcm.size()) / (size_t)channels;
+        benchmark::DoNotOptimize(pcm.data());
+    }
+    perf.finish(state.iterations() ? (double)decoded / (double)state.iterations() : 0.0);
+    mp3dec_ex_close(&dec);
+    state.SetItemsProcessed((int64_t)decoded);
+}
+BENCHMARK(BM_Decode)->ArgsProduct({{44100, 48000}, {1, 2}})->Unit(benchmark::kMicrosecond);
+
+// Mixer::render with N one-second grain voices, 256-frame blocks
+void BM_MixerRender(benchmark::State &state) {
+    const size_t voices = (size_t)state.range(0);
+    const size_t blockFrames = 256, grainFrames = (size_t)Walkk::kSampleRate;
+    Mixer mixer(Walkk::kChannels);
+    std::vector<float> grainAudio(grainFrames * Walkk::kChannels, 0.1f);
+    auto schedule = [&]() {
+        mixer.reset();
+        for (size_t i = 0; i < voices; i++) {
+            MixerVoice *v = mixer.allocateVoice(MixerVoice::Type::Grain);
+            v->buffer = grainAudio;
+            v->startFrame = i * 37; // staggered so voices start and end inside blocks
+            v->lengthFrames = grainFrames;
+        }
+    };
+    schedule();
+    std::vector<float> block(blockFrames * Walkk::kChannels);
+    PerfScope perf(state);
+    for (auto _ : state) {
+        if (mixer.renderFrame + blockFrames > grainFrames) {
+            state.PauseTiming();
+            schedule();
+            state.ResumeTiming();
+        }
+        mixer.render(block.data(), blockFrames);
+        benchmark::DoNotOptimize(block.data());
+    }
+    perf.finish((double)blockFrames);
+    state.SetItemsProcessed(state.iterations() * (int64_t)blockFrames);
+}
+BENCHMARK(BM_MixerRender)->Arg(1)->Arg(8)->Arg((int64_t)Mixer::kMaxVoices);
+
+// applyGrainEnvelope on one freshly written 200 ms stereo grain, as readGrain applies it per
+// voice. Manual timing: the refill between iterations is not counted. args: EnvelopeShape,
+// attack = release in ms
+void BM_GrainEnvelope(benchmark::State &state) {
+    const EnvelopeShape shape = (EnvelopeShape)state.range(0);
+    const size_t frames = Walkk::kSampleRate / 5;
+    const size_t rampFrames = (size_t)state.range(1) * Walkk::kSampleRate / 1000;
+    std::vector<float> grain(frames * Walkk::kChannels, 0.5f);
+    applyGrainEnvelope(grain.data(), frames, Walkk::kChannels, shape, rampFrames, rampFrames); // builds the tables
+    double totalNs = 0.0;
+    for (auto _ : state) {
+        std::fill(grain.begin(), grain.end(), 0.5f); // in-place ramps would decay into denormals
+        const auto start = std::chrono::steady_clock::now();
+        applyGrainEnvelope(grain.data(), frames, Walkk::kChannels, shape, rampFrames, rampFrames);
+        benchmark::DoNotOptimize(grain.data());
+        benchmark::ClobberMemory();
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        state.SetIterationTime(elapsed.count() * 1e-9);
+        totalNs += elapsed.count();
+    }
+
+    const double nsPerVoice = state.iterations() ? totalNs / (double)state.iterations() : 0.0;
+    state.counters["ns_per_voice"] = nsPerVoice;
+    state.counters["budget_used"] = nsPerVoice / kEnvelopeBudgetNsPerVoice;
+    state.SetItemsProcessed(state.iterations() * (int64_t)frames);
+    state.SetLabel(std::string(envelopeShapeName(shape)) + " " + std::to_string(state.range(1)) + " ms");
+    // Google Benchmark's first probe runs are a handful of iterations; only judge a real run
+    if (state.iterations() >= 100 && nsPerVoice > kEnvelopeBudgetNsPerVoice) {
+        budgetExceeded = true;
+        state.SkipWithError("over the per-voice envelope budget");
+    }
+}
+BENCHMARK(BM_GrainEnvelope)
+    ->ArgsProduct({benchmark::CreateDenseRange(0, kEnvelopeShapeCount - 1, 1), {1, 10, 50}})
+    ->UseManualTime();
+
+void BM_GenerateRandomGrain(benchmark::State &state) {
+    Walkk &walkk = library();
+    if (walkk.files.empty()) {
+        state.SkipWithError("no fixtures");
+        return;
+    }
+    walkk.settings.loopProbability = 0.5f;
+    walkk.settings.bouncebackProbability = 0.5f;
+    for (auto _ : state) {
+        GrainParams grain = generateRandomGrain(walkk);
+        benchmark::DoNotOptimize(grain);
+    }
+}
+BENCHMARK(BM_GenerateRandomGrain);
+
+// Open (building the seek index) and close one file, as the library scan does per file
+void BM_ProbeFile(benchmark::State &state) {
+    StreamedFile *file = findFixture((int)state.range(0), (int)state.range(1));
+    if (!file) {
+        state.SkipWithError("fixture missing");
+        return;
+    }
+    mp3dec_ex_t dec;
+    for (auto _ : state) {
+        if (mp3dec_ex_open(&dec, file->path.c_str(), MP3D_SEEK_TO_SAMPLE) != 0) {
+            state.SkipWithError("open failed");
+            return;
+        }
+        benchmark::DoNotOptimize(dec.samples);
+        mp3dec_ex_close(&dec);
+    }
+}
+BENCHMARK(BM_ProbeFile)->ArgsProduct({{44100, 48000}, {1, 2}})->Unit(benchmark::kMicrosecond);
+
+void BM_ScanDirectory(benchmark::State &state) {
+    for (auto _ : state) {
+        Walkk walkk((size_t)Walkk::kSampleRate);
+        loadDirectoryMp3s(fixtureDir(), walkk, false);
+        benchmark::DoNotOptimize(walkk.files.size());
+    }
+}
+BENCHMARK(BM_ScanDirectory)->Unit(benchmark::kMillisecond);
+
+// One push and one pop of a block, no contention
+void BM_SinkPushPop(benchmark::State &state) {
+    const size_t samples = (size_t)state.range(0);
+    AudioSink sink(samples * 4);
+    std::vector<float> in(samples, 0.25f), out(samples);
+    PerfScope perf(state);
+    for (auto _ : state) {
+        sink.push(in.data(), samples);
+        benchmark::DoNotOptimize(sink.pop(out.data(), samples));
+    }
+    perf.finish((double)samples / Walkk::kChannels);
+    state.SetItemsProcessed(state.iterations() * (int64_t)samples);
+}
+BENCHMARK(BM_SinkPushPop)->Arg(512)->Arg(4096);
+
+// Thread 0 pushes, thread 1 pops, both on the same sink
+void BM_SinkContended(benchmark::State &state) {
+    static AudioSink sink((size_t)Walkk::kSampleRate / 4 * Walkk::kChannels);
+    const size_t samples = (size_t)state.range(0);
+    if (state.thread_index() == 0) sink.clear();
+    std::vector<float> buffer(samples, 0.25f);
+    size_t moved = 0;
+    for (auto _ : state) {
+        moved += state.thread_index() == 0 ? sink.push(buffer.data(), samples) : sink.pop(buffer.data(), samples);
+    }
+    state.SetItemsProcessed((int64_t)moved);
+    state.SetLabel(state.thread_index() == 0 ? "push" : "pop");
+}
+BENCHMARK(BM_SinkContended)->Arg(512)->Threads(2)->UseRealTime();
+
+void BM_ConvertFloatToInt16(benchmark::State &state) {
+    const size_t samples = (size_t)state.range(0);
+    std::vector<float> in(samples);
+    std::vector<int16_t> out(samples);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dist(-1.2f, 1.2f);
+    for (float &s : in) s = dist(rng);
+    for (auto _ : state) {
+        convertFloatToInt16(in.data(), out.data(), samples);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)samples);
+}
+BENCHMARK(BM_ConvertFloatToInt16)->Arg(512)->Arg(8192);
+
+// Arg: 0 = none, 1 = tpdf, 2 = shaped; 24-bit packed output
+void BM_ConvertDithered(benchmark::State &state, bool int24) {
+    const size_t samples = 8192;
+    std::vector<float> in(samples);
+    AlignedBuffer<uint8_t> out;
+    out.reserve(samples * 3);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dist(-1.2f, 1.2f);
+    for (float &s : in) s = dist(rng);
+    DitherState dither((DitherMode)state.range(0), 2);
+    for (auto _ : state) {
+        if (int24) convertFloatToInt24(in.data(), out.data(), samples, dither);
+        else convertFloatToInt16(in.data(), (int16_t *)out.data(), samples, dither);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetLabel(ditherModeName(dither.mode));
+    state.SetItemsProcessed(state.iterations() * (int64_t)samples);
+}
+BENCHMARK_CAPTURE(BM_ConvertDithered, s16, false)->DenseRange(0, 2);
+BENCHMARK_CAPTURE(BM_ConvertDithered, s24, true)->DenseRange(0, 2);
+
+} // namespace
+
+int main(int argc, char **argv) {
+    // --perf is ours; strip it before Google Benchmark sees the arguments
+    const char *perfEnv = std::getenv("WALKK_BENCH_PERF");
+    perfEnabled = perfEnv && *perfEnv && std::strcmp(perfEnv, "0") != 0;
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--perf") == 0) perfEnabled = true;
+        else argv[kept++] = argv[i];
+    }
+    argc = kept;
+
+    std::string perfStatus = "off";
+    if (perfEnabled) {
+        PerfCounters probe;
+        std::string error;
+        if (probe.open(error)) {
+            perfStatus.clear();
+            for (int e = 0; e < PerfCounters::kEvents; e++) {
+                if (!probe.available(e)) continue;
+                if (!perfStatus.empty()) perfStatus += ",";
+                perfStatus += PerfCounters::name(e);
+            }
+        } else {
+            perfStatus = "unavailable (" + error + ")";
+            std::cerr << "walkk_bench: hardware counters " << perfStatus << ", timing only" << std::endl;
+            perfEnabled = false;
+        }
+    }
+
+    benchmark::AddCustomContext("walkk_fixtures", fixtureDir());
+    benchmark::AddCustomContext("walkk_perf_counters", perfStatus);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    if (budgetExceeded) {
+        std::cerr << "walkk_bench: envelope cost over " << kEnvelopeBudgetNsPerVoice << " ns per voice" << std::endl;
+        return 1;
+    }
+    return 0;
+}
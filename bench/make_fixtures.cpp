@@ -0,0 +1,35 @@
+// Writes the synthetic MP3 fixtures walkk_bench reads: every combination of
+// 44.1/48 kHz and mono/stereo, named fixture_<rate>_<mono|stereo>.mp3.
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "synth_mp3.h"
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <output_directory>" << std::endl;
+        return 1;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(argv[1], ec);
+
+    uint64_t seed = 1;
+    for (int rate : {44100, 48000}) {
+        for (int channels : {1, 2}) {
+            SynthMp3Options options;
+            options.sampleRate = rate;
+            options.channels = channels;
+            options.bitrateKbps = channels == 1 ? 96 : 128;
+            options.seconds = 12.0;
+            options.seed = seed++;
+            std::string path = std::string(argv[1]) + "/fixture_" + std::to_string(rate) +
+                               (channels == 1 ? "_mono.mp3" : "_stereo.mp3");
+            if (!writeSynthMp3(path, options)) {
+                std::cerr << "Could not write " << path << std::endl;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
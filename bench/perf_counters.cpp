@@ -0,0 +1,120 @@
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perf_counters.h"
+
+const char *PerfCounters::name(int event) {
+    switch (event) {
+    case Cycles: return "cycles";
+    case Instructions: return "instructions";
+    case L1dMisses: return "l1d_misses";
+    case LlcMisses: return "llc_misses";
+    case BranchMisses: return "branch_misses";
+    }
+    return "?";
+}
+
+#ifdef __linux__
+
+namespace {
+
+void describe(perf_event_attr &attr, int event) {
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    switch (event) {
+    case PerfCounters::Cycles:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PerfCounters::Instructions:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PerfCounters::L1dMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PerfCounters::LlcMisses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case PerfCounters::BranchMisses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+    attr.disabled = 1;
+    attr.exclude_kernel = 1; // allowed at perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+}
+
+} // namespace
+
+PerfCounters::~PerfCounters() {
+    for (int &fd : fds) {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+}
+
+bool PerfCounters::open(std::string &error) {
+    bool any = false;
+    for (int e = 0; e < kEvents; e++) {
+        if (fds[e] >= 0) {
+            any = true;
+            continue;
+        }
+        perf_event_attr attr;
+        describe(attr, e);
+        fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[e] >= 0) {
+            any = true;
+        } else if (error.empty()) {
+            error = std::string(name(e)) + ": " + std::strerror(errno);
+        }
+    }
+    if (any) error.clear();
+    return any;
+}
+
+void PerfCounters::start() {
+    for (int fd : fds) {
+        if (fd < 0) continue;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void PerfCounters::stop() {
+    for (int e = 0; e < kEvents; e++) {
+        values[e] = 0;
+        if (fds[e] < 0) continue;
+        ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t data[3] = {}; // value, time enabled, time running
+        if (read(fds[e], data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0) continue;
+        values[e] = data[2] < data[1] ? (uint64_t)((double)data[0] * (double)data[1] / (double)data[2]) : data[0];
+    }
+}
+
+#else
+
+PerfCounters::~PerfCounters() {}
+
+bool PerfCounters::open(std::string &error) {
+    error = "perf_event_open is Linux only";
+    return false;
+}
+
+void PerfCounters::start() {}
+void PerfCounters::stop() {}
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Hardware counters for the calling thread via perf_event_open (Linux only).
+// Each event is opened on its own, so a missing PMU event (common in VMs and
+// containers) only drops that one counter; everything else keeps working.
+struct PerfCounters {
+    enum Event { Cycles, Instructions, L1dMisses, LlcMisses, BranchMisses, kEvents };
+
+    PerfCounters() = default;
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // Opens every event it can. Returns false if none could be opened; `error`
+    // then says why (e.g. perf_event_paranoid, seccomp, no PMU).
+    bool open(std::string &error);
+
+    bool available(int event) const { return fds[event] >= 0; }
+
+    void start();
+    void stop();
+
+    // Counts between start() and stop(), scaled up if the kernel multiplexed the event
+    uint64_t value(int event) const { return values[event]; }
+
+    static const char *name(int event);
+
+private:
+    int fds[kEvents] = {-1, -1, -1, -1, -1};
+    uint64_t values[kEvents] = {};
+};
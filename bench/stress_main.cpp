@@ -0,0 +1,605 @@
+// End-to-end capacity test: writes a synthetic MP3 library, scans it, then runs the
+// granulizer into a clocked null output while stepping up the number of concurrent voices.
+// Reports scan time, time to first audio, grains/sec per step, the most voices that played
+// without a sink underrun, and peak RSS.
+//
+// With --survival (or any --io-* fault) it then replays playback with grain reads going
+// through an IoFaultInjector, once per lookahead (fixed sink depth), and reports how long
+// each one played before its first underrun.
+//
+// With --render-check it renders the same piece offline as one segment and as many short ones
+// and fails (status 4) if the segmented render is louder or quieter overall or just after the
+// segment boundaries.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "io_faults.h"
+#include "metrics.h"
+#include "offline_render.h"
+#include "rt_check.h"
+#include "output_backend.h"
+#include "pa_sink.h"
+#include "synth_mp3.h"
+#include "walkk.h"
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct StressOptions {
+    size_t files = 1000;
+    double minSeconds = 2.0;
+    double maxSeconds = 20.0;
+    uint64_t seed = 1;
+    std::string directory;      // empty: a temporary directory, removed afterwards
+    bool reuse = false;         // keep an existing library in `directory` instead of rewriting it
+    size_t maxVoices = Mixer::kMaxVoices;
+    double stepSeconds = 5.0;   // measured time per voice count
+    double warmupSeconds = 1.0; // settling time after each change
+    unsigned long bufferFrames = 256;
+    double sinkMaxMs = 2000.0;
+    std::string jsonPath;
+    bool ramp = true;
+    bool rtStrict = false;
+
+    // Survival runs under injected I/O faults
+    bool survival = false;
+    IoFaultConfig faults;
+    std::vector<double> lookaheadMs = {50, 100, 250, 500, 1000};
+    double surviveSeconds = 60.0; // give up (and call it a pass) after this long
+    size_t survivalVoices = 4;
+
+    // One segment against many in the offline render
+    bool renderCheck = false;
+    double renderSeconds = 600.0;
+    double renderSegmentSeconds = 2.0;
+    double renderTolerance = 0.15; // largest relative level difference that passes
+};
+
+struct StepResult {
+    size_t voices = 0;
+    double grainsPerSecond = 0.0;
+    uint64_t shortfalls = 0; // partial + empty output buffers
+    uint64_t lateWakes = 0;  // output thread woke a period late (scheduler, not the producer)
+    double decodeP99 = 0.0;
+    double sinkTargetMs = 0.0;
+};
+
+struct SurvivalResult {
+    double lookaheadMs = 0.0;
+    double survivedSeconds = 0.0;
+    bool survivedAll = false;    // reached surviveSeconds without an underrun
+    uint64_t grains = 0;
+    uint64_t grainFailures = 0;
+    uint64_t stalls = 0;
+    uint64_t readErrors = 0;
+};
+
+struct RenderCheckResult {
+    std::string settings;
+    double pieceRatio = 0.0;    // mean square, segmented / one segment
+    double boundaryRatio = 0.0; // the same, in the windows just after each boundary
+    bool passed = false;
+};
+
+struct StressReport {
+    size_t filesLoaded = 0;
+    double generateSeconds = 0.0;
+    double scanSeconds = 0.0;
+    double ttfaSeconds = 0.0;
+    std::vector<StepResult> steps;
+    size_t maxCleanVoices = 0;
+    double sustainedGrains = 0.0;
+    std::vector<SurvivalResult> survival;
+    std::vector<RenderCheckResult> renderChecks;
+    size_t peakRss = 0;
+    uint64_t rtViolations = 0; // WALKK_RT_CHECKS builds only
+};
+
+void printUsage(const char *argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --files <n>          synthetic MP3s to generate (default 1000)\n"
+              << "  --min-seconds <s>    shortest file (default 2)\n"
+              << "  --max-seconds <s>    longest file (default 20)\n"
+              << "  --seed <n>           library seed (default 1)\n"
+              << "  --dir <path>         where to write the library (default: a temporary directory)\n"
+              << "  --reuse              use the MP3s already in --dir instead of regenerating\n"
+              << "  --max-voices <n>     highest concurrent voice count to try (default "
+              << Mixer::kMaxVoices << ")\n"
+              << "  --step-seconds <s>   measured time per voice count (default 5)\n"
+              << "  --buffer-frames <n>  null output buffer size (default 256)\n"
+              << "  --sink-max-ms <ms>   sink capacity (default 2000)\n"
+              << "  --no-ramp            skip the voice ramp\n"
+              << "  --rt-strict          exit with status 3 if the output callback allocated, locked or\n"
+              << "                       blocked; status 1 in builds without WALKK_RT_CHECKS\n"
+              << "  --json <path>        also write the results as JSON\n"
+              << "Survival under injected I/O faults:\n"
+              << "  --survival             run it even without faults\n"
+              << "  --io-latency-ms <ms>   delay added to every read and seek\n"
+              << "  --io-bandwidth <MB/s>  read throughput cap\n"
+              << "  --io-stall-prob <p>    chance per read of a stall\n"
+              << "  --io-stall-ms <ms>     length of a stall\n"
+              << "  --io-error-prob <p>    chance per read that it fails\n"
+              << "  --lookahead-ms <list>  sink depths to try, comma separated (default 50,100,250,500,1000)\n"
+              << "  --survive-seconds <s>  stop a run after this long without an underrun (default 60)\n"
+              << "  --survival-voices <n>  concurrent voices during survival runs (default 4)\n"
+              << "\n"
+              << "  --render-check             render a piece as one segment and as many, exit 4 if they differ in level\n"
+              << "  --render-seconds <s>       length of that piece (default 600)\n"
+              << "  --render-segment-seconds <s> segment length of the segmented render (default 2)\n"
+              << "  --render-tolerance <r>     relative level difference allowed (default 0.15)" << std::endl;
+}
+
+// Mixed rates, channel layouts, bitrates, CBR/VBR and lengths, 250 files per subdirectory
+bool generateLibrary(const StressOptions &opt, const fs::path &dir) {
+    std::mt19937_64 rng(opt.seed);
+    const int rates[] = {32000, 44100, 48000};
+    const int bitrates[] = {64, 96, 128, 160, 192, 256, 320};
+    std::uniform_real_distribution<double> length(opt.minSeconds, std::max(opt.minSeconds, opt.maxSeconds));
+
+    for (size_t i = 0; i < opt.files; i++) {
+        fs::path sub = dir / std::to_string(i / 250);
+        std::error_code ec;
+        fs::create_directories(sub, ec);
+
+        SynthMp3Options o;
+        o.sampleRate = rates[rng() % 3];
+        o.channels = 1 + (int)(rng() % 2);
+        o.bitrateKbps = bitrates[rng() % 7];
+        o.vbr = rng() % 2 == 0;
+        o.seconds = length(rng);
+        o.seed = rng();
+        if (!writeSynthMp3((sub / ("s" + std::to_string(i) + ".mp3")).string(), o)) {
+            std::cerr << "Could not write into " << sub << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void setVoices(Walkk &walkk, size_t voices) {
+    std::lock_guard<std::mutex> lock(walkk.settingsMutex);
+    walkk.settings.maxConcurrentGrains = voices;
+    // Overlap as long as the longest grain: a new grain starts whenever a voice is free
+    walkk.settings.grainOverlapMs = walkk.settings.maxGrainMs;
+    walkk.settings.whiteNoiseMs = 0;
+}
+
+// Granulizer into a null output paced at the sample rate
+struct Pipeline {
+    Walkk &walkk;
+    CallbackData callbackData;
+    std::unique_ptr<OutputBackend> backend;
+    std::thread producer;
+
+    Pipeline(Walkk &w, unsigned long bufferFrames) : walkk(w), callbackData{ &w.sink, Walkk::kChannels, &w } {
+        OutputConfig output;
+        output.type = OutputBackendType::Null;
+        output.realtime = true;
+        output.framesPerBuffer = bufferFrames;
+        output.channels = Walkk::kChannels;
+        output.sampleRate = Walkk::kSampleRate;
+        backend = createOutputBackend(output, &callbackData);
+        walkk.engineBlockFrames.store(bufferFrames);
+    }
+
+    ~Pipeline() { stop(); }
+
+    // Returns seconds until the first real audio left the sink, or a negative value on failure
+    double start() {
+        if (!backend) return -1.0;
+        walkk.allFinished.store(false);
+        walkk.resetPlayback();
+        auto t0 = Clock::now();
+        producer = std::thread([this]() { granulizerLoop(&walkk); });
+        if (backend->start() != 0) return -1.0;
+        while (walkk.clock.framesConsumed.load() == 0 && Clock::now() - t0 < std::chrono::seconds(30)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        return std::chrono::duration<double>(Clock::now() - t0).count();
+    }
+
+    void stop() {
+        walkk.allFinished.store(true);
+        walkk.sink.wakeProducer();
+        if (backend) backend->stop();
+        if (producer.joinable()) producer.join();
+    }
+};
+
+uint64_t shortfalls(const AudioHealthStats &s) {
+    return s.partialBuffers + s.emptyBuffers;
+}
+
+bool writeJson(const std::string &path, const StressOptions &opt, const StressReport &r) {
+    FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) return false;
+    std::fprintf(f, "{\n  \"files\": %zu,\n  \"files_loaded\": %zu,\n  \"buffer_frames\": %lu,\n",
+                 opt.files, r.filesLoaded, opt.bufferFrames);
+    std::fprintf(f, "  \"generate_seconds\": %.3f,\n  \"scan_seconds\": %.4f,\n  \"time_to_first_audio_seconds\": %.4f,\n",
+                 r.generateSeconds, r.scanSeconds, r.ttfaSeconds);
+    std::fprintf(f, "  \"max_voices_without_underrun\": %zu,\n  \"sustained_grains_per_second\": %.2f,\n",
+                 r.maxCleanVoices, r.sustainedGrains);
+    std::fprintf(f, "  \"peak_rss_bytes\": %zu,\n  \"rt_violations\": %llu,\n  \"steps\": [\n", r.peakRss,
+                 (unsigned long long)r.rtViolations);
+    for (size_t i = 0; i < r.steps.size(); i++) {
+        const StepResult &s = r.steps[i];
+        std::fprintf(f, "    {\"voices\": %zu, \"grains_per_second\": %.2f, \"shortfalls\": %llu, \"late_wakes\": %llu, "
+                        "\"decode_p99_seconds\": %.6f, \"sink_target_ms\": %.1f}%s\n",
+                     s.voices, s.grainsPerSecond, (unsigned long long)s.shortfalls, (unsigned long long)s.lateWakes,
+                     s.decodeP99, s.sinkTargetMs, i + 1 < r.steps.size() ? "," : "");
+    }
+    std::fprintf(f, "  ],\n  \"io_faults\": {\"read_latency_ms\": %g, \"bandwidth_mbps\": %g, \"stall_probability\": %g, "
+                    "\"stall_ms\": %g, \"error_probability\": %g},\n  \"survival\": [\n",
+                 opt.faults.readLatencyMs, opt.faults.bandwidthMBps, opt.faults.stallProbability, opt.faults.stallMs,
+                 opt.faults.errorProbability);
+    for (size_t i = 0; i < r.survival.size(); i++) {
+        const SurvivalResult &s = r.survival[i];
+        std::fprintf(f, "    {\"lookahead_ms\": %g, \"survived_seconds\": %.2f, \"no_underrun\": %s, \"grains\": %llu, "
+                        "\"grain_failures\": %llu, \"stalls\": %llu, \"read_errors\": %llu}%s\n",
+                     s.lookaheadMs, s.survivedSeconds, s.survivedAll ? "true" : "false", (unsigned long long)s.grains,
+                     (unsigned long long)s.grainFailures, (unsigned long long)s.stalls,
+                     (unsigned long long)s.readErrors, i + 1 < r.survival.size() ? "," : "");
+    }
+    std::fprintf(f, "  ],\n  \"render_checks\": [\n");
+    for (size_t i = 0; i < r.renderChecks.size(); i++) {
+        const RenderCheckResult &c = r.renderChecks[i];
+        std::fprintf(f, "    {\"settings\": \"%s\", \"level_ratio\": %.4f, \"boundary_level_ratio\": %.4f, \"passed\": %s}%s\n",
+                     c.settings.c_str(), c.pieceRatio, c.boundaryRatio, c.passed ? "true" : "false",
+                     i + 1 < r.renderChecks.size() ? "," : "");
+    }
+    std::fprintf(f, "  ]\n}\n");
+    return std::fclose(f) == 0;
+}
+
+// One fixed-depth run with faults injected: plays until the first underrun or opt.surviveSeconds
+SurvivalResult surviveAt(Walkk &walkk, const StressOptions &opt, IoFaultInjector &injector, double lookaheadMs) {
+    SurvivalResult r;
+    r.lookaheadMs = lookaheadMs;
+    walkk.sinkDepth.minLatency.store(lookaheadMs / 1000.0);
+    walkk.sinkDepth.maxLatency.store(lookaheadMs / 1000.0);
+
+    const uint64_t grains0 = walkk.producerStats.grains.load(), failures0 = walkk.producerStats.grainFailures.load();
+    const uint64_t stalls0 = injector.stalls.load(), errors0 = injector.errors.load();
+
+    Pipeline pipeline(walkk, opt.bufferFrames);
+    if (pipeline.start() < 0.0) return r;
+
+    // Startup shortfalls are not what's measured: let the sink fill to its depth first
+    auto fillStart = Clock::now();
+    while (walkk.sink.getQueuedSamples() < walkk.sink.targetDepth.load() * 9 / 10 &&
+           Clock::now() - fillStart < std::chrono::seconds(10)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    const uint64_t shortfalls0 = shortfalls(walkk.health.stats());
+
+    auto t0 = Clock::now();
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        r.survivedSeconds = std::chrono::duration<double>(Clock::now() - t0).count();
+        if (shortfalls(walkk.health.stats()) > shortfalls0) break;
+        if (r.survivedSeconds >= opt.surviveSeconds) {
+            r.survivedAll = true;
+            break;
+        }
+    }
+    pipeline.stop();
+
+    r.grains = walkk.producerStats.grains.load() - grains0;
+    r.grainFailures = walkk.producerStats.grainFailures.load() - failures0;
+    r.stalls = injector.stalls.load() - stalls0;
+    r.readErrors = injector.errors.load() - errors0;
+    return r;
+}
+
+// Mean square of a rendered piece, overall and in the first `window` frames after every
+// multiple of `period` (the segment boundaries of the segmented render, the same frames in the
+// other). The tail past the piece's length is left out.
+struct LevelMeter {
+    uint64_t period = 0, window = 0, totalFrames = 0;
+    uint64_t frame = 0;
+    double energy = 0.0, boundaryEnergy = 0.0;
+    uint64_t frames = 0, boundaryFrames = 0;
+
+    void add(const float *samples, size_t count) {
+        for (size_t i = 0; i + 1 < count && frame < totalFrames; i += Walkk::kChannels, ++frame) {
+            const double e = 0.5 * ((double)samples[i] * samples[i] + (double)samples[i + 1] * samples[i + 1]);
+            energy += e;
+            frames++;
+            if (frame >= period && frame % period < window) {
+                boundaryEnergy += e;
+                boundaryFrames++;
+            }
+        }
+    }
+    double level() const { return frames ? energy / (double)frames : 0.0; }
+    double boundaryLevel() const { return boundaryFrames ? boundaryEnergy / (double)boundaryFrames : 0.0; }
+};
+
+LevelMeter renderLevel(Walkk &walkk, const StressOptions &opt, double segmentSeconds) {
+    OfflineRenderConfig config;
+    config.seconds = opt.renderSeconds;
+    config.segmentSeconds = segmentSeconds;
+    config.seed = opt.seed;
+
+    LevelMeter meter;
+    meter.period = (uint64_t)std::llround(opt.renderSegmentSeconds * Walkk::kSampleRate);
+    meter.window = meter.period / 4;
+    meter.totalFrames = (uint64_t)std::llround(opt.renderSeconds * Walkk::kSampleRate);
+    walkk.allFinished.store(false);
+    renderPiece(&walkk, config, [&meter](const float *samples, size_t count) { meter.add(samples, count); });
+    return meter;
+}
+
+// The segmented render against one long segment, with `name`d settings already applied
+RenderCheckResult checkRender(Walkk &walkk, const StressOptions &opt, const std::string &name) {
+    const LevelMeter whole = renderLevel(walkk, opt, opt.renderSeconds);
+    const LevelMeter split = renderLevel(walkk, opt, opt.renderSegmentSeconds);
+
+    RenderCheckResult r;
+    r.settings = name;
+    r.pieceRatio = whole.level() > 0.0 ? split.level() / whole.level() : 0.0;
+    r.boundaryRatio = whole.boundaryLevel() > 0.0 ? split.boundaryLevel() / whole.boundaryLevel() : 0.0;
+    r.passed = std::abs(r.pieceRatio - 1.0) <= opt.renderTolerance && std::abs(r.boundaryRatio - 1.0) <= opt.renderTolerance;
+    return r;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    StressOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        auto needValue = [&](const char *name) -> const char * {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << name << std::endl;
+                return nullptr;
+            }
+            return argv[++i];
+        };
+        const char *v = nullptr;
+        if (arg == "--reuse" || arg == "--survival" || arg == "--no-ramp" || arg == "--rt-strict" ||
+            arg == "--render-check") {
+            if (arg == "--reuse") opt.reuse = true;
+            if (arg == "--survival") opt.survival = true;
+            if (arg == "--no-ramp") opt.ramp = false;
+            if (arg == "--rt-strict") opt.rtStrict = true;
+            if (arg == "--render-check") opt.renderCheck = true;
+            continue;
+        }
+        if (arg == "--help" || arg == "-h" || !(v = needValue(arg.c_str()))) {
+            printUsage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+        if (arg == "--files") opt.files = (size_t)std::strtoull(v, nullptr, 10);
+        else if (arg == "--min-seconds") opt.minSeconds = std::atof(v);
+        else if (arg == "--max-seconds") opt.maxSeconds = std::atof(v);
+        else if (arg == "--seed") opt.seed = std::strtoull(v, nullptr, 10);
+        else if (arg == "--dir") opt.directory = v;
+        else if (arg == "--max-voices") opt.maxVoices = (size_t)std::strtoull(v, nullptr, 10);
+        else if (arg == "--step-seconds") opt.stepSeconds = std::atof(v);
+        else if (arg == "--buffer-frames") opt.bufferFrames = std::strtoul(v, nullptr, 10);
+        else if (arg == "--sink-max-ms") opt.sinkMaxMs = std::atof(v);
+        else if (arg == "--json") opt.jsonPath = v;
+        else if (arg == "--io-latency-ms") opt.faults.readLatencyMs = std::atof(v);
+        else if (arg == "--io-bandwidth") opt.faults.bandwidthMBps = std::atof(v);
+        else if (arg == "--io-stall-prob") opt.faults.stallProbability = std::atof(v);
+        else if (arg == "--io-stall-ms") opt.faults.stallMs = std::atof(v);
+        else if (arg == "--io-error-prob") opt.faults.errorProbability = std::atof(v);
+        else if (arg == "--survive-seconds") opt.surviveSeconds = std::atof(v);
+        else if (arg == "--survival-voices") opt.survivalVoices = (size_t)std::strtoull(v, nullptr, 10);
+        else if (arg == "--render-seconds") opt.renderSeconds = std::atof(v);
+        else if (arg == "--render-segment-seconds") opt.renderSegmentSeconds = std::atof(v);
+        else if (arg == "--render-tolerance") opt.renderTolerance = std::atof(v);
+        else if (arg == "--lookahead-ms") {
+            opt.lookaheadMs.clear();
+            std::stringstream list(v);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                if (std::atof(item.c_str()) > 0.0) opt.lookaheadMs.push_back(std::atof(item.c_str()));
+            }
+        }
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    opt.maxVoices = std::clamp<size_t>(opt.maxVoices, 1, Mixer::kMaxVoices);
+    opt.survivalVoices = std::clamp<size_t>(opt.survivalVoices, 1, Mixer::kMaxVoices);
+    opt.faults.seed = opt.seed;
+    if (opt.faults.enabled()) opt.survival = true;
+    if (opt.files == 0 || opt.minSeconds <= 0.5 || opt.bufferFrames == 0) {
+        std::cerr << "Need --files > 0, --min-seconds > 0.5 and --buffer-frames > 0" << std::endl;
+        return 1;
+    }
+    if (opt.renderCheck && (opt.renderSegmentSeconds <= 0.1 || opt.renderSeconds < 4 * opt.renderSegmentSeconds)) {
+        std::cerr << "Need --render-segment-seconds > 0.1 and --render-seconds of at least four segments" << std::endl;
+        return 1;
+    }
+    // A CI gate must not pass just because the build cannot check
+    if (opt.rtStrict && !rtChecksCompiledIn()) {
+        std::cerr << "--rt-strict needs a build with -DWALKK_RT_CHECKS=ON" << std::endl;
+        return 1;
+    }
+
+    // ----- Library
+    const bool temporary = opt.directory.empty();
+    fs::path dir = temporary ? fs::temp_directory_path() / ("walkk_stress_" + std::to_string(opt.seed))
+                             : fs::path(opt.directory);
+    // A generated library is removed on every exit, early errors included
+    struct RemoveLibrary {
+        fs::path dir;
+        bool active;
+        ~RemoveLibrary() {
+            std::error_code ec;
+            if (active) fs::remove_all(dir, ec);
+        }
+    } removeLibrary{dir, temporary && !opt.reuse};
+
+    StressReport report;
+    if (!opt.reuse) {
+        std::error_code ec;
+        if (temporary) fs::remove_all(dir, ec);
+        auto t0 = Clock::now();
+        std::cout << "Writing " << opt.files << " synthetic MP3s to " << dir.string() << "..." << std::endl;
+        if (!generateLibrary(opt, dir)) return 1;
+        report.generateSeconds = std::chrono::duration<double>(Clock::now() - t0).count();
+    }
+
+    const size_t sinkCapacity = (size_t)(opt.sinkMaxMs / 1000.0 * Walkk::kSampleRate) * (size_t)Walkk::kChannels;
+    Walkk walkk(sinkCapacity);
+    walkk.consoleLog = false;
+    walkk.sinkDepth.maxLatency.store(opt.sinkMaxMs / 1000.0);
+
+    auto scanStart = Clock::now();
+    loadDirectoryMp3s(dir.string().c_str(), walkk, true);
+    report.scanSeconds = std::chrono::duration<double>(Clock::now() - scanStart).count();
+    report.filesLoaded = walkk.files.size();
+    walkk.pumpEvents();
+    std::cout << "Scanned " << walkk.files.size() << " files in " << report.scanSeconds * 1000.0 << " ms" << std::endl;
+    if (walkk.files.empty()) {
+        std::cerr << "Nothing loaded" << std::endl;
+        return 1;
+    }
+
+    // ----- Step the voice count up until the sink runs dry
+    if (opt.ramp) {
+        Pipeline pipeline(walkk, opt.bufferFrames);
+        setVoices(walkk, 1);
+        report.ttfaSeconds = pipeline.start();
+        if (report.ttfaSeconds < 0.0) {
+            std::cerr << "Null output failed to start" << std::endl;
+            return 1;
+        }
+        std::cout << "First audio after " << report.ttfaSeconds * 1000.0 << " ms" << std::endl;
+
+        std::vector<size_t> levels;
+        for (size_t v = 1; v < opt.maxVoices; v = v < 4 ? v * 2 : v + 4) levels.push_back(v);
+        levels.push_back(opt.maxVoices);
+
+        for (size_t voices : levels) {
+            setVoices(walkk, voices);
+            std::this_thread::sleep_for(std::chrono::duration<double>(opt.warmupSeconds));
+
+            const AudioHealthStats before = walkk.health.stats();
+            const uint64_t grainsBefore = walkk.producerStats.grains.load();
+            LatencyHistogram decodeBefore;
+            walkk.producerStats.decodeTime.snapshot(decodeBefore);
+            auto t0 = Clock::now();
+            std::this_thread::sleep_for(std::chrono::duration<double>(opt.stepSeconds));
+            const double elapsed = std::chrono::duration<double>(Clock::now() - t0).count();
+            const AudioHealthStats after = walkk.health.stats();
+
+            // Decode p99 of this step only
+            LatencyHistogram decode;
+            walkk.producerStats.decodeTime.snapshot(decode);
+            for (int i = 0; i < LatencyHistogram::kBins; i++) decode.counts[i] -= decodeBefore.counts[i];
+            decode.total -= decodeBefore.total;
+
+            StepResult s;
+            s.voices = voices;
+            s.grainsPerSecond = (double)(walkk.producerStats.grains.load() - grainsBefore) / elapsed;
+            s.shortfalls = shortfalls(after) - shortfalls(before);
+            s.lateWakes = after.underflows - before.underflows;
+            s.decodeP99 = decode.percentile(0.99);
+            s.sinkTargetMs = walkk.sinkDepth.targetFrames.load() * 1000.0 / Walkk::kSampleRate;
+            report.steps.push_back(s);
+
+            char line[200];
+            std::snprintf(line, sizeof(line), "voices %3zu: %7.1f grains/s  decode p99 %6.2f ms  sink %6.1f ms  shortfalls %llu  late wakes %llu",
+                          s.voices, s.grainsPerSecond, s.decodeP99 * 1000.0, s.sinkTargetMs,
+                          (unsigned long long)s.shortfalls, (unsigned long long)s.lateWakes);
+            std::cout << line << std::endl;
+
+            if (s.shortfalls > 0) break;
+            report.maxCleanVoices = voices;
+            report.sustainedGrains = s.grainsPerSecond;
+        }
+        pipeline.stop();
+        std::cout << "Max voices without underrun: " << report.maxCleanVoices << " (" << report.sustainedGrains
+                  << " grains/s)" << std::endl;
+    }
+
+    // ----- Survival under injected I/O faults, one run per lookahead
+    if (opt.survival) {
+        IoFaultInjector injector(opt.faults);
+        walkk.ioFaults = &injector;
+        setVoices(walkk, opt.survivalVoices);
+        std::cout << "Survival with " << opt.survivalVoices << " voices: latency " << opt.faults.readLatencyMs
+                  << " ms, bandwidth " << opt.faults.bandwidthMBps << " MB/s, stalls " << opt.faults.stallProbability
+                  << " x " << opt.faults.stallMs << " ms, errors " << opt.faults.errorProbability << std::endl;
+        for (double lookahead : opt.lookaheadMs) {
+            lookahead = std::min(lookahead, opt.sinkMaxMs);
+            SurvivalResult r = surviveAt(walkk, opt, injector, lookahead);
+            report.survival.push_back(r);
+
+            char line[200];
+            std::snprintf(line, sizeof(line), "lookahead %6.0f ms: %s %7.2f s  grains %llu (failed %llu)  stalls %llu  read errors %llu",
+                          r.lookaheadMs, r.survivedAll ? "no underrun in" : "underrun after", r.survivedSeconds,
+                          (unsigned long long)r.grains, (unsigned long long)r.grainFailures,
+                          (unsigned long long)r.stalls, (unsigned long long)r.readErrors);
+            std::cout << line << std::endl;
+        }
+        walkk.ioFaults = nullptr;
+    }
+
+    // ----- Offline render: one segment against many
+    bool renderFailed = false;
+    if (opt.renderCheck) {
+        std::cout << "Render check: " << opt.renderSeconds << " s as one segment and as " << opt.renderSegmentSeconds
+                  << " s segments" << std::endl;
+        const Walkk::GranularSettings defaults;
+        struct Case {
+            const char *name;
+            void (*apply)(Walkk::GranularSettings &);
+        };
+        const Case cases[] = {
+            {"default", [](Walkk::GranularSettings &) {}},
+            {"noise gaps", [](Walkk::GranularSettings &s) { s.whiteNoiseMs = 300; }},
+            {"4 voices", [](Walkk::GranularSettings &s) {
+                 s.maxConcurrentGrains = 4;
+                 s.grainOverlapMs = s.maxGrainMs;
+             }},
+        };
+        for (const Case &c : cases) {
+            {
+                std::lock_guard<std::mutex> lock(walkk.settingsMutex);
+                walkk.settings = defaults;
+                c.apply(walkk.settings);
+            }
+            RenderCheckResult r = checkRender(walkk, opt, c.name);
+            report.renderChecks.push_back(r);
+            renderFailed = renderFailed || !r.passed;
+
+            char line[200];
+            std::snprintf(line, sizeof(line), "%-10s: level %.3f, after boundaries %.3f of one segment  %s",
+                          r.settings.c_str(), r.pieceRatio, r.boundaryRatio, r.passed ? "ok" : "FAIL");
+            std::cout << line << std::endl;
+        }
+    }
+
+    report.peakRss = peakRssBytes();
+    std::cout << "Peak RSS: " << report.peakRss / (1024.0 * 1024.0) << " MiB" << std::endl;
+
+    report.rtViolations = rtCheckStats().all();
+    if (rtChecksCompiledIn()) std::cerr << rtCheckReport();
+
+    if (!opt.jsonPath.empty() && !writeJson(opt.jsonPath, opt, report)) {
+        std::cerr << "Could not write " << opt.jsonPath << std::endl;
+    }
+
+    if (opt.rtStrict && report.rtViolations > 0) return 3;
+    return renderFailed ? 4 : 0;
+}
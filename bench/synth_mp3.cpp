@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "synth_mp3.h"
+
+namespace {
+
+const int kBitratesKbps[15] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+
+struct BitWriter {
+    std::vector<uint8_t> bytes;
+    size_t bitPos = 0;
+
+    void put(uint32_t value, int bits) {
+        for (int i = bits - 1; i >= 0; --i) {
+            if (bitPos / 8 >= bytes.size()) bytes.push_back(0);
+            if ((value >> i) & 1u) bytes[bitPos / 8] |= (uint8_t)(0x80u >> (bitPos % 8));
+            ++bitPos;
+        }
+    }
+};
+
+struct Rng {
+    uint64_t s;
+    uint32_t next() {
+        s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+        return (uint32_t)(s >> 32);
+    }
+};
+
+int bitrateIndexFor(int kbps) {
+    int best = 1;
+    for (int i = 1; i < 15; ++i) {
+        if (std::abs(kBitratesKbps[i] - kbps) < std::abs(kBitratesKbps[best] - kbps)) best = i;
+    }
+    return best;
+}
+
+} // namespace
+
+bool writeSynthMp3(const std::string &path, const SynthMp3Options &options) {
+    int srIndex;
+    switch (options.sampleRate) {
+    case 44100: srIndex = 0; break;
+    case 48000: srIndex = 1; break;
+    case 32000: srIndex = 2; break;
+    default: return false;
+    }
+    if (options.channels != 1 && options.channels != 2) return false;
+
+    FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+
+    const int nch = options.channels;
+    const int sideInfoBytes = nch == 1 ? 17 : 32;
+    const size_t frames = (size_t)(options.seconds * options.sampleRate / 1152.0) + 1;
+    const int baseIndex = bitrateIndexFor(options.bitrateKbps);
+    Rng rng{ options.seed * 0x9E3779B97F4A7C15ull + 0x2545F4914F6CDD1Dull };
+    uint64_t paddingAcc = 0;
+    bool ok = true;
+
+    for (size_t fr = 0; fr < frames && ok; ++fr) {
+        int brIndex = baseIndex;
+        if (options.vbr) {
+            brIndex = std::clamp(baseIndex + (int)(rng.next() % 5) - 2, 1, 14);
+        }
+        const int kbps = kBitratesKbps[brIndex];
+
+        // Frame length in bytes, with padding distributed so the average rate is exact
+        const uint64_t num = 144000ull * (uint64_t)kbps;
+        size_t frameBytes = (size_t)(num / (uint64_t)options.sampleRate);
+        paddingAcc += num % (uint64_t)options.sampleRate;
+        int padding = 0;
+        if (paddingAcc >= (uint64_t)options.sampleRate) {
+            paddingAcc -= (uint64_t)options.sampleRate;
+            padding = 1;
+            ++frameBytes;
+        }
+
+        const size_t mainBits = (frameBytes - 4 - (size_t)sideInfoBytes) * 8;
+        const size_t budget = mainBits / (size_t)(2 * nch);
+
+        // Bandwidth drifts slowly so the spectrum is not stationary
+        const double phase = (double)fr / 200.0;
+        const size_t bandQuads = (size_t)(40 + 60 * (0.5 + 0.5 * std::sin(phase)));
+
+        // Main data: one run of count1 quads per granule/channel, table B (4-bit codes)
+        BitWriter main;
+        uint32_t part23[2][2] = {};
+        for (int gr = 0; gr < 2; ++gr) {
+            for (int ch = 0; ch < nch; ++ch) {
+                size_t used = 0;
+                for (size_t q = 0; q < bandQuads && q < 144; ++q) {
+                    uint32_t flags = rng.next() & 0xF;
+                    int nonzero = std::popcount(flags);
+                    if (used + 4 + (size_t)nonzero > budget) break;
+                    main.put(~flags & 0xF, 4);
+                    main.put(rng.next() & ((1u << nonzero) - 1u), nonzero);
+                    used += 4 + (size_t)nonzero;
+                }
+                part23[gr][ch] = (uint32_t)used;
+            }
+        }
+
+        BitWriter hdr;
+        hdr.put(0xFFFB, 16);               // sync, MPEG-1, Layer III, no CRC
+        hdr.put((uint32_t)brIndex, 4);
+        hdr.put((uint32_t)srIndex, 2);
+        hdr.put((uint32_t)padding, 1);
+        hdr.put(0, 1);                     // private
+        hdr.put(nch == 1 ? 3 : 0, 2);      // mono / stereo
+        hdr.put(0, 2);                     // mode extension
+        hdr.put(0, 1);                     // copyright
+        hdr.put(1, 1);                     // original
+        hdr.put(0, 2);                     // emphasis
+
+        hdr.put(0, 9);                     // main_data_begin: no bit reservoir
+        hdr.put(0, nch == 1 ? 5 : 3);      // private bits
+        hdr.put(0, 4 * nch);               // scfsi
+        for (int gr = 0; gr < 2; ++gr) {
+            for (int ch = 0; ch < nch; ++ch) {
+                hdr.put(part23[gr][ch], 12);
+                hdr.put(0, 9);             // big_values
+                hdr.put(176 + (rng.next() % 8), 8); // global_gain
+                hdr.put(0, 4);             // scalefac_compress: no scalefactor bits
+                hdr.put(0, 1);             // window_switching_flag
+                hdr.put(0, 15);            // table_select x3
+                hdr.put(0, 4);             // region0_count
+                hdr.put(0, 3);             // region1_count
+                hdr.put(0, 1);             // preflag
+                hdr.put(0, 1);             // scalefac_scale
+                hdr.put(1, 1);             // count1table_select: table B
+            }
+        }
+
+        std::vector<uint8_t> frame(frameBytes, 0);
+        std::copy(hdr.bytes.begin(), hdr.bytes.end(), frame.begin());
+        std::copy(main.bytes.begin(), main.bytes.end(), frame.begin() + 4 + sideInfoBytes);
+        ok = std::fwrite(frame.data(), 1, frame.size(), f) == frame.size();
+    }
+
+    if (std::fclose(f) != 0) ok = false;
+    return ok;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Parameters for a synthetic MPEG-1 Layer III file
+struct SynthMp3Options {
+    int      sampleRate = 44100; // 32000, 44100 or 48000
+    int      channels = 2;       // 1 or 2
+    int      bitrateKbps = 128;  // CBR rate, or the average for VBR
+    bool     vbr = false;        // vary the bitrate index frame by frame
+    double   seconds = 10.0;
+    uint64_t seed = 1;
+};
+
+// Write a decodable MP3 made of count1-coded (+-1) spectral lines.
+// The content is band-limited noise whose bandwidth drifts over time, which
+// exercises the real Huffman/IMDCT/synthesis path of the decoder.
+// Returns false if the file could not be written or options are unsupported.
+bool writeSynthMp3(const std::string &path, const SynthMp3Options &options);
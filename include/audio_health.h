@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "sink_depth.h"
+
+// Status bits an output reports with each buffer (mirrors PortAudio's callback flags)
+enum AudioStatusFlag : uint32_t {
+    kStatusOutputUnderflow = 1u << 0, // device ran dry before this buffer: an xrun
+    kStatusOutputOverflow  = 1u << 1,
+    kStatusPrimingOutput   = 1u << 2, // buffer is pre-roll, not yet audible
+};
+
+// Lock-free histogram with the same log-spaced bins as LatencyHistogram.
+// Any thread may record; readers take a snapshot.
+struct AtomicLatencyHistogram {
+    std::atomic<uint64_t> counts[LatencyHistogram::kBins] = {};
+    std::atomic<uint64_t> maxNs{0};
+    std::atomic<uint64_t> sumNs{0};
+
+    void record(uint64_t ns);
+    void snapshot(LatencyHistogram &out) const;
+    void reset();
+};
+
+// Plain copy of the counters for display
+struct AudioHealthStats {
+    uint64_t callbacks = 0;
+    uint64_t xruns = 0;          // device-reported underflows + overflows
+    uint64_t underflows = 0;
+    uint64_t overflows = 0;
+    uint64_t primingBuffers = 0;
+    uint64_t partialBuffers = 0; // sink had some audio, but not a whole buffer
+    uint64_t emptyBuffers = 0;   // sink had nothing: the whole buffer was silence
+    uint64_t overBudget = 0;     // callbacks that took longer than the buffer lasts
+
+    // Seconds
+    double callbackP50 = 0.0, callbackP99 = 0.0, callbackP999 = 0.0, callbackMax = 0.0;
+    double intervalP50 = 0.0, intervalP99 = 0.0, intervalMax = 0.0;
+};
+
+// Written by the output thread once per buffer, read from anywhere
+struct AudioHealth {
+    std::atomic<uint64_t> callbacks{0};
+    std::atomic<uint64_t> underflows{0};
+    std::atomic<uint64_t> overflows{0};
+    std::atomic<uint64_t> primingBuffers{0};
+    std::atomic<uint64_t> partialBuffers{0};
+    std::atomic<uint64_t> emptyBuffers{0};
+    std::atomic<uint64_t> overBudget{0};
+
+    AtomicLatencyHistogram callbackTime;     // time spent filling one buffer
+    AtomicLatencyHistogram callbackInterval; // time between consecutive buffers (jitter)
+
+    // Output thread: one call per buffer. `started` is false until real audio has
+    // flowed, so the pre-roll before the first block is not counted as a shortfall.
+    void recordBuffer(uint64_t startNs, uint64_t endNs, double bufferSeconds, uint32_t statusFlags,
+                      size_t framesCopied, size_t framesWanted, bool started);
+
+    AudioHealthStats stats() const;
+
+    // Call while no output is running
+    void reset();
+
+private:
+    std::atomic<uint64_t> lastStartNs{0};
+};
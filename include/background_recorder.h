@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_ring.h"
+#include "flac_writer.h"
+#include "wav_writer.h"
+
+enum class RecordingCodec {
+    Wav,  // WavFileWriter: s16, s24 or f32, RF64 past 4 GB
+    Flac, // FlacFileWriter: s16 or s24, about half the bytes
+};
+
+bool parseRecordingCodec(const std::string &text, RecordingCodec &codec);
+const char *recordingCodecName(RecordingCodec codec);
+
+// Records the output into one file from a worker thread. The output thread only copies into a
+// CaptureRing, so a disk that stalls (SD cards can hold an fwrite for hundreds of ms) uses
+// up ring space instead of glitching the audio. The worker converts, encodes and writes.
+struct BackgroundRecorder {
+    double bufferSeconds = 10.0; // how far the worker may fall behind; set before start()
+
+    BackgroundRecorder() = default;
+    ~BackgroundRecorder();
+    BackgroundRecorder(const BackgroundRecorder &) = delete;
+    BackgroundRecorder &operator=(const BackgroundRecorder &) = delete;
+
+    // Opens the file (so errors reach the caller) and starts the worker
+    bool start(const std::string &path, int sampleRate, int channels, WavSampleFormat format, RecordingCodec codec,
+               std::string &error);
+    // Writes out what is buffered, finishes the file and joins the worker. False if any write failed.
+    bool stop();
+    bool isActive() const { return ring.isOpen(); }
+
+    // Output thread, once per buffer. Never blocks or allocates.
+    void capture(const float *samples, size_t frames);
+
+    // Readable from any thread
+    std::atomic<uint64_t> framesWritten{0};
+    std::atomic<uint64_t> bytesWritten{0};  // audio as stored, compressed for FLAC
+    std::atomic<uint64_t> framesDropped{0}; // lost because the ring was full
+    std::atomic<bool> rf64{false};          // WAV past 4 GB
+
+private:
+    RecordingCodec codec = RecordingCodec::Wav;
+    int channels = 2;
+    WavFileWriter wav;
+    FlacFileWriter flac;
+
+    CaptureRing<float> ring; // output -> worker
+    std::atomic<bool> stopRequested{false};
+    std::atomic<bool> failed{false};
+    std::thread worker;
+    std::vector<float> chunk; // worker only
+
+    void run();
+    bool writeChunk(size_t frames);
+};
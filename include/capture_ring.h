@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <thread>
+
+// Hands output audio from the output thread to another thread: a single-producer,
+// single-consumer ring plus the gate that lets the owner stop capturing while an output
+// callback may still be running. Every recorder (BackgroundRecorder, SegmentRecorder,
+// RetroCapture) captures through one of these, so the callback side and its memory
+// orderings exist once.
+//
+// Positions count samples since open(); owners keep them multiples of their channel count.
+template <typename T>
+struct CaptureRing {
+    // One capture on the output thread. While it lives close() waits; false if the ring is closed.
+    class Scope {
+    public:
+        explicit Scope(CaptureRing &r) : ring(r) {
+            ring.capturing.fetch_add(1);
+            isOpen = ring.enabled.load();
+        }
+        ~Scope() { ring.capturing.fetch_sub(1); }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        explicit operator bool() const { return isOpen; }
+
+    private:
+        CaptureRing &ring;
+        bool isOpen;
+    };
+
+    CaptureRing() = default;
+    CaptureRing(const CaptureRing &) = delete;
+    CaptureRing &operator=(const CaptureRing &) = delete;
+
+    // While closed. Zeroed, so the pages are committed here rather than on the output thread.
+    void allocate(size_t samples) {
+        storage.reset(samples > 0 ? new T[samples]() : nullptr);
+        capacitySamples = samples;
+    }
+    void release() {
+        storage.reset();
+        capacitySamples = 0;
+    }
+    size_t capacity() const { return capacitySamples; }
+
+    // Rewinds to position 0 and lets captures in
+    void open() {
+        writePosition.store(0);
+        readPosition.store(0);
+        enabled.store(true);
+    }
+    // Turns captures away and waits for one still in progress; the consumer may keep draining
+    void close() {
+        enabled.store(false);
+        while (capturing.load() > 0) std::this_thread::yield();
+    }
+    bool isOpen() const { return enabled.load(); }
+
+    // Output thread, inside a Scope. Never blocks or allocates.
+    size_t space() const {
+        return capacitySamples - (size_t)(writePosition.load(std::memory_order_relaxed) -
+                                          readPosition.load(std::memory_order_acquire));
+    }
+    void push(const T *samples, size_t count) {
+        pushWith(count, [samples](T *dst, size_t offset, size_t n) { std::memcpy(dst, samples + offset, n * sizeof(T)); });
+    }
+    // `fill(dst, offset, n)` stores samples [offset, offset + n) of the block at dst, in one or
+    // two spans around the wrap. Overwrites the oldest samples: check space() first unless
+    // that is the point.
+    template <typename Fill>
+    void pushWith(size_t count, Fill &&fill) {
+        const uint64_t w = writePosition.load(std::memory_order_relaxed);
+        const size_t start = (size_t)(w % capacitySamples);
+        const size_t first = std::min(count, capacitySamples - start);
+        fill(storage.get() + start, (size_t)0, first);
+        if (count > first) fill(storage.get(), first, count - first);
+        writePosition.store(w + count, std::memory_order_release);
+    }
+
+    // Samples handed over so far. Readable from any thread.
+    uint64_t written() const { return writePosition.load(std::memory_order_acquire); }
+
+    // Consumer: moves up to `maxSamples` out, not past position `limit`. Returns how many.
+    uint64_t consumed() const { return readPosition.load(std::memory_order_relaxed); }
+    size_t pop(T *out, size_t maxSamples, uint64_t limit = std::numeric_limits<uint64_t>::max()) {
+        const uint64_t r = readPosition.load(std::memory_order_relaxed);
+        const uint64_t end = std::min(limit, written());
+        if (end <= r) return 0;
+        const size_t count = (size_t)std::min<uint64_t>(end - r, maxSamples);
+        copy(r, out, count);
+        readPosition.store(r + count, std::memory_order_release);
+        return count;
+    }
+
+    // Copies [position, position + count) without consuming it, for a reader that trails an
+    // overwriting writer (RetroCapture); it checks written() afterwards to see if it was lapped
+    void copy(uint64_t position, T *out, size_t count) const {
+        const size_t start = (size_t)(position % capacitySamples);
+        const size_t first = std::min(count, capacitySamples - start);
+        std::copy(storage.get() + start, storage.get() + start + first, out);
+        std::copy(storage.get(), storage.get() + (count - first), out + first);
+    }
+
+private:
+    std::unique_ptr<T[]> storage;
+    size_t capacitySamples = 0;
+    std::atomic<bool> enabled{false};
+    std::atomic<int> capturing{0};
+    std::atomic<uint64_t> writePosition{0};
+    std::atomic<uint64_t> readPosition{0};
+};
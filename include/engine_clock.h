@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Sample-accurate playback clock.
+//
+// The producer places every voice on the engine timeline (frames pushed into the sink).
+// The output thread advances this clock once per buffer with the engine frame it just
+// consumed and the moment that buffer reaches the DAC, so any thread can map between
+// engine frames and wall-clock time without guessing from queue depth.
+struct EngineClock {
+    using Clock = std::chrono::steady_clock;
+
+    int sampleRate;
+
+    // Device frames handed to the output so far, padding included (monotonic)
+    std::atomic<uint64_t> framesOutput{0};
+    // Engine-timeline frames taken from the sink so far
+    std::atomic<uint64_t> framesConsumed{0};
+
+    explicit EngineClock(int rate) : sampleRate(rate) {}
+
+    // Call while no output is running (before a stream starts)
+    void reset();
+
+    // Output thread, once per buffer: `consumed` sink frames (at the start of the buffer,
+    // followed by `bufferFrames - consumed` frames of padding) start playing after `dacDelaySeconds`.
+    void advance(uint64_t bufferFrames, uint64_t consumed, double dacDelaySeconds);
+
+    // Engine frame being heard right now (stalls at the last real frame during an underrun)
+    uint64_t playbackFrame() const;
+
+    // Wall-clock time at which engine frame `frame` reaches (or reached) the DAC
+    Clock::time_point timeOfFrame(uint64_t frame) const;
+
+private:
+    struct Anchor {
+        uint64_t frame;   // engine frame at the start of the latest buffer
+        uint64_t frames;  // real (non-padding) frames in that buffer
+        int64_t  dacNs;   // steady_clock time the buffer starts playing
+    };
+
+    // Seqlock-protected anchor: written by the output thread only, read lock-free anywhere
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint64_t> anchorFrame{0};
+    std::atomic<uint64_t> anchorFrames{0};
+    std::atomic<int64_t>  anchorDacNs{0};
+
+    Anchor readAnchor() const;
+};
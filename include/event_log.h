@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class EventType : uint8_t {
+    GrainStart,      // a=engine frame, b=file frame, c=file index, d=duration frames, value=amplitude
+    GrainReadFailed, // c=file index
+    Underrun,        // a=engine frame, d=frames padded with silence
+    SinkDepth,       // a=old target frames, b=new target frames, value=p99 lateness ms, c=p99 decode us
+};
+
+// One cache line, written without allocation from any thread (including the audio callback).
+// Only the audio and producer threads log here; cold paths like the library scan use addLog.
+struct EventRecord {
+    uint64_t timeNs = 0;   // steady_clock
+    uint64_t a = 0;
+    uint64_t b = 0;
+    uint32_t c = 0;
+    uint32_t d = 0;
+    float    value = 0.0f;
+    EventType type = EventType::GrainStart;
+    uint8_t  flags = 0;    // GrainStart: kFlagLoop | kFlagReverse
+    uint8_t  reserved[26] = {}; // pads to 64 bytes
+
+    static constexpr uint8_t kFlagLoop = 1;
+    static constexpr uint8_t kFlagReverse = 2;
+};
+
+// Bounded lock-free multi-producer ring of binary events. Writers never block: when the
+// ring is full the event is dropped and counted. Records are formatted only when drained.
+struct EventLog {
+    static constexpr size_t kCapacity = 4096; // power of two
+
+    EventLog();
+
+    // Any thread; stamps timeNs if zero. Returns false if the ring was full.
+    bool push(EventRecord record);
+
+    // Reader side; returns false when empty
+    bool pop(EventRecord &record);
+
+    std::atomic<uint64_t> dropped{0};
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq{0};
+        EventRecord record;
+    };
+    std::vector<Slot> slots;
+    alignas(64) std::atomic<size_t> head{0}; // next slot to write
+    alignas(64) std::atomic<size_t> tail{0}; // next slot to read
+};
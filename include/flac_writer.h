@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "sample_convert.h"
+#include "wav_writer.h"
+
+// Built-in lossless FLAC encoder writing a .flac file: fixed and LPC prediction, partitioned
+// Rice residuals, stereo decorrelation. Same calling pattern as WavFileWriter. Only the
+// integer formats (Int16, Int24) exist in FLAC.
+//
+// STREAMINFO gets its sample count and frame sizes on close(); a file cut short by a crash
+// says "length unknown" but every frame written so far still decodes.
+struct FlacFileWriter {
+    // Set before open()
+    int blockSize = 4096;      // frames per FLAC frame
+    int maxLpcOrder = 8;       // 0 = fixed predictors only (cheapest)
+    int maxPartitionOrder = 6; // Rice partitions per subframe: up to 2^this
+    DitherMode dither = DitherMode::Tpdf;
+
+    uint64_t dataBytes = 0;     // encoded bytes written (after STREAMINFO)
+    uint64_t framesWritten = 0; // sample frames encoded
+
+    FlacFileWriter() = default;
+    ~FlacFileWriter() { close(); }
+    FlacFileWriter(const FlacFileWriter &) = delete;
+    FlacFileWriter &operator=(const FlacFileWriter &) = delete;
+
+    bool open(const std::string &path, uint32_t sampleRate, uint16_t numChannels, WavSampleFormat sampleFormat);
+    // Buffers whole blocks and encodes each as it fills
+    bool write(const float *audioData, size_t frameCount);
+    // Encodes the partial last block, rewrites STREAMINFO, closes. False if anything failed.
+    bool close();
+    bool isOpen() const { return file != nullptr; }
+
+private:
+    FILE *file = nullptr;
+    uint32_t sampleRate = 48000;
+    int channels = 2;
+    int bitsPerSample = 16;
+    bool failed = false;
+
+    uint64_t frameNumber = 0;
+    uint32_t minFrameBytes = 0;
+    uint32_t maxFrameBytes = 0;
+
+    DitherState ditherState;
+    AlignedBuffer<uint8_t> converted;
+    std::vector<std::vector<int32_t>> pending; // per channel, blockSize each
+    size_t pendingFrames = 0;
+
+    // Encoder scratch, reused block to block
+    std::vector<int32_t> mid, side, residual;
+    std::vector<double> window, windowed;
+    std::vector<uint8_t> frame;
+
+    bool writeStreamInfo();
+    bool encodeBlock(size_t frames);
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+// Window shapes available for grain attack/release
+enum class EnvelopeShape : int {
+    Hann = 0,    // raised cosine over the whole grain (attack/release ignored)
+    Tukey,       // raised cosine ramps over attack/release, flat sustain
+    Trapezoid,   // linear ramps over attack/release, flat sustain
+    Exponential, // exponential ramps over attack/release, flat sustain
+};
+
+constexpr int kEnvelopeShapeCount = 4;
+
+// Resolution of the precomputed ramp tables (one guard entry is added for interpolation)
+constexpr size_t kEnvelopeTableSize = 512;
+
+const char *envelopeShapeName(EnvelopeShape shape);
+
+// Table-interpolated ramp gain for x in [0, 1] (0 = silent edge, 1 = full level)
+float envelopeRampGain(EnvelopeShape shape, float x);
+
+// Apply the window in place to interleaved samples.
+// Only the attack and release regions are touched; the sustain is left as-is.
+// attackFrames + releaseFrames larger than frames are scaled down proportionally.
+void applyGrainEnvelope(float *samples, size_t frames, int channels,
+                        EnvelopeShape shape, size_t attackFrames, size_t releaseFrames);
+
+// Same window with every gain computed in double precision instead of read from the tables.
+// Slower; for offline renders (--render-quality high).
+void applyGrainEnvelopeExact(float *samples, size_t frames, int channels,
+                             EnvelopeShape shape, size_t attackFrames, size_t releaseFrames);
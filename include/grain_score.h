@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Session "score": the binary log of every voice the producer scheduled, with the settings in
+// force. Each voice is fully described by its record (file position, length, loop, envelope,
+// noise seed) plus the mixer slot it played in, so replaying a score through readGrain and the
+// Mixer reproduces the live mix sample for sample, without keeping any audio.
+//
+// Layout (little-endian): "WKSC", version, sample rate, channels, file count, then per file its
+// sample rate, channels, total frames and relative path; then records, each a ScoreRecordType
+// byte followed by a 64-byte ScoreVoice or ScoreSettings payload or the (End) uint64 engine frame.
+// Fields are serialized one by one, so the structs below are not the file layout.
+// loadScore() rejects a score whose voices point outside the mixer, the file table or the
+// shape enums.
+
+enum class ScoreRecordType : uint8_t {
+    Grain = 1,
+    Noise = 2,
+    Settings = 3,
+    End = 4, // engine frame where the session stopped
+};
+
+// Grain and Noise records
+struct ScoreVoice {
+    uint64_t engineFrame = 0;   // first frame on the engine timeline
+    uint64_t sourceFrame = 0;   // Grain: first frame in the file
+    uint64_t noiseSeed = 0;     // Noise
+    uint32_t fileIndex = 0;     // Grain: index into Score::files
+    uint32_t lengthFrames = 0;  // output frames
+    uint32_t loopWindowFrames = 0;
+    int32_t  loopDragFrames = 0;
+    uint32_t attackFrames = 0;
+    uint32_t releaseFrames = 0;
+    float    amplitude = 0.0f;
+    uint8_t  slot = 0;          // mixer voice it played in; fixes the summation order
+    uint8_t  flags = 0;         // kFlagLoop | kFlagReverse
+    uint8_t  shape = 0;         // Grain: EnvelopeShape, Noise: NoiseColor
+    ScoreRecordType type = ScoreRecordType::Grain;
+    uint32_t reserved = 0;
+
+    static constexpr uint8_t kFlagLoop = 1;
+    static constexpr uint8_t kFlagReverse = 2;
+};
+
+// Walkk::GranularSettings as it was from `engineFrame` on
+struct ScoreSettings {
+    uint64_t engineFrame = 0;
+    uint32_t minGrainMs = 0;
+    uint32_t maxGrainMs = 0;
+    uint32_t grainOverlapMs = 0;
+    uint32_t maxConcurrentGrains = 0;
+    uint32_t minLoopWindowMs = 0;
+    uint32_t maxLoopWindowMs = 0;
+    int32_t  maxLoopDragMs = 0;
+    uint32_t whiteNoiseMs = 0;
+    uint32_t envelopeAttackMs = 0;
+    uint32_t envelopeReleaseMs = 0;
+    float    loopProbability = 0.0f;
+    float    bouncebackProbability = 0.0f;
+    float    whiteNoiseAmplitude = 0.0f;
+    uint8_t  noiseColor = 0;
+    uint8_t  envelopeShape = 0;
+    uint8_t  reserved[2] = {};
+};
+
+struct ScoreFile {
+    std::string path; // relative to the library directory
+    uint64_t totalFrames = 0;
+    uint32_t sampleRate = 0;
+    uint32_t channels = 0;
+};
+
+// A whole score in memory (about 64 bytes per grain: a 10-hour session is a few MB)
+struct Score {
+    uint32_t sampleRate = 0;
+    uint32_t channels = 0;
+    std::vector<ScoreFile> files;
+    std::vector<ScoreVoice> voices; // Grain and Noise records, in scheduling order
+    std::vector<ScoreSettings> settings;
+    uint64_t endFrame = 0; // End record, or where the last voice stops if the file was cut short
+    bool complete = false; // End record present
+};
+
+bool loadScore(const std::string &path, Score &score, std::string &error);
+
+// Appends records as the producer schedules voices. Buffered; flushed every few seconds of
+// engine time, so a crash loses at most the tail.
+struct ScoreWriter {
+    ScoreWriter() = default;
+    ~ScoreWriter();
+    ScoreWriter(const ScoreWriter &) = delete;
+    ScoreWriter &operator=(const ScoreWriter &) = delete;
+
+    bool open(const std::string &path, uint32_t sampleRate, uint32_t channels, const std::vector<ScoreFile> &files,
+              std::string &error);
+    bool isOpen() const { return file != nullptr; }
+
+    // Producer thread
+    void addVoice(const ScoreVoice &voice);
+    void addSettings(const ScoreSettings &settings);
+
+    // Writes the End record (engine frame `endFrame`) and closes. False if any write failed.
+    // Destroying an open writer closes it without one, like a crash would.
+    bool close(uint64_t endFrame);
+
+    uint64_t voicesWritten = 0;
+
+private:
+    FILE *file = nullptr;
+    uint32_t sampleRate = 48000;
+    uint64_t flushedFrame = 0;
+    bool failed = false;
+
+    void writeRecord(ScoreRecordType type, const uint8_t *payload, size_t bytes);
+};
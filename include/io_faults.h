@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include "minimp3_ex.h"
+
+// What a degraded drive looks like (slow USB stick, NFS hiccups). All zero: healthy.
+struct IoFaultConfig {
+    double readLatencyMs = 0.0;    // added to every read and seek
+    double bandwidthMBps = 0.0;    // read throughput cap, 0 = unlimited
+    double stallProbability = 0.0; // chance per read of an additional stall
+    double stallMs = 0.0;
+    double errorProbability = 0.0; // chance per read that it fails outright
+    uint64_t seed = 1;
+
+    bool enabled() const {
+        return readLatencyMs > 0.0 || bandwidthMBps > 0.0 || (stallProbability > 0.0 && stallMs > 0.0) ||
+               errorProbability > 0.0;
+    }
+};
+
+struct IoFaultInjector;
+
+// One file opened for a decoder through the injector; lives until the decoder is closed
+struct FaultyFile {
+    FILE *file = nullptr;
+    IoFaultInjector *injector = nullptr;
+    mp3dec_io_t io{};
+
+    ~FaultyFile() {
+        if (file) std::fclose(file);
+    }
+};
+
+// Resilience testing only: decoder reads go through stdio with the configured delays and
+// errors injected, instead of minimp3's memory-mapped file access
+struct IoFaultInjector {
+    IoFaultConfig config;
+
+    // Injected so far, readable from any thread
+    std::atomic<uint64_t> reads{0};
+    std::atomic<uint64_t> bytesRead{0};
+    std::atomic<uint64_t> stalls{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> delayNs{0};
+
+    explicit IoFaultInjector(const IoFaultConfig &c) : config(c), rng(c.seed) {}
+
+    // mp3dec_ex_open through the injector. On success `holder` owns the file until the decoder
+    // is closed. Returns minimp3's error code (0 on success).
+    int open(mp3dec_ex_t *dec, const std::string &path, int flags, std::unique_ptr<FaultyFile> &holder);
+
+    // Sleep for the latency/bandwidth/stall of one access of `bytes`; false if it should fail
+    bool inject(size_t bytes);
+
+private:
+    std::mutex rngMutex;
+    std::mt19937_64 rng;
+};
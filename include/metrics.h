@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+struct Walkk;
+
+// Where the Prometheus text exposition goes. Both may be enabled at once.
+struct MetricsConfig {
+    int port = 0;               // serve http://<bindAddress>:<port>/metrics, 0 = off
+    std::string bindAddress = "127.0.0.1";
+    std::string filePath;       // rewrite this file (atomically, via rename) every fileInterval seconds
+    double fileInterval = 10.0;
+
+    bool enabled() const { return port > 0 || !filePath.empty(); }
+};
+
+// Render every engine metric in Prometheus text format. Reads only atomics the audio and
+// producer threads already maintain, so it never takes their locks.
+std::string formatPrometheusMetrics(Walkk &walkk, double grainsPerSecond);
+
+// Resident set size of this process in bytes, 0 when the platform does not say
+size_t currentRssBytes();
+
+// Highest resident set size this process has reached, 0 when unknown
+size_t peakRssBytes();
+
+// Background thread serving and/or writing formatPrometheusMetrics()
+struct MetricsExporter {
+    ~MetricsExporter() { stop(); }
+
+    // Returns false (with error set) if the socket cannot be bound
+    bool start(Walkk &walkk, const MetricsConfig &config, std::string &error);
+    void stop();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Walkk *walkk = nullptr;
+    MetricsConfig config;
+    std::thread worker;
+    std::atomic<bool> stopping{false};
+    intptr_t listenSocket = -1;
+
+    // grains/sec over the last sampling window; exporter thread only
+    uint64_t rateGrains = 0;
+    Clock::time_point rateStart;
+    double grainsPerSecond = 0.0;
+
+    void run();
+    void sampleRate();
+    void serveClient(intptr_t client);
+    bool writeFile();
+};
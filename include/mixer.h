@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "noise_gen.h"
+
+// One sound source scheduled on the engine timeline (frames at the sink rate)
+struct MixerVoice {
+    enum class Type { Grain, Noise };
+
+    Type     type = Type::Grain;
+    bool     active = false;
+    uint64_t startFrame = 0;    // engine frame of the first output frame
+    size_t   lengthFrames = 0;
+    size_t   position = 0;      // frames already rendered
+
+    // Grain: pre-rendered interleaved samples (capacity is reused across grains)
+    std::vector<float> buffer;
+    size_t fileIndex = 0;
+
+    // Noise: rendered block by block, nothing is buffered
+    NoiseGenerator noise;
+
+    uint64_t endFrame() const { return startFrame + lengthFrames; }
+};
+
+// Fixed pool of voices summed into interleaved output blocks.
+// Owned and driven by the producer thread only.
+struct Mixer {
+    static constexpr size_t kMaxVoices = 32;
+    static constexpr size_t kMaxBlockFrames = 4096;
+
+    int channels;
+    uint64_t renderFrame = 0; // engine frame of the next block to render
+    std::vector<MixerVoice> voices;
+
+    explicit Mixer(int ch) : channels(ch), voices(kMaxVoices) {}
+
+    // Returns an inactive voice (marked active) or nullptr if the pool is exhausted
+    MixerVoice *allocateVoice(MixerVoice::Type type);
+    // Claims voice `slot` (score replay keeps the slots of the live session, which fix the order
+    // voices are summed in); nullptr if it is still playing
+    MixerVoice *allocateVoice(MixerVoice::Type type, size_t slot);
+
+    size_t activeVoices() const;
+    size_t activeVoices(MixerVoice::Type type) const;
+
+    // Drop all voices and restart the timeline at frame 0
+    void reset();
+
+    // Overwrite `out` with the sum of every voice overlapping the next `frames` frames
+    // (frames <= kMaxBlockFrames) and advance renderFrame.
+    void render(float *out, size_t frames);
+    // render() without the audio: retires the voices that end in the next `frames` frames
+    void advance(size_t frames);
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class NoiseColor : int {
+    White = 0,
+    Pink,   // -3 dB/octave (Paul Kellet's economy filter)
+    Brown,  // -6 dB/octave (leaky integrator)
+};
+
+constexpr int kNoiseColorCount = 3;
+
+const char *noiseColorName(NoiseColor color);
+
+// SplitMix64 step, used to derive independent seeds from one base seed
+uint64_t splitMix64(uint64_t &state);
+
+// Multi-lane xorshift noise source.
+// Sample k of the stream always comes from lane (k % kLanes), so the output only
+// depends on the seed and the sample index, not on how rendering is split into blocks.
+struct NoiseGenerator {
+    static constexpr int kLanes = 8;
+    static constexpr int kMaxChannels = 2;
+
+    alignas(16) uint32_t lanes[kLanes];
+    uint64_t samplesRendered = 0;
+
+    // Coloring filter state, per channel
+    float pinkState[kMaxChannels][3] = {};
+    float brownState[kMaxChannels] = {};
+
+    NoiseColor color = NoiseColor::White;
+    float amplitude = 0.25f;
+
+    NoiseGenerator() { seed(0); }
+
+    void seed(uint64_t seedValue);
+
+    // Overwrite `samples` interleaved values (channels <= kMaxChannels) with noise scaled by amplitude
+    void render(float *out, size_t samples, int channels);
+};
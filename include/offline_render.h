@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "walkk.h"
+
+struct OfflineRenderConfig {
+    double seconds = 0.0;         // length of the piece; the last grains ring out past it
+    double segmentSeconds = 30.0; // timeline split: changes the piece, the thread count does not
+    int threads = 0;              // 0 = one per core
+    uint64_t seed = 0;
+    GrainQuality quality = GrainQuality::Live;
+    size_t blockFrames = 512;     // fixed, so scheduling never depends on the output's buffer size
+};
+
+// Seed of segment `segment` of a render seeded with `seed`
+uint64_t segmentSeed(uint64_t seed, uint64_t segment);
+
+// Generates a new piece from walkk.settings on every core and hands it to `emit` in timeline
+// order. The timeline is cut into segments of segmentSeconds; each renders on its own engine
+// (library, rng, mixer) seeded from segmentSeed, schedules grains only inside its span and lets
+// the last ones ring out. A quick sequential pass first schedules every segment without
+// decoding, so each one starts with the previous one's tail in its voice budget and its first
+// grain waits for that tail (and its noise gap) as in one long run: the boundaries do not
+// show in the level. Segments are stitched in order, each tail added onto the start of what
+// follows; at most two segments per thread are held at once. Returns early if
+// walkk->allFinished is set.
+//
+// The audio depends on the seed, settings, library and segment length only: any thread count
+// gives the same samples.
+void renderPiece(Walkk *walkk, const OfflineRenderConfig &config,
+                 const std::function<void(const float *, size_t)> &emit);
+
+// Producer loop: renderPiece() into the sink
+void parallelRenderLoop(Walkk *walkk, const OfflineRenderConfig &config);
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flac_writer.h"
+#include "rt_thread.h"
+#include "wav_writer.h"
+
+struct CallbackData;
+
+enum class OutputBackendType {
+    PortAudio, // sound card (only when built with PortAudio)
+    Null,      // discard samples
+    WavFile,   // WAV file (s16, s24 or f32)
+    FlacFile,  // FLAC file (s16 or s24)
+    Pipe,      // raw interleaved PCM to stdout, a FIFO or a file
+};
+
+enum class PipeSampleFormat {
+    Float32, // native-endian 32-bit float
+    S16,     // native-endian signed 16-bit
+};
+
+// Sound card selection for the PortAudio backend
+struct AudioDeviceSettings {
+    int deviceIndex = -1;          // PortAudio device index, -1 to pick by name or default
+    std::string deviceName;        // case-insensitive substring of the device name
+    std::string hostApi;           // case-insensitive substring, e.g. "ALSA", "JACK", "WASAPI"
+    double suggestedLatency = 0.0; // seconds, 0 for the device's default low output latency
+};
+
+struct AudioDeviceInfo {
+    int index = -1;
+    std::string name;
+    std::string hostApi;
+    int maxOutputChannels = 0;
+    double defaultLowLatency = 0.0;  // seconds
+    double defaultHighLatency = 0.0; // seconds
+    double defaultSampleRate = 0.0;
+    bool isDefault = false;
+};
+
+struct OutputConfig {
+    OutputBackendType type = OutputBackendType::PortAudio;
+    int channels = 2;
+    int sampleRate = 48000;
+    unsigned long framesPerBuffer = 256; // 0 lets the device pick (paFramesPerBufferUnspecified)
+    AudioDeviceSettings device;
+
+    // Non-device backends: pace buffers at the sample rate (true) or pull as fast as the
+    // producer allows (false). Free-running backends wait for audio instead of padding silence.
+    bool realtime = true;
+
+    // Scheduling for the worker thread of null/wav/pipe (PortAudio runs its own callback thread)
+    ThreadTuning thread;
+
+    std::string path;  // WavFile/FlacFile: output file. Pipe: FIFO/file path, "-" or empty for stdout
+    PipeSampleFormat pipeFormat = PipeSampleFormat::Float32;
+    WavSampleFormat wavFormat = WavSampleFormat::Int16; // also FLAC's, which has no f32
+    DitherMode dither = DitherMode::Tpdf; // wav/flac/pipe integer formats
+};
+
+// Where rendered audio leaves the engine. Every backend pulls through renderOutputBuffer().
+struct OutputBackend {
+    virtual ~OutputBackend() = default;
+
+    // Returns 0 on success, a backend-specific error code otherwise
+    virtual int start() = 0;
+    virtual void stop() = 0;
+    virtual bool isActive() = 0;
+    virtual const char *name() const = 0;
+
+    // Frames delivered per buffer and output latency (seconds) as negotiated by start()
+    virtual unsigned long bufferFrames() const = 0;
+    virtual double outputLatency() const = 0;
+};
+
+// Keeps the device layer initialized while alive. Hold one for the whole
+// application session so play/stop does not re-initialize (and re-probe) the audio system.
+struct AudioSystemSession {
+    int error = 0;
+
+    AudioSystemSession();
+    ~AudioSystemSession();
+    AudioSystemSession(const AudioSystemSession &) = delete;
+    AudioSystemSession &operator=(const AudioSystemSession &) = delete;
+};
+
+// Output-capable sound devices (empty without PortAudio)
+std::vector<AudioDeviceInfo> listOutputDevices();
+
+// Returns nullptr if the backend type is not available in this build
+std::unique_ptr<OutputBackend> createOutputBackend(const OutputConfig &config, CallbackData *cb);
+
+// Parse "portaudio", "null", "wav", "flac" or "pipe"
+bool parseOutputBackendType(const std::string &text, OutputBackendType &type);
+
+// True when the config's backend writes to stdout (logs must go elsewhere)
+bool outputWritesToStdout(const OutputConfig &config);
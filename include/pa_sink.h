@@ -3,7 +3,15 @@
 #include <deque>
 #include <mutex>
 #include <atomic>
+#include <cstdint>
+#include <limits>
+#include <semaphore>
+
+#include "output_backend.h"
+#include "trace.h"
+#ifdef WALKK_HAVE_PORTAUDIO
 #include <portaudio.h>
+#endif
 
 struct Walkk; // Forward declaration
 
@@ -13,23 +21,71 @@ struct AudioSink {
 	size_t capacity;
 	std::atomic<bool> finished;
 
+	// Depth the producer fills up to (samples, <= capacity); set by the depth controller
+	std::atomic<size_t> targetDepth;
+
+	// Queue depth mirrored outside the mutex so fill levels can be read lock-free
+	std::atomic<size_t> queued{0};
+
+	// Producer wakeup: the waiting producer arms wakeThreshold with the free space it
+	// needs; the consumer posts spaceAvailable once that much is free. No locks on either side.
+	static constexpr size_t kNotWaiting = std::numeric_limits<size_t>::max();
+	std::atomic<size_t> wakeThreshold{kNotWaiting};
+	std::binary_semaphore spaceAvailable{0};
+
+	// Producer wait statistics (monotonic)
+	std::atomic<uint64_t> producerWakeups{0};
+	std::atomic<uint64_t> producerIdleNs{0};
+
 	explicit AudioSink(size_t cap)
-		: capacity(cap), finished(false) {}
+		: capacity(cap), finished(false), targetDepth(cap) {}
 
 	size_t pop(float *out, size_t maxSamples);
 	size_t push(const float *in, size_t numSamples);
 
 	// Thread-safe query of queued samples
 	size_t getQueuedSamples();
+
+	// Drop everything queued (call while no output is running)
+	void clear();
+
+	// Room left below the target depth
+	size_t freeSpace() const;
+
+	// Producer: block until `samples` fit below the target depth. Returns false if `stop` was raised.
+	bool waitForSpace(size_t samples, const std::atomic<bool> &stop);
+
+	// Release a waiting producer early (e.g. when stopping)
+	void wakeProducer();
+
+private:
+	void signalSpace();
+	bool disarmWait();
 };
 
 struct CallbackData {
 	AudioSink *sink;
 	int channels;
 	Walkk *walkk; // Added for recording functionality
+	double outputLatency = 0.0; // seconds, used when the host reports no DAC timestamps
+	TraceBuffer *traceBuffer = nullptr; // PortAudio callback's trace buffer, reserved while its stream runs
 };
 
-int openAndStartStream(PaStream **stream, CallbackData *cb, int channels, int sampleRate, unsigned long framesPerBuffer);
-void stopAndCloseStream(PaStream *stream);
+// Fill one output buffer from the sink (zero-padding any shortfall), advance the engine
+// clock, feed the recorder and update the health counters. dacDelaySeconds is how long until
+// the buffer's first frame is audible; statusFlags are AudioStatusFlag bits reported by the output.
+// Shared by every output backend. Returns false once the sink is finished and drained.
+bool renderOutputBuffer(CallbackData *cb, float *out, unsigned long frames, double dacDelaySeconds = 0.0,
+						uint32_t statusFlags = 0);
+
+#ifdef WALKK_HAVE_PORTAUDIO
+// Reference-counted Pa_Initialize/Pa_Terminate (see AudioSystemSession)
+PaError acquirePortAudio();
+void releasePortAudio();
 
+// Open the device chosen by `device` with Pa_OpenStream and start it
+int openAndStartStream(PaStream **stream, CallbackData *cb, int channels, int sampleRate,
+					unsigned long framesPerBuffer, const AudioDeviceSettings &device);
+void stopAndCloseStream(PaStream *stream, CallbackData *cb);
+#endif
 
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "capture_ring.h"
+#include "sample_convert.h"
+
+// Keeps the last few minutes of the output in memory as dithered 16-bit PCM, so a moment
+// can be saved after it has happened without recording to disk all the time. The output
+// thread converts straight into a CaptureRing, overwriting the oldest audio; save() copies the requested stretch to a WAV file
+// on a background thread while the ring keeps filling.
+struct RetroCapture {
+    RetroCapture() = default;
+    ~RetroCapture();
+    RetroCapture(const RetroCapture &) = delete;
+    RetroCapture &operator=(const RetroCapture &) = delete;
+
+    // Sizes the ring to `megabytes` (0 turns capture off and frees it). Touches the whole
+    // allocation up front so the output thread never faults on it. Fails while saving.
+    bool configure(double megabytes, int sampleRate, int channels, DitherMode dither = DitherMode::Tpdf);
+    bool isEnabled() const { return ring.isOpen(); }
+
+    // Output thread, once per buffer. Never blocks or allocates.
+    void capture(const float *samples, size_t frames);
+
+    double capacitySeconds() const; // what the budget holds
+    double bufferedSeconds() const; // what is held right now
+
+    // Writes the last `seconds` (all that is held if <= 0) to `path` on a background thread.
+    // Fails if a save is already running or nothing has been captured.
+    bool save(const std::string &path, double seconds, std::string &error);
+    bool isSaving() const { return saving.load(); }
+
+    struct SaveResult {
+        uint64_t number = 0; // counts finished saves; 0 = none yet
+        std::string path;
+        double seconds = 0.0; // audio written
+        bool ok = false;
+        std::string error;
+    };
+    SaveResult lastSave();
+
+    // <directory>/walkk_retro_<YYYYmmdd-HHMMSS>.wav
+    static std::string timestampedPath(const std::string &directory);
+
+private:
+    // One second kept between the writer and the oldest sample a save may read, so a save
+    // can start on the oldest audio without the output overwriting it mid-copy
+    size_t guardSamples = 0;
+
+    CaptureRing<int16_t> ring; // samples since configure(), multiple of channels
+    int sampleRate = 48000;
+    int channels = 2;
+    DitherState dither;        // output thread only
+
+    std::thread saver;
+    std::atomic<bool> saving{false};
+    std::mutex resultMutex;
+    SaveResult result; // guarded by resultMutex
+
+    void writeSave(std::string path, uint64_t begin, uint64_t end);
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Debug instrumentation for the real-time audio path. In a core built with WALKK_RT_CHECKS,
+// code running inside an RtScope that allocates or frees memory, locks a mutex, waits on a
+// condition/semaphore or makes a blocking I/O or sleep call is recorded as a violation,
+// together with the call stack it came from. Otherwise the macro expands to nothing and the
+// functions below report nothing.
+//
+// What is intercepted: operator new/delete everywhere; malloc/free, pthread locks and waits,
+// and blocking libc calls on glibc only.
+
+enum class RtViolationKind : uint8_t {
+    Allocation, // operator new, malloc, calloc, realloc
+    Free,       // operator delete, free
+    Lock,       // mutex and rwlock acquisition
+    Wait,       // condition variables, semaphores
+    Blocking,   // file and pipe I/O, sleeps, poll/select
+    kCount
+};
+
+const char *rtViolationKindName(RtViolationKind kind);
+
+// One distinct (call, stack) seen on a real-time thread
+struct RtViolation {
+    RtViolationKind kind = RtViolationKind::Allocation;
+    std::string call;                // intercepted function, e.g. "pthread_mutex_lock"
+    std::string scope;               // innermost RtScope label
+    uint64_t count = 0;              // times this exact stack was hit
+    std::vector<std::string> stack;  // innermost frame first, symbolized where possible
+};
+
+struct RtCheckStats {
+    uint64_t total[(int)RtViolationKind::kCount] = {};
+    uint64_t distinct = 0; // unique stacks recorded
+    uint64_t dropped = 0;  // unique stacks that did not fit the table
+
+    uint64_t all() const {
+        uint64_t sum = 0;
+        for (uint64_t n : total) sum += n;
+        return sum;
+    }
+};
+
+// True when the core was built with WALKK_RT_CHECKS
+bool rtChecksCompiledIn();
+
+// Whether the calling thread is currently inside an RtScope
+bool rtIsRealtimeThread();
+
+RtCheckStats rtCheckStats();
+
+// Distinct violations recorded so far. Symbolizes stacks, so call from a normal thread.
+std::vector<RtViolation> rtCheckViolations();
+
+// Readable report of every violation with its stack; empty if there were none
+std::string rtCheckReport();
+
+void rtCheckReset();
+
+#ifdef WALKK_RT_CHECKS
+// Marks the calling thread real-time until destroyed; scopes nest
+struct RtScope {
+    explicit RtScope(const char *label); // must be a string literal (stored by pointer)
+    ~RtScope();
+    RtScope(const RtScope &) = delete;
+    RtScope &operator=(const RtScope &) = delete;
+
+private:
+    const char *previous;
+};
+
+// Lifts the checks for a known, deliberate call inside an RtScope (e.g. a one-time lazy init)
+struct RtAllowScope {
+    RtAllowScope();
+    ~RtAllowScope();
+    RtAllowScope(const RtAllowScope &) = delete;
+    RtAllowScope &operator=(const RtAllowScope &) = delete;
+};
+
+#define WALKK_RT_CONCAT_(a, b) a##b
+#define WALKK_RT_CONCAT(a, b) WALKK_RT_CONCAT_(a, b)
+#define WALKK_RT_SCOPE(label) RtScope WALKK_RT_CONCAT(walkkRtScope, __LINE__)(label)
+#define WALKK_RT_ALLOW() RtAllowScope WALKK_RT_CONCAT(walkkRtAllow, __LINE__)
+#else
+#define WALKK_RT_SCOPE(label) do {} while (0)
+#define WALKK_RT_ALLOW() do {} while (0)
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+enum class RtPolicy {
+    Normal,     // leave the OS default scheduling
+    Fifo,       // SCHED_FIFO (Windows: time-critical priority)
+    RoundRobin, // SCHED_RR   (Windows: time-critical priority)
+};
+
+// Opt-in scheduling for one of our audio threads. Everything defaults to "leave alone".
+struct ThreadTuning {
+    RtPolicy policy = RtPolicy::Normal;
+    int priority = 0;           // 1..99 for Fifo/RoundRobin, 0 picks kDefaultRtPriority
+    int cpu = -1;               // pin to this CPU, -1 keeps the inherited affinity
+    bool prefaultStack = false; // touch the stack up front so the first deep call does not page-fault
+
+    static constexpr int kDefaultRtPriority = 70;
+
+    bool isDefault() const { return policy == RtPolicy::Normal && cpu < 0 && !prefaultStack; }
+};
+
+// Apply `tuning` to the calling thread. Every step is attempted; returns false if any
+// failed, with a readable reason (e.g. missing privileges) in `error`.
+bool applyThreadTuning(const ThreadTuning &tuning, std::string &error);
+
+// Lock current and future pages in RAM (mlockall). Returns false with a reason on failure.
+bool lockProcessMemory(std::string &error);
+
+// Human-readable summary, e.g. "SCHED_FIFO 70, cpu 2"
+std::string describeThreadTuning(const ThreadTuning &tuning);
+
+// Parse "normal", "fifo" or "rr"
+bool parseRtPolicy(const std::string &text, RtPolicy &policy);
+const char *rtPolicyName(RtPolicy policy);
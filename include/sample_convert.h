@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+
+// Float -> integer PCM. Samples are scaled by 2^(bits-1), rounded to nearest and saturated;
+// the kernels run 4 samples at a time on SSE2 / NEON and fall back to scalar code elsewhere.
+enum class DitherMode {
+    None,   // round only
+    Tpdf,   // +-1 LSB triangular dither: the error no longer follows the signal
+    Shaped, // TPDF plus first-order error feedback, pushing the noise floor up in frequency
+};
+
+bool parseDitherMode(const std::string &text, DitherMode &mode);
+const char *ditherModeName(DitherMode mode);
+
+// Per-stream dither state. The generator is one xorshift32 per lane of two vectors, so a
+// fixed seed gives the same output on every run.
+struct DitherState {
+    static constexpr int kMaxShapedChannels = 8; // wider streams get plain TPDF
+
+    DitherMode mode = DitherMode::None;
+    int channels = 2;
+    uint32_t rng[8];
+    float error[kMaxShapedChannels] = {}; // Shaped: last quantization error per channel, in LSBs
+
+    explicit DitherState(DitherMode mode = DitherMode::None, int channels = 2, uint32_t seed = 0x2545F491u);
+};
+
+// Interleaved whole frames; `dither` carries over between calls, so a stream can be converted in
+// pieces
+void convertFloatToInt16(const float *input, int16_t *output, size_t sampleCount);
+void convertFloatToInt16(const float *input, int16_t *output, size_t sampleCount, DitherState &dither);
+// 24-bit little-endian packed, 3 bytes per sample (WAV layout)
+void convertFloatToInt24(const float *input, uint8_t *output, size_t sampleCount, DitherState &dither);
+
+// Grow-only scratch buffer, aligned for the vector kernels; reused across callbacks
+template <typename T>
+struct AlignedBuffer {
+    static constexpr std::align_val_t kAlignment{64};
+
+    T *data() { return buffer.get(); }
+    size_t capacity() const { return count; }
+
+    // Only allocates when `n` is more than it has ever held
+    void reserve(size_t n) {
+        if (n <= count) return;
+        buffer.reset(static_cast<T *>(::operator new(n * sizeof(T), kAlignment)));
+        count = n;
+    }
+
+private:
+    struct Free {
+        void operator()(T *p) const { ::operator delete(p, kAlignment); }
+    };
+    std::unique_ptr<T, Free> buffer;
+    size_t count = 0;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_ring.h"
+#include "wav_writer.h"
+
+struct SegmentRecorderConfig {
+    std::string directory = ".";
+    std::string prefix = "walkk";
+    double segmentSeconds = 3600.0; // roll to the next file after this much audio (0 = no limit)
+    double segmentMegabytes = 0.0;  // ... or once a file's audio reaches this size (0 = no limit)
+    WavSampleFormat format = WavSampleFormat::Int16;
+    DitherMode dither = DitherMode::Tpdf;
+    bool preallocate = true;        // reserve each segment's disk space when it is opened
+    bool index = true;              // CSV of the grains that start in each segment
+    double bufferSeconds = 10.0;    // how far the writer thread may fall behind the output
+};
+
+// Archives the output into a numbered series of WAV files (RF64 when a segment passes 4 GB).
+// The output thread only copies into a CaptureRing; a writer thread converts the audio,
+// splits it at exact frame boundaries (no gap or overlap between segments) and writes it in
+// large block-aligned chunks. Frames dropped because the writer fell behind are written as
+// silence, so file time always matches engine time.
+//
+// Files: <directory>/<prefix>_<YYYYmmdd-HHMMSS>_<NNNN>.wav and, with `index`,
+// <prefix>_<YYYYmmdd-HHMMSS>_index.csv.
+struct SegmentRecorder {
+    SegmentRecorder() = default;
+    ~SegmentRecorder();
+    SegmentRecorder(const SegmentRecorder &) = delete;
+    SegmentRecorder &operator=(const SegmentRecorder &) = delete;
+
+    // Opens the first segment and starts the writer thread
+    bool start(const SegmentRecorderConfig &config, int sampleRate, int channels, std::string &error);
+    // Writes out what is buffered, finishes the open segment and joins the writer
+    void stop();
+    bool isActive() const { return ring.isOpen(); }
+
+    // Output thread, once per buffer: `frames` of engine audio starting at engine frame
+    // `engineFrame`. Never blocks or allocates.
+    void capture(const float *samples, size_t frames, uint64_t engineFrame);
+
+    // Any other thread (Walkk::pumpEvents does this): a grain starting at `engineFrame`
+    void noteGrain(uint64_t engineFrame, const std::string &source, uint64_t sourceFrame, uint32_t durationFrames,
+                   float amplitude);
+
+    std::string currentSegmentPath();
+
+    // Readable from any thread
+    std::atomic<uint64_t> framesWritten{0};
+    std::atomic<uint64_t> framesDropped{0};  // written as silence instead
+    std::atomic<uint64_t> segmentsWritten{0};
+    std::atomic<uint64_t> writeErrors{0};
+
+private:
+    // Where the engine timeline jumps relative to the captured stream (dropped frames, a
+    // restarted output). Applies before ring sample `position`.
+    struct Marker {
+        uint64_t position = 0;
+        uint64_t engineFrame = 0;
+        uint64_t silentFrames = 0;
+    };
+
+    struct Run {
+        uint64_t fileFrame;   // frames into the whole recording
+        uint64_t engineFrame; // engine frame at fileFrame
+    };
+
+    struct GrainNote {
+        uint64_t engineFrame;
+        std::string source;
+        uint64_t sourceFrame;
+        uint32_t durationFrames;
+        float amplitude;
+    };
+
+    static constexpr size_t kMarkers = 256;
+    static constexpr size_t kBlockBytes = 1 << 20;
+
+    SegmentRecorderConfig config;
+    int sampleRate = 48000;
+    int channels = 2;
+    uint64_t segmentFrames = 0; // 0 = unlimited
+    std::string stamp;
+
+    std::atomic<bool> stopRequested{false};
+    std::thread writer;
+
+    // Output -> writer: samples, and the markers placed between them (single producer,
+    // single consumer; marker positions are ring positions)
+    CaptureRing<float> ring;
+    Marker markers[kMarkers];
+    std::atomic<uint64_t> markerHead{0};
+    std::atomic<uint64_t> markerTail{0};
+    uint64_t expectedEngineFrame = 0; // output thread only
+    uint64_t pendingSilence = 0;      // output thread only: dropped frames not yet in a marker
+    bool markerNeeded = true;         // output thread only: the next samples start a new run
+
+    // Writer thread only
+    WavFileWriter segment;
+    uint64_t segmentNumber = 0;
+    uint64_t fileFrames = 0;   // frames written across all segments
+    std::vector<Run> runs;
+    std::vector<float> chunk;
+    FILE *indexFile = nullptr;
+
+    std::mutex notesMutex;
+    std::deque<GrainNote> notes;
+    std::string currentPath; // guarded by notesMutex
+
+    void run();
+    bool openSegment();
+    void writeFrames(const float *samples, size_t frames);
+    void writeIndex(bool flushAll);
+    std::string segmentPath(uint64_t number) const;
+};
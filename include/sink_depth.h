@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Log-spaced histogram of durations: 8 bins per octave (~9% resolution) from 1 us to ~16 s
+struct LatencyHistogram {
+    static constexpr int kBinsPerOctave = 8;
+    static constexpr int kBins = 24 * kBinsPerOctave;
+
+    uint32_t counts[kBins] = {};
+    uint64_t total = 0;
+
+    void add(double seconds);
+    void clear();
+    void merge(const LatencyHistogram &other);
+
+    // Upper edge (seconds) of the bin holding the p-th fraction of samples, 0 when empty
+    double percentile(double p) const;
+
+    static int binFor(double seconds);
+    static double binUpperEdge(int bin);
+};
+
+// Picks how deep the sink should run. The producer reports how long each block took
+// from "the sink has room" to "the block is pushed" (its lateness) and how long each
+// grain decode took; the target depth covers the recent p99 of both with some margin,
+// bounded by minLatency/maxLatency. Grows at once, shrinks gradually.
+struct SinkDepthController {
+    using Clock = std::chrono::steady_clock;
+
+    // Limits in seconds; may be changed while running
+    std::atomic<double> minLatency{0.02};
+    std::atomic<double> maxLatency{2.0};
+
+    double safetyFactor = 2.0;   // headroom over the measured p99
+    double windowSeconds = 1.0;  // histograms roll over two windows
+    double shrinkRate = 0.25;    // fraction of the gap closed per window when shrinking
+
+    // Telemetry, readable from any thread
+    std::atomic<size_t>   targetFrames{0};
+    std::atomic<uint64_t> adjustments{0};
+    std::atomic<double>   latenessP99{0.0};  // seconds
+    std::atomic<double>   decodeP99{0.0};    // seconds
+    std::atomic<double>   lastAdjustFrom{0.0}; // seconds, most recent adjustment
+    std::atomic<double>   lastAdjustTo{0.0};
+
+    explicit SinkDepthController(int rate) : sampleRate(rate) {}
+
+    // Producer thread only below this line
+    void reset(size_t capacityFrames);
+    void addDecode(double seconds);
+
+    // Returns true when targetFrames changed
+    bool addBlock(double latenessSeconds, size_t blockFrames);
+
+private:
+    int sampleRate;
+    size_t capacityFrames = 0;
+    LatencyHistogram lateness, latenessPrev;
+    LatencyHistogram decode, decodePrev;
+    Clock::time_point windowStart;
+
+    size_t clampFrames(double seconds, size_t blockFrames) const;
+    bool setTarget(size_t frames);
+};
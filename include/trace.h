@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Scoped trace zones recorded into per-thread ring buffers and exported as Chrome
+// trace-event JSON (chrome://tracing or ui.perfetto.dev). Zones only exist when the
+// core is built with WALKK_TRACING; otherwise the macro expands to nothing and the
+// functions below are no-ops.
+
+// Runtime switch; zones cost two clock reads and a few stores while enabled
+void traceSetEnabled(bool enabled);
+bool traceIsEnabled();
+
+// Claims a trace buffer for the calling thread, labelled `name` in exported traces. Call at
+// thread start, off any real-time path: it may lock and allocate. Zones on a thread that has
+// no buffer are skipped, never recorded by allocating one.
+void traceRegisterThread(const char *name);
+
+// Threads the app does not start, like the PortAudio callback's, would have to claim a buffer
+// on the audio path. Instead a control thread reserves one at stream start, the callback
+// attaches it on every call (one thread-local store), and it is released after the stream stops.
+struct TraceBuffer;
+TraceBuffer *traceReserveThread(const char *name);
+void traceAttachThread(TraceBuffer *buffer);
+void traceReleaseThread(TraceBuffer *buffer);
+
+// Write zones that ended within the last `lastSeconds` (0 = everything still buffered).
+// Returns false if the file could not be written or tracing is compiled out.
+bool traceWriteChromeJson(const std::string &path, double lastSeconds);
+
+#ifdef WALKK_TRACING
+struct TraceZone {
+    const char *name;   // must be a string literal (stored by pointer)
+    uint64_t beginNs;   // 0 while tracing is off
+
+    explicit TraceZone(const char *zoneName);
+    ~TraceZone();
+    TraceZone(const TraceZone &) = delete;
+    TraceZone &operator=(const TraceZone &) = delete;
+};
+
+#define WALKK_TRACE_CONCAT_(a, b) a##b
+#define WALKK_TRACE_CONCAT(a, b) WALKK_TRACE_CONCAT_(a, b)
+#define WALKK_TRACE_ZONE(name) TraceZone WALKK_TRACE_CONCAT(walkkTraceZone, __LINE__)(name)
+#else
+#define WALKK_TRACE_ZONE(name) do {} while (0)
+#endif
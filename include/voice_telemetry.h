@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// What the UI needs to know about one scheduled voice: indices and numbers only,
+// names are resolved by the reader (files[fileIndex]).
+struct VoiceInfo {
+    uint64_t serial = 0;            // 1, 2, 3... in scheduling order; 0 marks an empty slot
+    uint64_t engineStartFrame = 0;  // compare with EngineClock::playbackFrame()
+    uint64_t engineEndFrame = 0;
+    uint64_t fileStartFrame = 0;    // grain: position in the source file
+    uint32_t fileIndex = 0;
+    uint32_t durationFrames = 0;
+    uint32_t loopWindowFrames = 0;
+    int32_t  loopDragFrames = 0;
+    float    amplitude = 0.0f;
+    uint8_t  type = 0;              // MixerVoice::Type
+    uint8_t  noiseColor = 0;        // NoiseColor, noise voices only
+    bool     loopEnabled = false;
+    bool     reversePlayback = false;
+};
+
+// Recently scheduled voices, written by the producer and read lock-free by anyone.
+// Each slot is a seqlock: the writer never waits, readers retry a torn read.
+// Slots are handed out round-robin, so a voice stays visible for the next kSlots-1
+// schedules, which covers everything still queued in the sink.
+struct VoiceTelemetry {
+    static constexpr size_t kSlots = 128;
+
+    // Producer thread only
+    void publish(VoiceInfo info);
+
+    // Call while the producer is stopped
+    void reset();
+
+    // Copy every filled slot into `out` (up to `maxCount`), returns how many
+    size_t snapshot(VoiceInfo *out, size_t maxCount) const;
+
+    // Serial of the latest published voice
+    uint64_t latestSerial() const { return nextSerial.load(std::memory_order_acquire) - 1; }
+
+private:
+    static constexpr size_t kWords = (sizeof(VoiceInfo) + 7) / 8;
+
+    struct Slot {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<uint64_t> words[kWords] = {};
+    };
+
+    Slot slots[kSlots];
+    std::atomic<uint64_t> nextSerial{1};
+};
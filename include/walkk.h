@@ -9,6 +9,21 @@
 
 #include "minimp3_ex.h"
 #include "pa_sink.h"
+#include "audio_health.h"
+#include "background_recorder.h"
+#include "engine_clock.h"
+#include "event_log.h"
+#include "grain_envelope.h"
+#include "grain_score.h"
+#include "io_faults.h"
+#include "mixer.h"
+#include "noise_gen.h"
+#include "sink_depth.h"
+#include "voice_telemetry.h"
+#include "rt_thread.h"
+#include "retro_capture.h"
+#include "segment_recorder.h"
+#include "wav_writer.h"
 
 // Stream-based file info (no full buffer loaded)
 struct StreamedFile {
@@ -19,6 +34,7 @@ struct StreamedFile {
 	int sampleRate;
 	int channels;
 	bool isOpen;
+	std::unique_ptr<FaultyFile> faultyIo; // set while the decoder reads through an IoFaultInjector
 	
 	StreamedFile() : totalFrames(0), sampleRate(0), channels(0), isOpen(false) {}
 	
@@ -40,7 +56,8 @@ struct StreamedFile {
 		, totalFrames(other.totalFrames)
 		, sampleRate(other.sampleRate)
 		, channels(other.channels)
-		, isOpen(other.isOpen) {
+		, isOpen(other.isOpen)
+		, faultyIo(std::move(other.faultyIo)) {
 		other.isOpen = false;
 	}
 	
@@ -56,6 +73,7 @@ struct StreamedFile {
 			sampleRate = other.sampleRate;
 			channels = other.channels;
 			isOpen = other.isOpen;
+			faultyIo = std::move(other.faultyIo);
 			other.isOpen = false;
 		}
 		return *this;
@@ -75,6 +93,28 @@ struct GrainParams {
 
     // New: bounceback/reverse playback
     bool   reversePlayback = false; // if true, play this grain in reverse
+
+    // Attack/release window (in output frames)
+    EnvelopeShape envelopeShape = EnvelopeShape::Tukey;
+    size_t attackFrames  = 0;
+    size_t releaseFrames = 0;
+};
+
+// How readGrain resamples and envelopes
+enum class GrainQuality {
+    Live, // what playback uses: nearest source frame, table envelopes
+    High, // windowed-sinc resampling at the fractional position, exact envelopes (offline renders)
+};
+
+bool parseGrainQuality(const std::string &text, GrainQuality &quality);
+
+// Producer-side counters, bumped with relaxed atomics and read by the metrics exporter
+struct ProducerStats {
+    std::atomic<uint64_t> grains{0};         // grains decoded and scheduled
+    std::atomic<uint64_t> grainFailures{0};  // grains whose decode failed
+    std::atomic<uint64_t> decoderOpens{0};   // grain reads that had to open the file
+    std::atomic<int64_t>  openDecoders{0};   // mp3 decoder handles currently open
+    AtomicLatencyHistogram decodeTime;       // open + seek + decode + resample per grain
 };
 
 struct Walkk {
@@ -92,6 +132,10 @@ struct Walkk {
     size_t filesLoadedLast = 0;        // how many successfully opened
     std::mutex loadStatsMutex;         // guard the counters during background loading
 
+    // Library size, kept atomically so it can be read while a load is still adding files
+    std::atomic<size_t>   libraryFiles{0};
+    std::atomic<double>   librarySeconds{0.0};
+
     struct GranularSettings {
         size_t minGrainMs = 50;
         size_t maxGrainMs = 1200;
@@ -102,43 +146,44 @@ struct Walkk {
         size_t maxLoopWindowMs = 620;
         int    maxLoopDragMs   = 25;   // ± ms
         float  bouncebackProbability = 0.0f; // 0..1, probability to play grain backwards after forwards
-        size_t whiteNoiseMs    = 0;    // silence replaced by white noise between grains
+        size_t whiteNoiseMs    = 0;    // silence replaced by noise between grains
         float  whiteNoiseAmplitude = 0.25f; // 0..1 amplitude for noise
+        NoiseColor noiseColor = NoiseColor::White;
+        EnvelopeShape envelopeShape = EnvelopeShape::Tukey;
+        size_t envelopeAttackMs  = 10;  // ignored by Hann (spans the whole grain)
+        size_t envelopeReleaseMs = 10;
+
+        bool operator==(const GranularSettings &) const = default;
     } settings;
 
     std::mutex settingsMutex;
 
-    // Debug/status of the most recently generated grain (for GUI display)
-    struct GrainDebugInfo {
-        size_t fileIndex = 0;
-        std::string relPath;
-        size_t startFrame = 0;
-        size_t durationFrames = 0;
-        float amplitude = 0.0f;
-        bool loopEnabled = false;
-        size_t loopWindowFrames = 0;
-        int loopDragFrames = 0;
-        bool reversePlayback = false; // if true, this grain plays in reverse
-        // Estimated audio-out start time for this grain (steady_clock)
-        std::chrono::steady_clock::time_point expectedStartTime;
-        bool hasExpectedStart = false;
-        bool hasStarted = false;
-        std::chrono::steady_clock::time_point expectedEndTime;
-    } lastGrain;
-    std::mutex lastGrainMutex;
-
-    // Explicit current-playing grain snapshot (promoted when ETA is reached)
-    GrainDebugInfo currentGrain;
+    // Every scheduled voice (grains and noise gaps) for display, lock-free for readers
+    VoiceTelemetry voiceTelemetry;
 
     // Console-like log buffer for GUI history
     std::deque<std::string> logLines;
     std::mutex logMutex;
     size_t logMaxLines = 2000;
 
+    // Cold-path messages (already formatted). Hot paths push binary records into `events`.
     void addLog(const std::string &line);
 
+    // Grain/load/error/underrun records, formatted only when pumped
+    EventLog events;
+
+    // Echo pumped events to stdout/stderr, at most this many lines per second
+    bool consoleLog = true;
+    size_t consoleLinesPerSecond = 50;
+
+    // Drain `events` into logLines (and the console). Call from one UI/main thread;
+    // returns the number of events drained.
+    size_t pumpEvents();
+    std::string formatEvent(const EventRecord &event) const;
+
     // Recording functionality
-    bool startRecording(const std::string& outputPath);
+    bool startRecording(const std::string& outputPath, WavSampleFormat format = WavSampleFormat::Int16,
+                        RecordingCodec codec = RecordingCodec::Wav);
     void stopRecording();
     void writeRecordingData(const float* data, size_t frames);
     double getRecordingDurationSeconds(); // Get current recording duration in seconds
@@ -146,16 +191,68 @@ struct Walkk {
     // Random number generator
     std::mt19937 rng;
 
+    // Voices rendered by the producer thread
+    Mixer mixer;
+
+    // Frames rendered per mixer block; follows the output's negotiated buffer size
+    std::atomic<size_t> engineBlockFrames{512};
+
+    // Playback position of the engine timeline, advanced by the output
+    EngineClock clock;
+
+    // Scheduling applied by granulizerLoop to its own (render + grain decode) thread
+    ThreadTuning producerTuning;
+
+    // Xruns, shortfalls and callback timing recorded by the output
+    AudioHealth health;
+
+    // Grain decode counters and timings recorded by the producer
+    ProducerStats producerStats;
+
+    // Resilience testing: when set, grain decoders read their files through this injector
+    IoFaultInjector *ioFaults = nullptr;
+
+    // Resampling/envelope quality of the grains granulizerLoop decodes
+    GrainQuality grainQuality = GrainQuality::Live;
+
+    // Adapts sink.targetDepth to measured producer lateness and decode times
+    SinkDepthController sinkDepth;
+
+    // Empty the sink, rewind the clock, forget scheduled voices and zero the health counters;
+    // call before (re)starting an output
+    void resetPlayback();
+
+    // Base for per-voice noise seeds (kept apart from rng so noise never shifts grain choices)
+    uint64_t noiseSeed;
+
+    // Derive rng and noiseSeed from one value, making the grain sequence repeatable
+    void seed(uint64_t value);
+
     // Recording state
     std::atomic<bool> isRecording;
     std::string recordingOutputPath;
-    FILE* recordingFile;
-    std::mutex recordingMutex;
-    size_t recordingDataSize; // Track bytes written for WAV header fixup
+    BackgroundRecorder recorder; // fed by the output, encoded and written on its own thread
+    std::mutex recordingMutex;   // start/stop
     std::chrono::steady_clock::time_point recordingStartTime; // Track when recording started
 
+    // 24/7 archive: rotating segments fed by the output, written on their own thread
+    SegmentRecorder archive;
+
+    // The last few minutes of output in memory, saved on request ("save the last N minutes")
+    RetroCapture retro;
+
+    // When open, granulizerLoop logs every voice it schedules (and settings changes) for re-rendering
+    ScoreWriter score;
+
+    // Console rate limiting state for pumpEvents()
+    std::chrono::steady_clock::time_point consoleWindowStart;
+    size_t consoleWindowLines = 0;
+    uint64_t consoleSuppressed = 0;
+    uint64_t droppedReported = 0;
+
     explicit Walkk(size_t sinkCapacity)
-        : sink(sinkCapacity), allFinished(false), rng(std::random_device{}()), isRecording(false), recordingFile(nullptr), recordingDataSize(0) {}
+        : sink(sinkCapacity), allFinished(false), rng(std::random_device{}()), mixer(kChannels), clock(kSampleRate), sinkDepth(kSampleRate),
+          noiseSeed(((uint64_t)std::random_device{}() << 32) | std::random_device{}()), isRecording(false) {}
 };
 
 
@@ -164,4 +261,51 @@ struct Walkk {
 int loadDirectoryMp3s(const char *directoryPath, Walkk &walkk, bool recursive = false);
 
 // Producer loop: granulizer that plays random segments from random files
-void granulizerLoop(Walkk *walkk);
\ No newline at end of file
+void granulizerLoop(Walkk *walkk);
+
+// Scheduling state granulizerLoop carries from one block to the next
+struct GranulizerState {
+    uint64_t nextStartFrame = 0;             // engine frame at which the next grain may start
+    Walkk::GranularSettings scoredSettings;  // last settings written to the score
+    bool settingsScored = false;
+    bool planOnly = false; // choose and time the voices without decoding or mixing them (offline render)
+};
+
+// One block of granulizerLoop: schedule the grains (and noise gaps) starting within the next
+// `frames` frames, unless `schedule` is false (voices already playing ring out), then mix into `out`
+// (left untouched when state.planOnly)
+void renderGranulizerBlock(Walkk *walkk, GranulizerState &state, float *out, size_t frames, bool schedule = true);
+
+// Block until all samples are in the sink or playback is stopped.
+// Sleeps until the output has drained room for the whole block, then pushes it in one go.
+void pushToSink(Walkk *walkk, const float *data, size_t samples);
+
+// Pick a random grain (file, position, length, loop/reverse, envelope) from walkk.settings
+GrainParams generateRandomGrain(Walkk &walkk);
+
+// Decode, resample to targetRate and envelope one grain into interleaved stereo `output`.
+// Opens the file's decoder if it is closed (through `faults` when given) and closes it again afterwards.
+bool readGrain(StreamedFile &file, GrainParams &params, std::vector<float> &output, int targetRate,
+               ProducerStats &stats, IoFaultInjector *faults = nullptr, GrainQuality quality = GrainQuality::Live);
+
+// Producer loop for a recorded score: replays its voices (files matched by relative path) into
+// the sink instead of choosing new ones, then marks the sink finished. With GrainQuality::Live
+// the result matches the original session sample for sample.
+void scorePlaybackLoop(Walkk *walkk, const Score *score, GrainQuality quality);
+
+// Open walkk.score on walkk.files (call after loading, before granulizerLoop starts)
+bool startScore(Walkk &walkk, const std::string &path, std::string &error);
+
+// readGrain's inner loop: map each output frame of the grain (linear, looping or reversed) onto
+// the decoded slice `src` (framesRead frames starting at file frame readStart) and interpolate it
+// into interleaved stereo `out` (params.durationFrames frames). windowLen is the loop window in
+// source frames, or the whole span when not looping.
+void interpolateGrain(const mp3d_sample_t *src, size_t framesRead, int channels, int64_t readStart, size_t fileFrames,
+                      double rateRatio, size_t windowLen, const GrainParams &params, float *out);
+
+// GrainQuality::High counterpart: the same mapping, but keeps the fractional source position and
+// interpolates it with a Kaiser-windowed sinc (kSincTaps taps, low-passed when downsampling).
+// `src` must cover kSincTaps / 2 frames beyond the mapped span on both sides where the file has them.
+constexpr int kSincTaps = 32;
+void interpolateGrainSinc(const mp3d_sample_t *src, size_t framesRead, int channels, int64_t readStart,
+                          size_t fileFrames, double rateRatio, size_t windowLen, const GrainParams &params, float *out);
\ No newline at end of file
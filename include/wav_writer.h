@@ -2,37 +2,102 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
-// WAV file header structure
+#include "sample_convert.h"
+
+enum class WavSampleFormat {
+    Int16,   // 16-bit PCM, rounded and saturated (dithered unless the writer says otherwise)
+    Int24,   // 24-bit packed PCM, same treatment
+    Float32, // IEEE float, the mix exactly as rendered
+};
+
+// WAV file header structure. A 28-byte JUNK chunk is reserved up front so the file can be
+// turned into RF64 (EBU Tech 3306) in place once it outgrows the 32-bit RIFF sizes.
 #pragma pack(push, 1)
 struct WavHeader {
-    char riff[4];           // "RIFF"
-    uint32_t fileSize;      // File size - 8
+    char riff[4];           // "RIFF", "RF64" past 4 GB
+    uint32_t fileSize;      // File size - 8 (0xFFFFFFFF in RF64)
     char wave[4];           // "WAVE"
+    char ds64[4];           // "JUNK" placeholder, "ds64" in RF64
+    uint32_t ds64Size;      // 28
+    uint64_t riffSize64;    // RF64 only: file size - 8
+    uint64_t dataSize64;    // RF64 only: size of data section
+    uint64_t sampleCount64; // RF64 only: frames
+    uint32_t tableLength;   // no extra chunk sizes
     char fmt[4];            // "fmt "
-    uint32_t chunkSize;     // 16 for PCM
-    uint16_t audioFormat;   // 1 for PCM
+    uint32_t chunkSize;     // 16
+    uint16_t audioFormat;   // 1 for PCM, 3 for IEEE float
     uint16_t numChannels;   // 1 for mono, 2 for stereo
     uint32_t sampleRate;    // Sample rate
     uint32_t byteRate;      // SampleRate * NumChannels * BitsPerSample/8
     uint16_t blockAlign;    // NumChannels * BitsPerSample/8
-    uint16_t bitsPerSample; // 16 or 32
+    uint16_t bitsPerSample; // 16, 24 or 32
     char data[4];           // "data"
-    uint32_t dataSize;      // Size of data section
+    uint32_t dataSize;      // Size of data section (0xFFFFFFFF in RF64)
 };
 #pragma pack(pop)
 
-// Initialize WAV header for 16-bit stereo audio at 48kHz
-void initWavHeader(WavHeader* header, uint32_t sampleRate = 48000, uint16_t channels = 2, uint16_t bitsPerSample = 16);
+// Initialize a WAV header with zero sizes
+void initWavHeader(WavHeader* header, uint32_t sampleRate = 48000, uint16_t channels = 2,
+                   WavSampleFormat format = WavSampleFormat::Int16);
+
+// Fill in the sizes for `dataBytes` of audio, switching to RF64 if they no longer fit 32 bits.
+// The RIFF size includes the pad byte that follows an odd-length data chunk.
+void setWavDataSize(WavHeader* header, uint64_t dataBytes, uint32_t dataOffset = sizeof(WavHeader));
+
+// Write WAV header to file at the current position. A larger `dataOffset` pads it with a
+// JUNK chunk so the audio starts there (e.g. 4096 for block-aligned writes).
+bool writeWavHeader(FILE* file, const WavHeader* header, uint32_t dataOffset = sizeof(WavHeader));
 
-// Write WAV header to file (with placeholder sizes)
-bool writeWavHeader(FILE* file, const WavHeader* header);
+uint16_t wavBytesPerSample(WavSampleFormat format);
+bool parseWavSampleFormat(const std::string& text, WavSampleFormat& format);
+const char* wavSampleFormatName(WavSampleFormat format);
 
-// Update WAV header with actual file sizes (for when recording is complete)
-bool updateWavHeader(FILE* file, uint32_t dataSize);
+// Streams audio into a WAV file. The header is rewritten every `checkpointSeconds` of audio,
+// so a crash leaves a playable file missing at most that much from the end.
+struct WavFileWriter {
+    FILE* file = nullptr;
+    WavHeader header{};
+    WavSampleFormat format = WavSampleFormat::Int16;
+    uint16_t channels = 2;
+    uint64_t dataBytes = 0;
+    uint32_t dataOffset = sizeof(WavHeader);
+    double checkpointSeconds = 2.0; // 0 = only on close
+    uint64_t checkpointBytes = 0;   // dataBytes at the last header rewrite
+    DitherMode dither = DitherMode::Tpdf; // integer formats; set before open()
 
-// Write 16-bit PCM audio data to WAV file
-bool writeWavAudioData(FILE* file, const float* audioData, size_t frameCount, uint16_t channels = 2);
+    // Set before open(). blockBytes > 0 (a multiple of 4096): audio starts at 4096 and goes to
+    // disk unbuffered, in whole blocks at block-aligned offsets. preallocateBytes reserves disk
+    // space up front (Linux fallocate, keeping the file size).
+    size_t blockBytes = 0;
+    uint64_t preallocateBytes = 0;
 
-// Convert float audio data to 16-bit integers for WAV writing
-void convertFloatToInt16(const float* input, int16_t* output, size_t sampleCount);
+    WavFileWriter() = default;
+    ~WavFileWriter() { close(); }
+    WavFileWriter(const WavFileWriter&) = delete;
+    WavFileWriter& operator=(const WavFileWriter&) = delete;
+
+    bool open(const std::string& path, uint32_t sampleRate, uint16_t numChannels, WavSampleFormat sampleFormat);
+    bool write(const float* audioData, size_t frameCount);
+    // Audio already in the file's sample format (int16_t for Int16, and so on)
+    bool writeEncoded(const void* samples, size_t frameCount);
+    // Rewrite the header for everything written so far and flush it to the OS
+    bool checkpoint();
+    // Final header, then close. Returns false if anything failed to reach the file.
+    bool close();
+
+    bool isOpen() const { return file != nullptr; }
+    bool isRf64() const { return dataBytes + (dataBytes & 1) + dataOffset - 8 > 0xFFFFFFFFull; }
+
+private:
+    AlignedBuffer<uint8_t> converted; // integer samples, reused across writes
+    DitherState ditherState;
+    std::vector<uint8_t> staged;    // blockBytes mode: audio not yet written as a whole block
+    uint64_t blocksWritten = 0;     // bytes of audio on disk in whole blocks
+    bool failed = false;
+
+    bool append(const void* bytes, size_t count);
+    bool writeStaged(size_t count);
+};
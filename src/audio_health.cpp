@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "audio_health.h"
+
+void AtomicLatencyHistogram::record(uint64_t ns) {
+    counts[LatencyHistogram::binFor((double)ns * 1e-9)].fetch_add(1, std::memory_order_relaxed);
+    sumNs.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t prev = maxNs.load(std::memory_order_relaxed);
+    while (ns > prev && !maxNs.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void AtomicLatencyHistogram::snapshot(LatencyHistogram &out) const {
+    out.clear();
+    for (int i = 0; i < LatencyHistogram::kBins; i++) {
+        uint64_t n = counts[i].load(std::memory_order_relaxed);
+        out.counts[i] = (uint32_t)std::min<uint64_t>(n, UINT32_MAX);
+        out.total += out.counts[i];
+    }
+}
+
+void AtomicLatencyHistogram::reset() {
+    for (auto &c : counts) c.store(0, std::memory_order_relaxed);
+    maxNs.store(0, std::memory_order_relaxed);
+    sumNs.store(0, std::memory_order_relaxed);
+}
+
+void AudioHealth::recordBuffer(uint64_t startNs, uint64_t endNs, double bufferSeconds, uint32_t statusFlags,
+                               size_t framesCopied, size_t framesWanted, bool started) {
+    callbacks.fetch_add(1, std::memory_order_relaxed);
+    if (statusFlags & kStatusOutputUnderflow) underflows.fetch_add(1, std::memory_order_relaxed);
+    if (statusFlags & kStatusOutputOverflow) overflows.fetch_add(1, std::memory_order_relaxed);
+    if (statusFlags & kStatusPrimingOutput) primingBuffers.fetch_add(1, std::memory_order_relaxed);
+
+    if (started && framesCopied < framesWanted) {
+        (framesCopied == 0 ? emptyBuffers : partialBuffers).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const uint64_t elapsed = endNs - startNs;
+    callbackTime.record(elapsed);
+    if ((double)elapsed * 1e-9 > bufferSeconds) overBudget.fetch_add(1, std::memory_order_relaxed);
+
+    const uint64_t last = lastStartNs.exchange(startNs, std::memory_order_relaxed);
+    if (last != 0 && startNs > last) callbackInterval.record(startNs - last);
+}
+
+AudioHealthStats AudioHealth::stats() const {
+    AudioHealthStats s;
+    s.callbacks = callbacks.load();
+    s.underflows = underflows.load();
+    s.overflows = overflows.load();
+    s.xruns = s.underflows + s.overflows;
+    s.primingBuffers = primingBuffers.load();
+    s.partialBuffers = partialBuffers.load();
+    s.emptyBuffers = emptyBuffers.load();
+    s.overBudget = overBudget.load();
+
+    LatencyHistogram h;
+    callbackTime.snapshot(h);
+    s.callbackP50 = h.percentile(0.5);
+    s.callbackP99 = h.percentile(0.99);
+    s.callbackP999 = h.percentile(0.999);
+    s.callbackMax = (double)callbackTime.maxNs.load() * 1e-9;
+
+    callbackInterval.snapshot(h);
+    s.intervalP50 = h.percentile(0.5);
+    s.intervalP99 = h.percentile(0.99);
+    s.intervalMax = (double)callbackInterval.maxNs.load() * 1e-9;
+    return s;
+}
+
+void AudioHealth::reset() {
+    callbacks.store(0);
+    underflows.store(0);
+    overflows.store(0);
+    primingBuffers.store(0);
+    partialBuffers.store(0);
+    emptyBuffers.store(0);
+    overBudget.store(0);
+    callbackTime.reset();
+    callbackInterval.reset();
+    lastStartNs.store(0);
+}
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <chrono>
+
+#include "background_recorder.h"
+
+bool parseRecordingCodec(const std::string &text, RecordingCodec &codec) {
+    if (text == "wav") codec = RecordingCodec::Wav;
+    else if (text == "flac") codec = RecordingCodec::Flac;
+    else return false;
+    return true;
+}
+
+const char *recordingCodecName(RecordingCodec codec) {
+    return codec == RecordingCodec::Flac ? "flac" : "wav";
+}
+
+BackgroundRecorder::~BackgroundRecorder() {
+    stop();
+}
+
+bool BackgroundRecorder::start(const std::string &path, int sampleRate, int numChannels, WavSampleFormat format,
+                               RecordingCodec recordingCodec, std::string &error) {
+    if (ring.isOpen()) {
+        error = "already recording";
+        return false;
+    }
+    if (recordingCodec == RecordingCodec::Flac && format == WavSampleFormat::Float32) {
+        error = "FLAC records s16 or s24, not f32";
+        return false;
+    }
+    codec = recordingCodec;
+    channels = numChannels;
+    const bool opened = codec == RecordingCodec::Flac
+                            ? flac.open(path, (uint32_t)sampleRate, (uint16_t)channels, format)
+                            : wav.open(path, (uint32_t)sampleRate, (uint16_t)channels, format);
+    if (!opened) {
+        error = "cannot create " + path;
+        return false;
+    }
+
+    ring.allocate((size_t)(std::max(bufferSeconds, 1.0) * sampleRate) * (size_t)channels);
+    chunk.assign((size_t)sampleRate / 10 * (size_t)channels, 0.0f);
+    framesWritten.store(0);
+    bytesWritten.store(0);
+    framesDropped.store(0);
+    rf64.store(false);
+    failed.store(false);
+
+    stopRequested.store(false);
+    ring.open();
+    worker = std::thread([this]() { run(); });
+    return true;
+}
+
+bool BackgroundRecorder::stop() {
+    if (!ring.isOpen()) return true;
+    ring.close();
+    stopRequested.store(true);
+    if (worker.joinable()) worker.join();
+    return !failed.load();
+}
+
+void BackgroundRecorder::capture(const float *samples, size_t frames) {
+    CaptureRing<float>::Scope scope(ring);
+    if (!scope || frames == 0) return;
+
+    const size_t count = frames * (size_t)channels;
+    if (ring.space() < count) {
+        framesDropped.fetch_add(frames, std::memory_order_relaxed);
+        return;
+    }
+    ring.push(samples, count);
+}
+
+bool BackgroundRecorder::writeChunk(size_t frames) {
+    bool ok;
+    if (codec == RecordingCodec::Flac) {
+        ok = flac.write(chunk.data(), frames);
+        bytesWritten.store(flac.dataBytes, std::memory_order_relaxed);
+    } else {
+        ok = wav.write(chunk.data(), frames);
+        bytesWritten.store(wav.dataBytes, std::memory_order_relaxed);
+    }
+    framesWritten.fetch_add(frames, std::memory_order_relaxed);
+    return ok;
+}
+
+void BackgroundRecorder::run() {
+    bool ok = true;
+    while (true) {
+        const bool stopping = stopRequested.load();
+
+        // Drain the ring; once stopping, the output has handed over all it will
+        size_t count;
+        while ((count = ring.pop(chunk.data(), chunk.size())) > 0) {
+            // After a failed write keep draining, so the output never sees a full ring
+            if (ok) ok = writeChunk(count / (size_t)channels);
+        }
+
+        if (stopping) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    if (codec == RecordingCodec::Flac) {
+        ok = flac.close() && ok;
+        bytesWritten.store(flac.dataBytes);
+    } else {
+        rf64.store(wav.isRf64());
+        ok = wav.close() && ok;
+    }
+    if (!ok) failed.store(true);
+}
@@ -0,0 +1,59 @@
+#include <algorithm>
+
+#include "engine_clock.h"
+
+static int64_t toNs(EngineClock::Clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+void EngineClock::reset() {
+    framesOutput.store(0);
+    framesConsumed.store(0);
+    seq.fetch_add(1, std::memory_order_acq_rel);
+    anchorFrame.store(0, std::memory_order_relaxed);
+    anchorFrames.store(0, std::memory_order_relaxed);
+    anchorDacNs.store(toNs(Clock::now()), std::memory_order_relaxed);
+    seq.fetch_add(1, std::memory_order_release);
+}
+
+void EngineClock::advance(uint64_t bufferFrames, uint64_t consumed, double dacDelaySeconds) {
+    const uint64_t start = framesConsumed.load(std::memory_order_relaxed);
+    const int64_t dacNs = toNs(Clock::now()) + (int64_t)(std::max(0.0, dacDelaySeconds) * 1e9);
+
+    seq.fetch_add(1, std::memory_order_acq_rel); // odd: update in progress
+    anchorFrame.store(start, std::memory_order_relaxed);
+    anchorFrames.store(consumed, std::memory_order_relaxed);
+    anchorDacNs.store(dacNs, std::memory_order_relaxed);
+    seq.fetch_add(1, std::memory_order_release); // even: consistent again
+
+    framesConsumed.store(start + consumed, std::memory_order_release);
+    framesOutput.fetch_add(bufferFrames, std::memory_order_release);
+}
+
+EngineClock::Anchor EngineClock::readAnchor() const {
+    Anchor a;
+    uint32_t before, after;
+    do {
+        before = seq.load(std::memory_order_acquire);
+        a.frame  = anchorFrame.load(std::memory_order_relaxed);
+        a.frames = anchorFrames.load(std::memory_order_relaxed);
+        a.dacNs  = anchorDacNs.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = seq.load(std::memory_order_relaxed);
+    } while ((before & 1u) || before != after);
+    return a;
+}
+
+uint64_t EngineClock::playbackFrame() const {
+    const Anchor a = readAnchor();
+    const double elapsed = (double)(toNs(Clock::now()) - a.dacNs) * 1e-9;
+    const double pos = (double)a.frame + elapsed * (double)sampleRate;
+    // Earlier buffers are still draining when elapsed < 0; beyond the real frames we are in padding
+    return (uint64_t)std::clamp(pos, 0.0, (double)(a.frame + a.frames));
+}
+
+EngineClock::Clock::time_point EngineClock::timeOfFrame(uint64_t frame) const {
+    const Anchor a = readAnchor();
+    const double offset = ((double)frame - (double)a.frame) / (double)sampleRate;
+    return Clock::time_point(std::chrono::nanoseconds(a.dacNs + (int64_t)(offset * 1e9)));
+}
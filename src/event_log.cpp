@@ -0,0 +1,59 @@
+#include <chrono>
+
+#include "event_log.h"
+
+static_assert(sizeof(EventRecord) == 64, "EventRecord should stay one cache line");
+
+EventLog::EventLog() : slots(kCapacity) {
+    for (size_t i = 0; i < kCapacity; i++) {
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+// Per-slot sequence numbers (Vyukov's bounded queue): a slot is writable when seq == pos
+// and readable when seq == pos + 1
+bool EventLog::push(EventRecord record) {
+    if (record.timeNs == 0) {
+        record.timeNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    size_t pos = head.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot &slot = slots[pos & (kCapacity - 1)];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.record = record;
+                slot.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool EventLog::pop(EventRecord &record) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot &slot = slots[pos & (kCapacity - 1)];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                record = slot.record;
+                slot.seq.store(pos + kCapacity, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
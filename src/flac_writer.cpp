@@ -0,0 +1,540 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "flac_writer.h"
+
+namespace {
+
+constexpr int kMaxLpcOrder = 32;
+constexpr int kMaxPartitionOrder = 8;
+constexpr double kPi = 3.14159265358979323846;
+
+// MSB-first bit packer appending to a reusable byte vector
+struct BitWriter {
+    std::vector<uint8_t> &bytes;
+    uint64_t acc = 0;
+    int count = 0; // bits in acc not yet in bytes, always < 8 between calls
+
+    explicit BitWriter(std::vector<uint8_t> &out) : bytes(out) { bytes.clear(); }
+
+    void put(uint32_t value, int bits) { // 0..32 bits
+        if (bits == 0) return;
+        acc = (acc << bits) | (value & (0xFFFFFFFFu >> (32 - bits)));
+        count += bits;
+        while (count >= 8) {
+            count -= 8;
+            bytes.push_back((uint8_t)(acc >> count));
+        }
+        acc &= (1u << count) - 1;
+    }
+
+    void putSigned(int32_t value, int bits) { put((uint32_t)value, bits); }
+
+    // Zigzag folded, then unary quotient and k low bits
+    void putRice(int32_t value, int k) {
+        const uint32_t u = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+        uint32_t q = u >> k;
+        if (q + 1 + (uint32_t)k <= 32) {
+            put((1u << k) | (k ? u & (0xFFFFFFFFu >> (32 - k)) : 0), (int)q + 1 + k);
+            return;
+        }
+        for (; q >= 32; q -= 32) put(0, 32);
+        put(1, (int)q + 1);
+        put(u, k);
+    }
+
+    void alignToByte() {
+        if (count > 0) put(0, 8 - count);
+    }
+};
+
+uint8_t crc8(const uint8_t *data, size_t n) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < n; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+struct Crc16Table {
+    uint16_t entries[256];
+    Crc16Table() {
+        for (int i = 0; i < 256; i++) {
+            uint16_t crc = (uint16_t)(i << 8);
+            for (int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x8005) : (uint16_t)(crc << 1);
+            entries[i] = crc;
+        }
+    }
+};
+
+uint16_t crc16(const uint8_t *data, size_t n) {
+    static const Crc16Table table;
+    uint16_t crc = 0;
+    for (size_t i = 0; i < n; i++) crc = (uint16_t)((crc << 8) ^ table.entries[(crc >> 8) ^ data[i]]);
+    return crc;
+}
+
+inline uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+enum class SubframeType { Constant, Verbatim, Fixed, Lpc };
+
+struct SubframePlan {
+    SubframeType type = SubframeType::Verbatim;
+    int order = 0;
+    int precision = 0; // LPC coefficient bits
+    int shift = 0;
+    int32_t coefs[kMaxLpcOrder] = {};
+    int partitionOrder = 0;
+    int paramBits = 4; // 5 when a Rice parameter is above 14
+    uint8_t params[1 << kMaxPartitionOrder] = {};
+    uint64_t bits = 0; // whole subframe
+};
+
+// Rice parameter minimizing the usual estimate samples * (k + 1) + sum >> k
+inline int riceParameter(uint64_t sum, uint64_t samples, uint64_t &bits) {
+    if (samples == 0) {
+        bits = 0;
+        return 0;
+    }
+    int k0 = 0;
+    while (k0 < 30 && (samples << (k0 + 1)) <= sum) k0++;
+    int best = k0;
+    bits = UINT64_MAX;
+    for (int k = std::max(k0 - 1, 0); k <= std::min(k0 + 1, 30); k++) {
+        const uint64_t cost = samples * (uint64_t)(k + 1) + (sum >> k);
+        if (cost < bits) {
+            bits = cost;
+            best = k;
+        }
+    }
+    return best;
+}
+
+// Picks the partition order and parameters for residual[order..n). Returns the estimated bits.
+uint64_t planResidual(const int32_t *residual, int n, int order, int maxPartitionOrder, SubframePlan &plan) {
+    int deepest = 0;
+    while (deepest < maxPartitionOrder && n % (2 << deepest) == 0 && (n >> (deepest + 1)) > order) deepest++;
+
+    uint64_t sums[1 << kMaxPartitionOrder];
+    const int partSize = n >> deepest;
+    for (int p = 0; p < (1 << deepest); p++) {
+        uint64_t s = 0;
+        for (int i = p == 0 ? order : p * partSize; i < (p + 1) * partSize; i++) s += zigzag(residual[i]);
+        sums[p] = s;
+    }
+
+    uint64_t best = UINT64_MAX;
+    for (int po = deepest; po >= 0; po--) {
+        const int parts = 1 << po;
+        if (po < deepest) {
+            for (int p = 0; p < parts; p++) sums[p] = sums[2 * p] + sums[2 * p + 1];
+        }
+        uint8_t params[1 << kMaxPartitionOrder];
+        uint64_t bits = 0;
+        int maxParam = 0;
+        for (int p = 0; p < parts; p++) {
+            const uint64_t samples = (uint64_t)(n >> po) - (p == 0 ? (uint64_t)order : 0);
+            uint64_t partBits;
+            params[p] = (uint8_t)riceParameter(sums[p], samples, partBits);
+            maxParam = std::max(maxParam, (int)params[p]);
+            bits += partBits;
+        }
+        const int paramBits = maxParam > 14 ? 5 : 4;
+        bits += 2 + 4 + (uint64_t)parts * paramBits;
+        if (bits < best) {
+            best = bits;
+            plan.partitionOrder = po;
+            plan.paramBits = paramBits;
+            std::memcpy(plan.params, params, (size_t)parts);
+        }
+    }
+    return best;
+}
+
+void fixedResidual(const int32_t *x, int n, int order, int32_t *r) {
+    for (int i = order; i < n; i++) {
+        switch (order) {
+        case 0: r[i] = x[i]; break;
+        case 1: r[i] = x[i] - x[i - 1]; break;
+        case 2: r[i] = x[i] - 2 * x[i - 1] + x[i - 2]; break;
+        case 3: r[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]; break;
+        default: r[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4]; break;
+        }
+    }
+}
+
+// False if a residual does not fit the 32 bits FLAC allows
+bool lpcResidual(const int32_t *x, int n, const int32_t *coefs, int order, int shift, int32_t *r) {
+    for (int i = order; i < n; i++) {
+        int64_t sum = 0;
+        for (int j = 0; j < order; j++) sum += (int64_t)coefs[j] * x[i - j - 1];
+        const int64_t value = (int64_t)x[i] - (sum >> shift);
+        if (value < INT32_MIN || value > INT32_MAX) return false;
+        r[i] = (int32_t)value;
+    }
+    return true;
+}
+
+// Coefficients to `precision` signed bits with the largest shift that fits; rounding error
+// carried into the next coefficient
+bool quantizeLpc(const double *lp, int order, int precision, int32_t *q, int &shift) {
+    double cmax = 0.0;
+    for (int i = 0; i < order; i++) cmax = std::max(cmax, std::fabs(lp[i]));
+    if (cmax <= 0.0) return false;
+    int exponent;
+    std::frexp(cmax, &exponent);
+    shift = std::min(precision - 1 - exponent, 15);
+    if (shift < 0) return false;
+
+    const int32_t qmax = (1 << (precision - 1)) - 1, qmin = -qmax - 1;
+    double error = 0.0;
+    for (int i = 0; i < order; i++) {
+        error += lp[i] * (double)(1 << shift);
+        const int32_t value = (int32_t)std::clamp(std::lround(error), (long)qmin, (long)qmax);
+        error -= value;
+        q[i] = value;
+    }
+    return true;
+}
+
+// Levinson-Durbin on the autocorrelation of the windowed block. lp[o - 1][j] predicts with
+// x[i - j - 1] for order o. Returns the highest order computed.
+int computeLpc(const double *windowed, int n, int maxOrder, double lp[][kMaxLpcOrder]) {
+    double autoc[kMaxLpcOrder + 1];
+    for (int lag = 0; lag <= maxOrder; lag++) {
+        double sum = 0.0;
+        for (int i = lag; i < n; i++) sum += windowed[i] * windowed[i - lag];
+        autoc[lag] = sum;
+    }
+    if (autoc[0] <= 0.0) return 0;
+
+    double a[kMaxLpcOrder + 1] = {};
+    double err = autoc[0];
+    for (int i = 1; i <= maxOrder; i++) {
+        double acc = autoc[i];
+        for (int j = 1; j < i; j++) acc -= a[j] * autoc[i - j];
+        const double k = acc / err;
+        double next[kMaxLpcOrder + 1];
+        for (int j = 1; j < i; j++) next[j] = a[j] - k * a[i - j];
+        next[i] = k;
+        std::memcpy(a + 1, next + 1, (size_t)i * sizeof(double));
+        for (int j = 0; j < i; j++) lp[i - 1][j] = a[j + 1];
+        err *= 1.0 - k * k;
+        if (err <= 0.0) return i;
+    }
+    return maxOrder;
+}
+
+struct Analyzer {
+    int maxLpcOrder;
+    int maxPartitionOrder;
+    const double *window;
+    double *windowed;
+    int32_t *residual;
+
+    SubframePlan analyze(const int32_t *x, int n, int bps) const {
+        SubframePlan best;
+        if (std::all_of(x + 1, x + n, [v = x[0]](int32_t s) { return s == v; })) {
+            best.type = SubframeType::Constant;
+            best.bits = 8 + (uint64_t)bps;
+            return best;
+        }
+        best.bits = 8 + (uint64_t)n * bps;
+
+        for (int order = 0; order <= 4 && order < n; order++) {
+            SubframePlan p;
+            p.type = SubframeType::Fixed;
+            p.order = order;
+            fixedResidual(x, n, order, residual);
+            p.bits = 8 + (uint64_t)order * bps + planResidual(residual, n, order, maxPartitionOrder, p);
+            if (p.bits < best.bits) best = p;
+        }
+
+        const int maxOrder = std::min(maxLpcOrder, n - 1);
+        if (maxOrder <= 0) return best;
+        for (int i = 0; i < n; i++) windowed[i] = x[i] * window[i];
+        double lp[kMaxLpcOrder][kMaxLpcOrder];
+        const int orders = computeLpc(windowed, n, maxOrder, lp);
+        const int precision = bps <= 17 ? 12 : 14;
+        for (int order = 1; order <= orders; order++) {
+            SubframePlan p;
+            p.type = SubframeType::Lpc;
+            p.order = order;
+            p.precision = precision;
+            if (!quantizeLpc(lp[order - 1], order, precision, p.coefs, p.shift)) continue;
+            if (!lpcResidual(x, n, p.coefs, order, p.shift, residual)) continue;
+            p.bits = 8 + (uint64_t)order * bps + 4 + 5 + (uint64_t)order * precision +
+                     planResidual(residual, n, order, maxPartitionOrder, p);
+            if (p.bits < best.bits) best = p;
+        }
+        return best;
+    }
+
+    void write(BitWriter &bw, const int32_t *x, int n, int bps, const SubframePlan &p) const {
+        bw.put(0, 1);
+        switch (p.type) {
+        case SubframeType::Constant:
+            bw.put(0, 7);
+            bw.putSigned(x[0], bps);
+            return;
+        case SubframeType::Verbatim:
+            bw.put(1 << 1, 7);
+            for (int i = 0; i < n; i++) bw.putSigned(x[i], bps);
+            return;
+        case SubframeType::Fixed:
+            bw.put((uint32_t)(8 | p.order) << 1, 7);
+            for (int i = 0; i < p.order; i++) bw.putSigned(x[i], bps);
+            fixedResidual(x, n, p.order, residual);
+            break;
+        case SubframeType::Lpc:
+            bw.put((uint32_t)(32 | (p.order - 1)) << 1, 7);
+            for (int i = 0; i < p.order; i++) bw.putSigned(x[i], bps);
+            bw.put((uint32_t)p.precision - 1, 4);
+            bw.putSigned(p.shift, 5);
+            for (int i = 0; i < p.order; i++) bw.putSigned(p.coefs[i], p.precision);
+            lpcResidual(x, n, p.coefs, p.order, p.shift, residual);
+            break;
+        }
+
+        bw.put(p.paramBits == 5 ? 1 : 0, 2);
+        bw.put((uint32_t)p.partitionOrder, 4);
+        const int partSize = n >> p.partitionOrder;
+        for (int part = 0; part < (1 << p.partitionOrder); part++) {
+            const int k = p.params[part];
+            bw.put((uint32_t)k, p.paramBits);
+            for (int i = part == 0 ? p.order : part * partSize; i < (part + 1) * partSize; i++) bw.putRice(residual[i], k);
+        }
+    }
+};
+
+int blockSizeCode(int n) {
+    if (n == 192) return 1;
+    for (int c = 2; c <= 5; c++) {
+        if (n == 576 << (c - 2)) return c;
+    }
+    for (int c = 8; c <= 15; c++) {
+        if (n == 256 << (c - 8)) return c;
+    }
+    return n <= 256 ? 6 : 7; // size follows the header
+}
+
+int sampleRateCode(uint32_t rate) {
+    switch (rate) {
+    case 88200: return 1;
+    case 176400: return 2;
+    case 192000: return 3;
+    case 8000: return 4;
+    case 16000: return 5;
+    case 22050: return 6;
+    case 24000: return 7;
+    case 32000: return 8;
+    case 44100: return 9;
+    case 48000: return 10;
+    case 96000: return 11;
+    default: return 0; // see STREAMINFO
+    }
+}
+
+// Frame number in the UTF-8 style variable-length code
+void putCodedNumber(BitWriter &bw, uint64_t v) {
+    if (v < 0x80) {
+        bw.put((uint32_t)v, 8);
+        return;
+    }
+    int bytes = 2;
+    while (bytes < 7 && v >= (1ull << (5 * bytes + 1))) bytes++;
+    const uint32_t lead = bytes == 7 ? 0xFE : ((0xFF00u >> bytes) & 0xFF) | (uint32_t)(v >> (6 * (bytes - 1)));
+    bw.put(lead, 8);
+    for (int i = bytes - 2; i >= 0; i--) bw.put(0x80 | (uint32_t)((v >> (6 * i)) & 0x3F), 8);
+}
+
+} // namespace
+
+bool FlacFileWriter::open(const std::string &path, uint32_t rate, uint16_t numChannels, WavSampleFormat sampleFormat) {
+    close();
+    if (sampleFormat == WavSampleFormat::Float32 || numChannels < 1 || numChannels > 8) return false;
+    file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    sampleRate = rate;
+    channels = numChannels;
+    bitsPerSample = sampleFormat == WavSampleFormat::Int24 ? 24 : 16;
+    blockSize = std::clamp(blockSize, 16, 65535);
+    maxLpcOrder = std::clamp(maxLpcOrder, 0, kMaxLpcOrder);
+    maxPartitionOrder = std::clamp(maxPartitionOrder, 0, kMaxPartitionOrder);
+    failed = false;
+    dataBytes = 0;
+    framesWritten = 0;
+    frameNumber = 0;
+    minFrameBytes = 0;
+    maxFrameBytes = 0;
+    ditherState = DitherState(dither, channels);
+    pending.assign((size_t)channels, std::vector<int32_t>((size_t)blockSize));
+    pendingFrames = 0;
+    mid.resize((size_t)blockSize);
+    side.resize((size_t)blockSize);
+    residual.resize((size_t)blockSize);
+    windowed.resize((size_t)blockSize);
+
+    if (!writeStreamInfo()) {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool FlacFileWriter::writeStreamInfo() {
+    BitWriter bw(frame);
+    for (char c : {'f', 'L', 'a', 'C'}) bw.put((uint8_t)c, 8);
+    bw.put(1, 1); // last metadata block
+    bw.put(0, 7); // STREAMINFO
+    bw.put(34, 24);
+    bw.put((uint32_t)blockSize, 16);
+    bw.put((uint32_t)blockSize, 16);
+    bw.put(minFrameBytes, 24);
+    bw.put(maxFrameBytes, 24);
+    bw.put(sampleRate, 20);
+    bw.put((uint32_t)channels - 1, 3);
+    bw.put((uint32_t)bitsPerSample - 1, 5);
+    bw.put((uint32_t)(framesWritten >> 32) & 0xF, 4);
+    bw.put((uint32_t)framesWritten, 32);
+    for (int i = 0; i < 4; i++) bw.put(0, 32); // MD5 not computed
+    if (fwrite(frame.data(), 1, frame.size(), file) != frame.size()) {
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool FlacFileWriter::write(const float *audioData, size_t frameCount) {
+    if (!file || failed) return false;
+    const size_t count = frameCount * (size_t)channels;
+    const int16_t *s16 = nullptr;
+    const uint8_t *s24 = nullptr;
+    if (bitsPerSample == 24) {
+        converted.reserve(count * 3);
+        convertFloatToInt24(audioData, converted.data(), count, ditherState);
+        s24 = converted.data();
+    } else {
+        converted.reserve(count * sizeof(int16_t));
+        convertFloatToInt16(audioData, (int16_t *)converted.data(), count, ditherState);
+        s16 = (const int16_t *)converted.data();
+    }
+
+    for (size_t f = 0; f < frameCount; f++) {
+        for (int c = 0; c < channels; c++) {
+            const size_t i = f * (size_t)channels + (size_t)c;
+            pending[(size_t)c][pendingFrames] =
+                s16 ? s16[i] : (int32_t)((uint32_t)(s24[3 * i] | s24[3 * i + 1] << 8 | s24[3 * i + 2] << 16) << 8) >> 8;
+        }
+        if (++pendingFrames == (size_t)blockSize) {
+            if (!encodeBlock(pendingFrames)) return false;
+            pendingFrames = 0;
+        }
+    }
+    return true;
+}
+
+bool FlacFileWriter::encodeBlock(size_t frames) {
+    const int n = (int)frames;
+
+    // Tukey(0.5) analysis window, rebuilt only when the block length changes
+    if ((int)window.size() != n) {
+        window.assign((size_t)n, 1.0);
+        const int taper = n / 4;
+        for (int i = 0; i < taper; i++) {
+            const double w = 0.5 - 0.5 * std::cos(kPi * i / taper);
+            window[(size_t)i] = w;
+            window[(size_t)(n - 1 - i)] = w;
+        }
+    }
+    const Analyzer analyzer{maxLpcOrder, maxPartitionOrder, window.data(), windowed.data(), residual.data()};
+
+    // Independent channels, or the cheapest of left/side, side/right and mid/side for stereo
+    int assignment = channels - 1;
+    const int32_t *sources[8];
+    int sourceBits[8];
+    SubframePlan plans[8];
+    for (int c = 0; c < channels; c++) {
+        sources[c] = pending[(size_t)c].data();
+        sourceBits[c] = bitsPerSample;
+        plans[c] = analyzer.analyze(sources[c], n, bitsPerSample);
+    }
+    if (channels == 2) {
+        const int32_t *left = sources[0], *right = sources[1];
+        for (int i = 0; i < n; i++) {
+            side[(size_t)i] = left[i] - right[i];
+            mid[(size_t)i] = (left[i] + right[i]) >> 1;
+        }
+        const SubframePlan sidePlan = analyzer.analyze(side.data(), n, bitsPerSample + 1);
+        const SubframePlan midPlan = analyzer.analyze(mid.data(), n, bitsPerSample);
+        const uint64_t independent = plans[0].bits + plans[1].bits;
+        const uint64_t leftSide = plans[0].bits + sidePlan.bits;
+        const uint64_t sideRight = sidePlan.bits + plans[1].bits;
+        const uint64_t midSide = midPlan.bits + sidePlan.bits;
+        const uint64_t best = std::min({independent, leftSide, sideRight, midSide});
+        if (best == midSide) {
+            assignment = 10;
+            sources[0] = mid.data();
+            plans[0] = midPlan;
+        } else if (best == leftSide) {
+            assignment = 8;
+        } else if (best == sideRight) {
+            assignment = 9;
+            sources[0] = side.data();
+            sourceBits[0] = bitsPerSample + 1;
+            plans[0] = sidePlan;
+        }
+        if (assignment == 8 || assignment == 10) {
+            sources[1] = side.data();
+            sourceBits[1] = bitsPerSample + 1;
+            plans[1] = sidePlan;
+        }
+    }
+
+    BitWriter bw(frame);
+    bw.put(0xFFF8, 16); // sync, fixed block size
+    const int sizeCode = blockSizeCode(n);
+    bw.put((uint32_t)sizeCode, 4);
+    bw.put((uint32_t)sampleRateCode(sampleRate), 4);
+    bw.put((uint32_t)assignment, 4);
+    bw.put(bitsPerSample == 24 ? 6 : 4, 3);
+    bw.put(0, 1);
+    putCodedNumber(bw, frameNumber);
+    if (sizeCode == 6) bw.put((uint32_t)n - 1, 8);
+    else if (sizeCode == 7) bw.put((uint32_t)n - 1, 16);
+    bw.put(crc8(frame.data(), frame.size()), 8);
+
+    for (int c = 0; c < channels; c++) analyzer.write(bw, sources[c], n, sourceBits[c], plans[c]);
+    bw.alignToByte();
+    bw.put(crc16(frame.data(), frame.size()), 16);
+
+    if (fwrite(frame.data(), 1, frame.size(), file) != frame.size()) {
+        failed = true;
+        return false;
+    }
+    const uint32_t size = (uint32_t)frame.size();
+    minFrameBytes = minFrameBytes ? std::min(minFrameBytes, size) : size;
+    maxFrameBytes = std::max(maxFrameBytes, size);
+    dataBytes += size;
+    framesWritten += frames;
+    frameNumber++;
+    return true;
+}
+
+bool FlacFileWriter::close() {
+    if (!file) return !failed;
+    bool ok = !failed;
+    if (ok && pendingFrames > 0) ok = encodeBlock(pendingFrames);
+    pendingFrames = 0;
+    // Now the totals are known
+    if (ok) ok = fseek(file, 0, SEEK_SET) == 0 && writeStreamInfo();
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    return ok;
+}
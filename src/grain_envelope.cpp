@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WALKK_ENVELOPE_SSE 1
+#endif
+
+#include "grain_envelope.h"
+
+namespace {
+
+// Frames processed per block: gains for one block live on the stack next to the samples
+constexpr size_t kEnvelopeBlockFrames = 64;
+
+// Steepness of the exponential ramp (about 43 dB of range from edge to full level)
+constexpr double kExponentialSteepness = 5.0;
+
+// Rising ramp of each shape for x in [0, 1]
+double exactRamp(EnvelopeShape shape, double x) {
+    switch (shape) {
+    case EnvelopeShape::Hann:
+    case EnvelopeShape::Tukey:
+        return 0.5 - 0.5 * std::cos(std::numbers::pi * x);
+    case EnvelopeShape::Trapezoid:
+        return x;
+    case EnvelopeShape::Exponential:
+        return (std::exp(kExponentialSteepness * x) - 1.0) / (std::exp(kExponentialSteepness) - 1.0);
+    }
+    return 1.0;
+}
+
+// Rising ramps for every shape, built once. ~8 KB total so they stay in L1/L2.
+struct EnvelopeTables {
+    alignas(64) float ramp[kEnvelopeShapeCount][kEnvelopeTableSize + 2];
+
+    EnvelopeTables() {
+        for (int s = 0; s < kEnvelopeShapeCount; ++s) {
+            for (size_t i = 0; i < kEnvelopeTableSize + 2; ++i) {
+                double x = std::min(1.0, (double)i / (double)kEnvelopeTableSize);
+                ramp[s][i] = (float)exactRamp((EnvelopeShape)s, x);
+            }
+        }
+    }
+};
+
+const EnvelopeTables &tables() {
+    static const EnvelopeTables t;
+    return t;
+}
+
+inline float lookupRamp(const float *table, float x) {
+    float pos = x * (float)kEnvelopeTableSize;
+    size_t i0 = (size_t)pos;
+    if (i0 >= kEnvelopeTableSize) return table[kEnvelopeTableSize];
+    float frac = pos - (float)i0;
+    return table[i0] + (table[i0 + 1] - table[i0]) * frac;
+}
+
+void scaleBlock(float *samples, const float *gains, size_t frames, int channels) {
+    size_t f = 0;
+#ifdef WALKK_ENVELOPE_SSE
+    if (channels == 2) {
+        for (; f + 4 <= frames; f += 4) {
+            __m128 g  = _mm_loadu_ps(gains + f);
+            __m128 lo = _mm_unpacklo_ps(g, g); // g0 g0 g1 g1
+            __m128 hi = _mm_unpackhi_ps(g, g); // g2 g2 g3 g3
+            float *p = samples + f * 2;
+            _mm_storeu_ps(p,     _mm_mul_ps(_mm_loadu_ps(p),     lo));
+            _mm_storeu_ps(p + 4, _mm_mul_ps(_mm_loadu_ps(p + 4), hi));
+        }
+    } else if (channels == 1) {
+        for (; f + 4 <= frames; f += 4) {
+            _mm_storeu_ps(samples + f, _mm_mul_ps(_mm_loadu_ps(samples + f), _mm_loadu_ps(gains + f)));
+        }
+    }
+#endif
+    for (; f < frames; ++f) {
+        for (int ch = 0; ch < channels; ++ch) {
+            samples[f * (size_t)channels + (size_t)ch] *= gains[f];
+        }
+    }
+}
+
+// Apply a ramp over [firstFrame, firstFrame + count) where the ramp position of
+// frame i is (i - origin) / rampLen, mirrored when falling.
+void applyRamp(float *samples, int channels, const float *table,
+               size_t firstFrame, size_t count, size_t rampLen, bool falling) {
+    alignas(16) float gains[kEnvelopeBlockFrames];
+    const float step = 1.0f / (float)rampLen;
+
+    for (size_t done = 0; done < count; done += kEnvelopeBlockFrames) {
+        size_t n = std::min(kEnvelopeBlockFrames, count - done);
+        for (size_t i = 0; i < n; ++i) {
+            size_t k = done + i; // 0..count-1 within the ramp region
+            float x = falling ? (float)(rampLen - 1 - k) * step : (float)k * step;
+            gains[i] = lookupRamp(table, x);
+        }
+        scaleBlock(samples + (firstFrame + done) * (size_t)channels, gains, n, channels);
+    }
+}
+
+// Hann spans the whole grain; other ramps longer than the grain shrink proportionally so they
+// meet without overlapping
+void fitRamps(EnvelopeShape shape, size_t frames, size_t &attackFrames, size_t &releaseFrames) {
+    if (shape == EnvelopeShape::Hann) {
+        attackFrames  = frames / 2;
+        releaseFrames = frames - attackFrames;
+    } else if (attackFrames + releaseFrames > frames) {
+        double scale = (double)frames / (double)(attackFrames + releaseFrames);
+        attackFrames  = (size_t)((double)attackFrames * scale);
+        releaseFrames = std::min(frames - attackFrames, (size_t)((double)releaseFrames * scale));
+    }
+}
+
+} // namespace
+
+const char *envelopeShapeName(EnvelopeShape shape) {
+    switch (shape) {
+    case EnvelopeShape::Hann:        return "Hann";
+    case EnvelopeShape::Tukey:       return "Tukey";
+    case EnvelopeShape::Trapezoid:   return "Trapezoid";
+    case EnvelopeShape::Exponential: return "Exponential";
+    }
+    return "?";
+}
+
+float envelopeRampGain(EnvelopeShape shape, float x) {
+    int s = std::clamp((int)shape, 0, kEnvelopeShapeCount - 1);
+    return lookupRamp(tables().ramp[s], std::clamp(x, 0.0f, 1.0f));
+}
+
+void applyGrainEnvelope(float *samples, size_t frames, int channels,
+                        EnvelopeShape shape, size_t attackFrames, size_t releaseFrames) {
+    if (!samples || frames < 2 || channels <= 0) return;
+
+    int s = std::clamp((int)shape, 0, kEnvelopeShapeCount - 1);
+    const float *table = tables().ramp[s];
+    fitRamps(shape, frames, attackFrames, releaseFrames);
+
+    if (attackFrames > 0) {
+        applyRamp(samples, channels, table, 0, attackFrames, attackFrames, false);
+    }
+    if (releaseFrames > 0) {
+        applyRamp(samples, channels, table, frames - releaseFrames, releaseFrames, releaseFrames, true);
+    }
+}
+
+void applyGrainEnvelopeExact(float *samples, size_t frames, int channels,
+                             EnvelopeShape shape, size_t attackFrames, size_t releaseFrames) {
+    if (!samples || frames < 2 || channels <= 0) return;
+    shape = (EnvelopeShape)std::clamp((int)shape, 0, kEnvelopeShapeCount - 1);
+    fitRamps(shape, frames, attackFrames, releaseFrames);
+
+    // Same ramp positions as applyGrainEnvelope, evaluated directly
+    auto scaleFrame = [&](size_t frame, double gain) {
+        float *p = samples + frame * (size_t)channels;
+        for (int ch = 0; ch < channels; ++ch) p[ch] = (float)((double)p[ch] * gain);
+    };
+    for (size_t k = 0; k < attackFrames; ++k) {
+        scaleFrame(k, exactRamp(shape, (double)k / (double)attackFrames));
+    }
+    for (size_t k = 0; k < releaseFrames; ++k) {
+        scaleFrame(frames - releaseFrames + k, exactRamp(shape, (double)(releaseFrames - 1 - k) / (double)releaseFrames));
+    }
+}
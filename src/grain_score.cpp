@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "grain_envelope.h"
+#include "grain_score.h"
+#include "mixer.h"
+#include "noise_gen.h"
+
+static const char kScoreMagic[4] = {'W', 'K', 'S', 'C'};
+static constexpr uint32_t kScoreVersion = 1;
+
+// Voice and Settings payloads; the offsets below are fixed by the format, not by the structs
+static constexpr size_t kRecordBytes = 64;
+
+// Flush at least this often (engine seconds) so a crash loses little
+static constexpr uint64_t kFlushSeconds = 5;
+
+// Longest noise gap the producer schedules
+static constexpr uint64_t kMaxNoiseFrames = 5 * 48000;
+
+// Every field goes through these, so a score moves between hosts of either byte order
+static void putU32(uint8_t *p, uint32_t value) {
+    for (int i = 0; i < 4; ++i) p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void putU64(uint8_t *p, uint64_t value) {
+    for (int i = 0; i < 8; ++i) p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void putF32(uint8_t *p, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    putU32(p, bits);
+}
+
+static uint32_t getU32(const uint8_t *p) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) value |= (uint32_t)p[i] << (8 * i);
+    return value;
+}
+
+static uint64_t getU64(const uint8_t *p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) value |= (uint64_t)p[i] << (8 * i);
+    return value;
+}
+
+static float getF32(const uint8_t *p) {
+    const uint32_t bits = getU32(p);
+    float value;
+    std::memcpy(&value, &bits, 4);
+    return value;
+}
+
+static bool writeU32(FILE *file, uint32_t value) {
+    uint8_t bytes[4];
+    putU32(bytes, value);
+    return std::fwrite(bytes, 1, 4, file) == 4;
+}
+
+static bool writeU64(FILE *file, uint64_t value) {
+    uint8_t bytes[8];
+    putU64(bytes, value);
+    return std::fwrite(bytes, 1, 8, file) == 8;
+}
+
+static bool readU32(FILE *file, uint32_t &value) {
+    uint8_t bytes[4];
+    if (std::fread(bytes, 1, 4, file) != 4) return false;
+    value = getU32(bytes);
+    return true;
+}
+
+static bool readU64(FILE *file, uint64_t &value) {
+    uint8_t bytes[8];
+    if (std::fread(bytes, 1, 8, file) != 8) return false;
+    value = getU64(bytes);
+    return true;
+}
+
+static void encodeVoice(const ScoreVoice &v, uint8_t *p) {
+    std::memset(p, 0, kRecordBytes);
+    putU64(p + 0, v.engineFrame);
+    putU64(p + 8, v.sourceFrame);
+    putU64(p + 16, v.noiseSeed);
+    putU32(p + 24, v.fileIndex);
+    putU32(p + 28, v.lengthFrames);
+    putU32(p + 32, v.loopWindowFrames);
+    putU32(p + 36, (uint32_t)v.loopDragFrames);
+    putU32(p + 40, v.attackFrames);
+    putU32(p + 44, v.releaseFrames);
+    putF32(p + 48, v.amplitude);
+    p[52] = v.slot;
+    p[53] = v.flags;
+    p[54] = v.shape;
+    p[55] = (uint8_t)v.type;
+}
+
+static ScoreVoice decodeVoice(const uint8_t *p) {
+    ScoreVoice v;
+    v.engineFrame = getU64(p + 0);
+    v.sourceFrame = getU64(p + 8);
+    v.noiseSeed = getU64(p + 16);
+    v.fileIndex = getU32(p + 24);
+    v.lengthFrames = getU32(p + 28);
+    v.loopWindowFrames = getU32(p + 32);
+    v.loopDragFrames = (int32_t)getU32(p + 36);
+    v.attackFrames = getU32(p + 40);
+    v.releaseFrames = getU32(p + 44);
+    v.amplitude = getF32(p + 48);
+    v.slot = p[52];
+    v.flags = p[53];
+    v.shape = p[54];
+    return v;
+}
+
+static void encodeSettings(const ScoreSettings &s, uint8_t *p) {
+    std::memset(p, 0, kRecordBytes);
+    putU64(p + 0, s.engineFrame);
+    putU32(p + 8, s.minGrainMs);
+    putU32(p + 12, s.maxGrainMs);
+    putU32(p + 16, s.grainOverlapMs);
+    putU32(p + 20, s.maxConcurrentGrains);
+    putU32(p + 24, s.minLoopWindowMs);
+    putU32(p + 28, s.maxLoopWindowMs);
+    putU32(p + 32, (uint32_t)s.maxLoopDragMs);
+    putU32(p + 36, s.whiteNoiseMs);
+    putU32(p + 40, s.envelopeAttackMs);
+    putU32(p + 44, s.envelopeReleaseMs);
+    putF32(p + 48, s.loopProbability);
+    putF32(p + 52, s.bouncebackProbability);
+    putF32(p + 56, s.whiteNoiseAmplitude);
+    p[60] = s.noiseColor;
+    p[61] = s.envelopeShape;
+}
+
+static ScoreSettings decodeSettings(const uint8_t *p) {
+    ScoreSettings s;
+    s.engineFrame = getU64(p + 0);
+    s.minGrainMs = getU32(p + 8);
+    s.maxGrainMs = getU32(p + 12);
+    s.grainOverlapMs = getU32(p + 16);
+    s.maxConcurrentGrains = getU32(p + 20);
+    s.minLoopWindowMs = getU32(p + 24);
+    s.maxLoopWindowMs = getU32(p + 28);
+    s.maxLoopDragMs = (int32_t)getU32(p + 32);
+    s.whiteNoiseMs = getU32(p + 36);
+    s.envelopeAttackMs = getU32(p + 40);
+    s.envelopeReleaseMs = getU32(p + 44);
+    s.loopProbability = getF32(p + 48);
+    s.bouncebackProbability = getF32(p + 52);
+    s.whiteNoiseAmplitude = getF32(p + 56);
+    s.noiseColor = p[60];
+    s.envelopeShape = p[61];
+    return s;
+}
+
+// Fields that index into something or size an allocation; empty if the voice is sound
+static std::string checkVoice(const ScoreVoice &v, const std::vector<ScoreFile> &files) {
+    if (v.slot >= Mixer::kMaxVoices) return "slot " + std::to_string(v.slot) + " out of range";
+    if (v.type == ScoreRecordType::Noise) {
+        if (v.shape >= kNoiseColorCount) return "noise color " + std::to_string(v.shape) + " out of range";
+        if (v.lengthFrames > kMaxNoiseFrames) return "noise length " + std::to_string(v.lengthFrames) + " out of range";
+        return {};
+    }
+    if (v.fileIndex >= files.size()) return "file index " + std::to_string(v.fileIndex) + " out of range";
+    if (v.shape >= kEnvelopeShapeCount) return "envelope shape " + std::to_string(v.shape) + " out of range";
+    // The producer never makes a grain longer than its file
+    const ScoreFile &f = files[v.fileIndex];
+    if (v.lengthFrames > f.totalFrames || v.sourceFrame > f.totalFrames) {
+        return "grain of " + std::to_string(v.lengthFrames) + " frames at " + std::to_string(v.sourceFrame) +
+               " outside its file (" + std::to_string(f.totalFrames) + " frames)";
+    }
+    return {};
+}
+
+ScoreWriter::~ScoreWriter() {
+    if (file) std::fclose(file);
+}
+
+bool ScoreWriter::open(const std::string &path, uint32_t rate, uint32_t channels, const std::vector<ScoreFile> &files,
+                       std::string &error) {
+    if (file) {
+        error = "score already open";
+        return false;
+    }
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        error = "cannot create " + path;
+        return false;
+    }
+    std::setvbuf(file, nullptr, _IOFBF, 1 << 16);
+    sampleRate = rate;
+    voicesWritten = 0;
+    flushedFrame = 0;
+    failed = false;
+
+    bool ok = std::fwrite(kScoreMagic, 1, 4, file) == 4 && writeU32(file, kScoreVersion) &&
+              writeU32(file, rate) && writeU32(file, channels) && writeU32(file, (uint32_t)files.size());
+    for (const ScoreFile &f : files) {
+        if (!ok) break;
+        ok = writeU32(file, f.sampleRate) && writeU32(file, f.channels) &&
+             writeU64(file, f.totalFrames) && writeU32(file, (uint32_t)f.path.size()) &&
+             std::fwrite(f.path.data(), 1, f.path.size(), file) == f.path.size();
+    }
+    if (!ok || std::fflush(file) != 0) {
+        std::fclose(file);
+        file = nullptr;
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+void ScoreWriter::writeRecord(ScoreRecordType type, const uint8_t *payload, size_t bytes) {
+    if (!file) return;
+    const uint8_t tag = (uint8_t)type;
+    if (std::fwrite(&tag, 1, 1, file) != 1 || std::fwrite(payload, 1, bytes, file) != bytes) failed = true;
+}
+
+void ScoreWriter::addVoice(const ScoreVoice &voice) {
+    uint8_t payload[kRecordBytes];
+    encodeVoice(voice, payload);
+    writeRecord(voice.type, payload, sizeof(payload));
+    voicesWritten++;
+    if (file && voice.engineFrame >= flushedFrame + kFlushSeconds * sampleRate) {
+        if (std::fflush(file) != 0) failed = true;
+        flushedFrame = voice.engineFrame;
+    }
+}
+
+void ScoreWriter::addSettings(const ScoreSettings &settings) {
+    uint8_t payload[kRecordBytes];
+    encodeSettings(settings, payload);
+    writeRecord(ScoreRecordType::Settings, payload, sizeof(payload));
+}
+
+bool ScoreWriter::close(uint64_t endFrame) {
+    if (!file) return !failed;
+    uint8_t payload[8];
+    putU64(payload, endFrame);
+    writeRecord(ScoreRecordType::End, payload, sizeof(payload));
+    if (std::fclose(file) != 0) failed = true;
+    file = nullptr;
+    return !failed;
+}
+
+bool loadScore(const std::string &path, Score &score, std::string &error) {
+    score = Score();
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0, fileCount = 0;
+    bool ok = std::fread(magic, 1, 4, file) == 4 && std::memcmp(magic, kScoreMagic, 4) == 0 &&
+              readU32(file, version) && readU32(file, score.sampleRate) && readU32(file, score.channels) &&
+              readU32(file, fileCount);
+    if (!ok || version != kScoreVersion) {
+        std::fclose(file);
+        error = path + " is not a walkk score (or from another version)";
+        return false;
+    }
+
+    for (uint32_t i = 0; i < fileCount && ok; ++i) {
+        ScoreFile f;
+        uint32_t pathBytes = 0;
+        ok = readU32(file, f.sampleRate) && readU32(file, f.channels) &&
+             readU64(file, f.totalFrames) && readU32(file, pathBytes) &&
+             pathBytes < 65536;
+        if (ok) {
+            f.path.resize(pathBytes);
+            ok = std::fread(f.path.data(), 1, pathBytes, file) == pathBytes;
+        }
+        score.files.push_back(std::move(f));
+    }
+    if (!ok) {
+        std::fclose(file);
+        error = path + ": truncated file table";
+        return false;
+    }
+
+    // Records until End; a missing End (crash, still being written) keeps what is complete
+    uint8_t tag;
+    uint8_t payload[kRecordBytes];
+    std::string bad;
+    while (bad.empty() && std::fread(&tag, 1, 1, file) == 1) {
+        const ScoreRecordType type = (ScoreRecordType)tag;
+        if (type == ScoreRecordType::Grain || type == ScoreRecordType::Noise) {
+            if (std::fread(payload, 1, kRecordBytes, file) != kRecordBytes) break;
+            ScoreVoice voice = decodeVoice(payload);
+            voice.type = type;
+            bad = checkVoice(voice, score.files);
+            score.voices.push_back(voice);
+        } else if (type == ScoreRecordType::Settings) {
+            if (std::fread(payload, 1, kRecordBytes, file) != kRecordBytes) break;
+            const ScoreSettings settings = decodeSettings(payload);
+            if (settings.noiseColor >= kNoiseColorCount || settings.envelopeShape >= kEnvelopeShapeCount) {
+                bad = "settings with an unknown noise color or envelope shape";
+            }
+            score.settings.push_back(settings);
+        } else if (type == ScoreRecordType::End) {
+            score.complete = readU64(file, score.endFrame);
+            break;
+        } else {
+            break; // corrupt from here on
+        }
+    }
+    std::fclose(file);
+    if (!bad.empty()) {
+        error = path + ": record " + std::to_string(score.voices.size() + score.settings.size()) + ": " + bad;
+        score = Score();
+        return false;
+    }
+
+    if (!score.complete) {
+        for (const ScoreVoice &v : score.voices) {
+            score.endFrame = std::max(score.endFrame, v.engineFrame + v.lengthFrames);
+        }
+    }
+    return true;
+}
@@ -5,6 +5,7 @@
 #include <thread>
 #include <filesystem>
 #include <algorithm>
+#include <chrono>
 
 #ifdef _WIN32
     #define WIN32_LEAN_AND_MEAN
@@ -30,7 +31,9 @@
 #endif
 
 #include "tinyfiledialogs.h"
+#include "output_backend.h"
 #include "walkk.h"
+#include "trace.h"
 
 #ifdef PLATFORM_WINDOWS
 // Forward declare message handler from imgui_impl_win32.cpp
@@ -211,15 +214,34 @@ int main(int argc, char** argv) {
 
     const int kSinkRate = 48000;
     const int kSinkChannels = 2;
-    const size_t sinkCapacity = (size_t)kSinkRate * (size_t)kSinkChannels * 2;
+    const float kSinkMaxMs = 2000.0f; // hard capacity; the adaptive depth stays below it
+    const size_t sinkCapacity = (size_t)(kSinkMaxMs / 1000.0f * kSinkRate) * (size_t)kSinkChannels;
     Walkk walkk(sinkCapacity);
 
     bool recursive = false;
     bool loaded = false;
     std::string directoryPath;
 
+    // PortAudio stays initialized for the whole session; play/stop only open/close streams
+    AudioSystemSession audioSession;
+    std::vector<AudioDeviceInfo> outputDevices = listOutputDevices();
+    int selectedDevice = -1;  // index into outputDevices, -1 = system default
+    int bufferFrames = 256;   // 0 = let the host pick
+    float latencyMs = 0.0f;   // 0 = device default low latency
+    float sinkMinMs = 20.0f;  // adaptive sink depth bounds
+    float sinkMaxMs = kSinkMaxMs;
+
+    // Real-time scheduling (applied when playback starts)
+    int rtPolicy = 0;         // index into RtPolicy
+    int rtPriority = ThreadTuning::kDefaultRtPriority;
+    int producerCpu = -1;
+    int outputCpu = -1;
+    bool prefaultStacks = false;
+    bool lockMemory = false;
+    std::string memoryLockStatus;
+
     CallbackData callbackData{ &walkk.sink, kSinkChannels, &walkk };
-    PaStream* stream = nullptr;
+    std::unique_ptr<OutputBackend> output;
     std::thread producer;
     std::thread loader;
     bool playing = false;
@@ -286,9 +308,121 @@ int main(int argc, char** argv) {
             }
         }
 
+        if (!playing) {
+            const char* devicePreview = selectedDevice < 0 ? "Default" : outputDevices[selectedDevice].name.c_str();
+            if (ImGui::BeginCombo("Output Device", devicePreview)) {
+                if (ImGui::Selectable("Default", selectedDevice < 0)) selectedDevice = -1;
+                for (int i = 0; i < (int)outputDevices.size(); ++i) {
+                    std::string label = outputDevices[i].name + " [" + outputDevices[i].hostApi + "]##" + std::to_string(i);
+                    if (ImGui::Selectable(label.c_str(), selectedDevice == i)) selectedDevice = i;
+                }
+                ImGui::EndCombo();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Refresh")) {
+                outputDevices = listOutputDevices();
+                selectedDevice = -1;
+            }
+            ImGui::InputInt("Buffer (frames, 0 = host)", &bufferFrames, 32, 256);
+            bufferFrames = std::clamp(bufferFrames, 0, 4096);
+            ImGui::SliderFloat("Latency (ms, 0 = device low)", &latencyMs, 0.0f, 100.0f, "%.1f");
+
+            if (ImGui::CollapsingHeader("Real-time")) {
+                const char *policyNames[] = { "Normal", "SCHED_FIFO", "SCHED_RR" };
+                ImGui::Combo("Scheduling", &rtPolicy, policyNames, IM_ARRAYSIZE(policyNames));
+                ImGui::BeginDisabled(rtPolicy == 0);
+                ImGui::SliderInt("Priority", &rtPriority, 1, 99);
+                ImGui::EndDisabled();
+                ImGui::InputInt("Producer CPU (-1 = any)", &producerCpu);
+                ImGui::InputInt("Output CPU (-1 = any)", &outputCpu);
+                producerCpu = std::max(producerCpu, -1);
+                outputCpu = std::max(outputCpu, -1);
+                ImGui::Checkbox("Prefault thread stacks", &prefaultStacks);
+                // mlockall cannot be undone piecemeal, so it is a one-way switch per session
+                ImGui::BeginDisabled(lockMemory);
+                if (ImGui::Checkbox("Lock memory (mlockall)", &lockMemory) && lockMemory) {
+                    std::string error;
+                    if (lockProcessMemory(error)) {
+                        memoryLockStatus = "Memory locked";
+                    } else {
+                        memoryLockStatus = "Could not lock memory: " + error;
+                        lockMemory = false;
+                    }
+                    walkk.addLog(memoryLockStatus);
+                }
+                ImGui::EndDisabled();
+                if (!memoryLockStatus.empty()) {
+                    ImGui::TextWrapped("%s", memoryLockStatus.c_str());
+                }
+            }
+        } else if (output) {
+            ImGui::Text("Output: %s  %lu frames/buffer  %.1f ms latency",
+                output->name(), output->bufferFrames(), output->outputLatency() * 1000.0);
+
+            // Producer wakeup rate and idle share, refreshed once a second
+            static auto statsTime = std::chrono::steady_clock::now();
+            static uint64_t statsWakeups = 0, statsIdleNs = 0;
+            static double wakeupsPerSec = 0.0, idlePercent = 0.0;
+            auto now = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double>(now - statsTime).count();
+            if (elapsed >= 1.0) {
+                uint64_t wakeups = walkk.sink.producerWakeups.load();
+                uint64_t idleNs = walkk.sink.producerIdleNs.load();
+                wakeupsPerSec = (double)(wakeups - statsWakeups) / elapsed;
+                idlePercent = std::min(100.0, (double)(idleNs - statsIdleNs) * 1e-9 / elapsed * 100.0);
+                statsWakeups = wakeups;
+                statsIdleNs = idleNs;
+                statsTime = now;
+            }
+            ImGui::Text("Producer: %.0f wakeups/s  %.0f%% idle", wakeupsPerSec, idlePercent);
+
+            const SinkDepthController &depth = walkk.sinkDepth;
+            ImGui::Text("Sink: %.1f ms queued, target %.1f ms  (p99 lateness %.2f ms, decode %.2f ms)",
+                walkk.sink.getQueuedSamples() * 1000.0 / (kSinkRate * kSinkChannels),
+                depth.targetFrames.load() * 1000.0 / kSinkRate,
+                depth.latenessP99.load() * 1000.0, depth.decodeP99.load() * 1000.0);
+            ImGui::Text("Depth adjustments: %llu  (last %.1f -> %.1f ms)",
+                (unsigned long long)depth.adjustments.load(),
+                depth.lastAdjustFrom.load() * 1000.0, depth.lastAdjustTo.load() * 1000.0);
+        }
+
+        if (playing && ImGui::CollapsingHeader("Health")) {
+            AudioHealthStats hs = walkk.health.stats();
+            ImGui::Text("Buffers: %llu   xruns: %llu (underflow %llu, overflow %llu)   priming: %llu",
+                (unsigned long long)hs.callbacks, (unsigned long long)hs.xruns,
+                (unsigned long long)hs.underflows, (unsigned long long)hs.overflows,
+                (unsigned long long)hs.primingBuffers);
+            ImGui::Text("Sink shortfalls: %llu partial, %llu empty   over budget: %llu",
+                (unsigned long long)hs.partialBuffers, (unsigned long long)hs.emptyBuffers,
+                (unsigned long long)hs.overBudget);
+            ImGui::Text("Callback time p50 %.3f  p99 %.3f  p99.9 %.3f  max %.3f ms",
+                hs.callbackP50 * 1000.0, hs.callbackP99 * 1000.0, hs.callbackP999 * 1000.0, hs.callbackMax * 1000.0);
+            ImGui::Text("Callback interval p50 %.2f  p99 %.2f  max %.2f ms",
+                hs.intervalP50 * 1000.0, hs.intervalP99 * 1000.0, hs.intervalMax * 1000.0);
+        }
+
+        // Adaptive sink bounds apply live
+        if (ImGui::DragFloatRange2("Sink depth (ms)", &sinkMinMs, &sinkMaxMs, 1.0f, 0.0f, kSinkMaxMs, "min %.0f", "max %.0f")) {
+            walkk.sinkDepth.minLatency.store(sinkMinMs / 1000.0);
+            walkk.sinkDepth.maxLatency.store(sinkMaxMs / 1000.0);
+        }
+
         // Recording variables
         static char recordingPathBuf[1024] = {0};
         static std::string recordingPath = "output.wav";
+        struct RecordFormat {
+            const char* label;
+            RecordingCodec codec;
+            WavSampleFormat format;
+        };
+        static const RecordFormat kRecordFormats[] = {
+            {"WAV 16-bit", RecordingCodec::Wav, WavSampleFormat::Int16},
+            {"WAV 24-bit", RecordingCodec::Wav, WavSampleFormat::Int24},
+            {"WAV 32-bit float", RecordingCodec::Wav, WavSampleFormat::Float32},
+            {"FLAC 16-bit", RecordingCodec::Flac, WavSampleFormat::Int16},
+            {"FLAC 24-bit", RecordingCodec::Flac, WavSampleFormat::Int24},
+        };
+        static int recordFormat = 0; // index into kRecordFormats
 
         if (!playing) {
             if (!loading) {
@@ -298,6 +432,7 @@ int main(int argc, char** argv) {
                     loading = true;
                     loadResult = -1;
                     loader = std::thread([&walkk, &loading, &loadResult, directoryPath, recursive]() {
+                        traceRegisterThread("loader");
                         int res = 1;
                         if (!directoryPath.empty()) {
                             res = loadDirectoryMp3s(directoryPath.c_str(), walkk, recursive);
@@ -314,10 +449,11 @@ int main(int argc, char** argv) {
         } else {
             if (ImGui::Button("Stop")) {
                 walkk.allFinished.store(true);
+                walkk.sink.wakeProducer();
                 if (producer.joinable()) producer.join();
-                if (stream) {
-                    stopAndCloseStream(stream);
-                    stream = nullptr;
+                if (output) {
+                    output->stop();
+                    output.reset();
                 }
                 playing = false;
             }
@@ -337,8 +473,33 @@ int main(int argc, char** argv) {
         }
 
         if (!playing && !loading && loadResult == 0 && !walkk.files.empty()) {
-            int err = openAndStartStream(&stream, &callbackData, kSinkChannels, kSinkRate, 256);
-            if (err == paNoError) {
+            walkk.resetPlayback();
+            OutputConfig outputConfig;
+#ifndef WALKK_HAVE_PORTAUDIO
+            // Headless build: keep the engine running against a clocked null output
+            outputConfig.type = OutputBackendType::Null;
+#endif
+            outputConfig.channels = kSinkChannels;
+            outputConfig.sampleRate = kSinkRate;
+            outputConfig.framesPerBuffer = (unsigned long)bufferFrames;
+            outputConfig.device.deviceIndex = selectedDevice >= 0 ? outputDevices[selectedDevice].index : -1;
+            outputConfig.device.suggestedLatency = latencyMs / 1000.0;
+
+            ThreadTuning tuning;
+            tuning.policy = (RtPolicy)rtPolicy;
+            tuning.priority = rtPriority;
+            tuning.prefaultStack = prefaultStacks;
+            walkk.producerTuning = tuning;
+            walkk.producerTuning.cpu = producerCpu;
+            outputConfig.thread = tuning;
+            outputConfig.thread.cpu = outputCpu;
+
+            output = createOutputBackend(outputConfig, &callbackData);
+            int err = output ? output->start() : -1;
+            if (err != 0) {
+                output.reset();
+            } else {
+                walkk.engineBlockFrames.store(output->bufferFrames());
                 playing = true;
                 walkk.allFinished.store(false);
                 if (producer.joinable()) producer.join();
@@ -347,55 +508,91 @@ int main(int argc, char** argv) {
             loadResult = -1;
         }
 
-        {
-            std::lock_guard<std::mutex> g(walkk.lastGrainMutex);
-            if (!walkk.files.empty()) {
-                if (walkk.lastGrain.hasExpectedStart) {
-                    auto now = std::chrono::steady_clock::now();
-                    if (now >= walkk.lastGrain.expectedStartTime && !walkk.lastGrain.hasStarted) {
-                        walkk.lastGrain.hasStarted = true;
-                        walkk.currentGrain = walkk.lastGrain;
+        if (!walkk.files.empty() && !loading) {
+            // Lock-free copy of the recently scheduled voices; names are looked up here
+            static VoiceInfo voices[VoiceTelemetry::kSlots];
+            size_t voiceCount = walkk.voiceTelemetry.snapshot(voices, VoiceTelemetry::kSlots);
+            std::sort(voices, voices + voiceCount,
+                      [](const VoiceInfo &a, const VoiceInfo &b) { return a.serial < b.serial; });
+            const uint64_t playFrame = walkk.clock.playbackFrame();
+            auto voiceName = [&](const VoiceInfo &v) -> std::string {
+                if (v.type == (uint8_t)MixerVoice::Type::Noise) {
+                    return std::string(noiseColorName((NoiseColor)v.noiseColor)) + " noise";
+                }
+                if (v.fileIndex >= walkk.files.size()) return "?";
+                const auto &sf = walkk.files[v.fileIndex];
+                return sf.relPath.empty() ? sf.path : sf.relPath;
+            };
+
+            const VoiceInfo *next = nullptr;
+            std::string now;
+            for (size_t i = 0; i < voiceCount; ++i) {
+                const VoiceInfo &v = voices[i];
+                if (v.engineStartFrame <= playFrame && playFrame < v.engineEndFrame) {
+                    if (!now.empty()) now += ", ";
+                    now += voiceName(v);
+                } else if (v.engineStartFrame > playFrame && (!next || v.engineStartFrame < next->engineStartFrame)) {
+                    next = &v;
+                }
+            }
+            ImGui::Text("Now: %s", now.c_str());
+            if (next) {
+                long long msLeft = (long long)((next->engineStartFrame - playFrame) * 1000 / Walkk::kSampleRate);
+                ImGui::Text("Next: %s in %lld ms", voiceName(*next).c_str(), msLeft);
+            }
+
+            // Everything still audible or queued
+            if (ImGui::BeginTable("voices", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY,
+                                  ImVec2(0, 160))) {
+                ImGui::TableSetupScrollFreeze(0, 1);
+                ImGui::TableSetupColumn("Source");
+                ImGui::TableSetupColumn("In");
+                ImGui::TableSetupColumn("File pos");
+                ImGui::TableSetupColumn("Dur");
+                ImGui::TableSetupColumn("Amp");
+                ImGui::TableSetupColumn("Loop / rev");
+                ImGui::TableSetupColumn("Progress");
+                ImGui::TableHeadersRow();
+                for (size_t i = 0; i < voiceCount; ++i) {
+                    const VoiceInfo &v = voices[i];
+                    if (v.engineEndFrame <= playFrame) continue;
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(voiceName(v).c_str());
+                    ImGui::TableNextColumn();
+                    if (v.engineStartFrame > playFrame) {
+                        ImGui::Text("%lld ms", (long long)((v.engineStartFrame - playFrame) * 1000 / Walkk::kSampleRate));
+                    } else {
+                        ImGui::TextUnformatted("now");
                     }
-                    if (!walkk.currentGrain.relPath.empty() && walkk.currentGrain.hasExpectedStart) {
-                        if (now >= walkk.currentGrain.expectedEndTime) {
-                            walkk.currentGrain = Walkk::GrainDebugInfo{};
+                    ImGui::TableNextColumn();
+                    if (v.type == (uint8_t)MixerVoice::Type::Grain) ImGui::Text("%llu", (unsigned long long)v.fileStartFrame);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%u ms", (unsigned)((uint64_t)v.durationFrames * 1000 / Walkk::kSampleRate));
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", v.amplitude);
+                    ImGui::TableNextColumn();
+                    if (v.type == (uint8_t)MixerVoice::Type::Grain) {
+                        if (v.loopEnabled) {
+                            ImGui::Text("win=%u drag=%d%s", v.loopWindowFrames, v.loopDragFrames, v.reversePlayback ? " rev" : "");
+                        } else {
+                            ImGui::TextUnformatted(v.reversePlayback ? "rev" : "-");
                         }
                     }
-                }
-                std::string displayName = walkk.lastGrain.relPath;
-                if (displayName.empty()) {
-                    size_t idx = walkk.lastGrain.fileIndex;
-                    if (idx < walkk.files.size()) {
-                        const auto &sf = walkk.files[idx];
-                        displayName = sf.relPath.empty() ? sf.path : sf.relPath;
+                    ImGui::TableNextColumn();
+                    float progress = 0.0f;
+                    if (playFrame > v.engineStartFrame && v.engineEndFrame > v.engineStartFrame) {
+                        progress = (float)(playFrame - v.engineStartFrame) / (float)(v.engineEndFrame - v.engineStartFrame);
                     }
+                    ImGui::ProgressBar(progress, ImVec2(-1, 0), "");
                 }
-                // if (!walkk.currentGrain.relPath.empty()) {
-                ImGui::Text("Now: %s", walkk.currentGrain.relPath.c_str());
-                // }
-                // if (!displayName.empty()) {
-                    auto now = std::chrono::steady_clock::now();
-                    if (walkk.lastGrain.hasExpectedStart && now < walkk.lastGrain.expectedStartTime) {
-                        auto msLeft = std::chrono::duration_cast<std::chrono::milliseconds>(
-                            walkk.lastGrain.expectedStartTime - now).count();
-                        if (msLeft < 0) msLeft = 0;
-                        ImGui::Text("Next: %s in %lld ms", displayName.c_str(), (long long)msLeft);
-                    } else if (!walkk.lastGrain.hasStarted) {
-                        ImGui::Text("Next: %s", displayName.c_str());
-                    }
-                // }
-                ImGui::Text("Grain: start=%zu frames  dur=%zu frames  amp=%.2f",
-                    walkk.lastGrain.startFrame,
-                    walkk.lastGrain.durationFrames,
-                    walkk.lastGrain.amplitude);
-                ImGui::Text("Loop: %s  win=%zu fr  drag=%d fr  reverse=%s",
-                    walkk.lastGrain.loopEnabled ? "on" : "off",
-                    walkk.lastGrain.loopWindowFrames,
-                    walkk.lastGrain.loopDragFrames,
-                    walkk.lastGrain.reversePlayback ? "on" : "off");
+                ImGui::EndTable();
             }
         }
 
+        // Format whatever the engine recorded since the last frame
+        walkk.pumpEvents();
+
         ImGui::Separator();
         ImGui::Text("History");
         ImGui::BeginChild("log", ImVec2(0, 200), true, ImGuiWindowFlags_HorizontalScrollbar);
@@ -424,6 +621,10 @@ int main(int argc, char** argv) {
             float bouncebackProb = walkk.settings.bouncebackProbability;
             int whiteNoise = (int)walkk.settings.whiteNoiseMs;
             float whiteNoiseVol = walkk.settings.whiteNoiseAmplitude;
+            int noiseColor = (int)walkk.settings.noiseColor;
+            int envShape = (int)walkk.settings.envelopeShape;
+            int envAttack = (int)walkk.settings.envelopeAttackMs;
+            int envRelease = (int)walkk.settings.envelopeReleaseMs;
 
             if (ImGui::SliderInt("Min Grain (ms)", &minGrain, 5, 5000)) {
                 walkk.settings.minGrainMs = (size_t)std::max(1, minGrain);
@@ -462,13 +663,39 @@ int main(int argc, char** argv) {
             ImGui::SliderInt("Max Loop Drag (±ms)", &maxDrag, 0, 500);
             walkk.settings.maxLoopDragMs = std::max(0, maxDrag);
 
-            ImGui::SliderInt("White Noise Duration (ms)", &whiteNoise, 0, 5000);
+            ImGui::SliderInt("Noise Duration (ms)", &whiteNoise, 0, 5000);
             if (whiteNoise < 0) whiteNoise = 0; if (whiteNoise > 5000) whiteNoise = 5000;
             walkk.settings.whiteNoiseMs = (size_t)whiteNoise;
 
-            ImGui::SliderFloat("White Noise Volume", &whiteNoiseVol, 0.0f, 1.0f);
+            ImGui::SliderFloat("Noise Volume", &whiteNoiseVol, 0.0f, 1.0f);
             if (whiteNoiseVol < 0.0f) whiteNoiseVol = 0.0f; if (whiteNoiseVol > 1.0f) whiteNoiseVol = 1.0f;
             walkk.settings.whiteNoiseAmplitude = whiteNoiseVol;
+
+            static const char* kNoiseColorNames[kNoiseColorCount] = {
+                noiseColorName(NoiseColor::White),
+                noiseColorName(NoiseColor::Pink),
+                noiseColorName(NoiseColor::Brown),
+            };
+            if (ImGui::Combo("Noise Color", &noiseColor, kNoiseColorNames, kNoiseColorCount)) {
+                walkk.settings.noiseColor = (NoiseColor)noiseColor;
+            }
+
+            static const char* kEnvelopeNames[kEnvelopeShapeCount] = {
+                envelopeShapeName(EnvelopeShape::Hann),
+                envelopeShapeName(EnvelopeShape::Tukey),
+                envelopeShapeName(EnvelopeShape::Trapezoid),
+                envelopeShapeName(EnvelopeShape::Exponential),
+            };
+            if (ImGui::Combo("Envelope", &envShape, kEnvelopeNames, kEnvelopeShapeCount)) {
+                walkk.settings.envelopeShape = (EnvelopeShape)envShape;
+            }
+            const bool envSpansGrain = walkk.settings.envelopeShape == EnvelopeShape::Hann;
+            if (envSpansGrain) ImGui::BeginDisabled();
+            ImGui::SliderInt("Envelope Attack (ms)", &envAttack, 0, 500);
+            walkk.settings.envelopeAttackMs = (size_t)std::max(0, envAttack);
+            ImGui::SliderInt("Envelope Release (ms)", &envRelease, 0, 500);
+            walkk.settings.envelopeReleaseMs = (size_t)std::max(0, envRelease);
+            if (envSpansGrain) ImGui::EndDisabled();
         }
 
         ImGui::PopStyleVar(3);
@@ -479,18 +706,22 @@ int main(int argc, char** argv) {
 
         if (recordingPath.size() >= sizeof(recordingPathBuf)) recordingPath.resize(sizeof(recordingPathBuf)-1);
         std::snprintf(recordingPathBuf, sizeof(recordingPathBuf), "%s", recordingPath.c_str());
-        if (ImGui::InputText("Output WAV File", recordingPathBuf, sizeof(recordingPathBuf))) {
+        if (ImGui::InputText("Output File", recordingPathBuf, sizeof(recordingPathBuf))) {
             recordingPath = recordingPathBuf;
         }
         ImGui::SameLine();
-        if (ImGui::Button("Browse WAV...")) {
-            static const char* filters[] = {"*.wav"};
-            const char* selectedFile = tinyfd_saveFileDialog("Save WAV File", recordingPath.c_str(), 1, filters, "WAV Files");
+        if (ImGui::Button("Browse...")) {
+            const bool flac = kRecordFormats[recordFormat].codec == RecordingCodec::Flac;
+            const char* extension = flac ? ".flac" : ".wav";
+            static const char* wavFilters[] = {"*.wav"};
+            static const char* flacFilters[] = {"*.flac"};
+            const char* selectedFile = tinyfd_saveFileDialog(flac ? "Save FLAC File" : "Save WAV File", recordingPath.c_str(), 1,
+                                                             flac ? flacFilters : wavFilters, flac ? "FLAC Files" : "WAV Files");
             if (selectedFile) {
                 recordingPath = selectedFile;
-                // Ensure .wav extension
-                if (recordingPath.size() < 4 || recordingPath.substr(recordingPath.size() - 4) != ".wav") {
-                    recordingPath += ".wav";
+                // Ensure the extension matches the format
+                if (std::filesystem::path(recordingPath).extension() != extension) {
+                    recordingPath += extension;
                 }
             }
         }
@@ -502,10 +733,25 @@ int main(int argc, char** argv) {
         } else {
             if (!walkk.isRecording.load()) {
                 if (ImGui::Button("Start Recording")) {
-                    if (walkk.startRecording(recordingPath)) {
+                    const RecordFormat& f = kRecordFormats[recordFormat];
+                    if (walkk.startRecording(recordingPath, f.format, f.codec)) {
                         // Success - status will be shown below
                     }
                 }
+                ImGui::SameLine();
+                ImGui::SetNextItemWidth(160.0f);
+                if (ImGui::BeginCombo("Format", kRecordFormats[recordFormat].label)) {
+                    for (int i = 0; i < (int)(sizeof(kRecordFormats) / sizeof(kRecordFormats[0])); i++) {
+                        if (ImGui::Selectable(kRecordFormats[i].label, i == recordFormat)) {
+                            recordFormat = i;
+                            // Keep the extension in step with the container
+                            std::filesystem::path path(recordingPath);
+                            path.replace_extension(kRecordFormats[i].codec == RecordingCodec::Flac ? ".flac" : ".wav");
+                            recordingPath = path.string();
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
             } else {
                 if (ImGui::Button("Stop Recording")) {
                     walkk.stopRecording();
@@ -515,13 +761,98 @@ int main(int argc, char** argv) {
 
         if (walkk.isRecording.load()) {
             double duration = walkk.getRecordingDurationSeconds();
-            size_t fileSize = walkk.recordingDataSize;
-            ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "● RECORDING to %s | Duration: %.1fs | Size: %.1f KB",
-                recordingPath.c_str(), duration, fileSize / 1024.0);
+            uint64_t fileSize = walkk.recorder.bytesWritten.load();
+            ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "● RECORDING to %s | Duration: %.1fs | Size: %.1f MB",
+                recordingPath.c_str(), duration, fileSize / (1024.0 * 1024.0));
         } else if (!recordingPath.empty()) {
             ImGui::Text("Ready to record to: %s", recordingPath.c_str());
         }
 
+        // Retroactive capture: the last minutes of output stay in memory until saved
+        ImGui::Separator();
+        ImGui::Text("Retro Capture");
+        static bool retroEnabled = false;
+        static int retroMegabytes = 128;
+        static float retroSaveMinutes = 5.0f;
+        static std::string retroStatus;
+        static uint64_t retroReported = 0;
+        const bool retroSaving = walkk.retro.isSaving();
+
+        ImGui::BeginDisabled(retroSaving);
+        bool retroApply = ImGui::Checkbox("Keep last minutes in memory", &retroEnabled);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(160.0f);
+        ImGui::SliderInt("Memory budget (MB)", &retroMegabytes, 16, 2048);
+        // Resizing clears the buffer: only on release, not while dragging
+        retroApply |= retroEnabled && ImGui::IsItemDeactivatedAfterEdit();
+        ImGui::EndDisabled();
+        if (retroApply) {
+            walkk.retro.configure(retroEnabled ? retroMegabytes : 0.0, kSinkRate, kSinkChannels);
+        }
+
+        if (walkk.retro.isEnabled()) {
+            ImGui::Text("Holds %.1f min, %.1f min buffered", walkk.retro.capacitySeconds() / 60.0,
+                        walkk.retro.bufferedSeconds() / 60.0);
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::InputFloat("minutes", &retroSaveMinutes, 1.0f, 5.0f, "%.1f");
+            retroSaveMinutes = std::max(retroSaveMinutes, 0.1f);
+            ImGui::SameLine();
+            char retroLabel[64];
+            std::snprintf(retroLabel, sizeof(retroLabel), "Save Last %.1f min###retroSave", retroSaveMinutes);
+            ImGui::BeginDisabled(retroSaving);
+            if (ImGui::Button(retroLabel)) {
+                // Next to the recording file
+                std::string path = RetroCapture::timestampedPath(std::filesystem::path(recordingPath).parent_path().string());
+                std::string error;
+                retroStatus = walkk.retro.save(path, retroSaveMinutes * 60.0, error) ? "Saving " + path + "..."
+                                                                                     : "Retro save failed: " + error;
+            }
+            ImGui::EndDisabled();
+        }
+
+        RetroCapture::SaveResult retroResult = walkk.retro.lastSave();
+        if (!retroSaving && retroResult.number != retroReported) {
+            retroReported = retroResult.number;
+            char line[1200];
+            if (retroResult.ok) {
+                std::snprintf(line, sizeof(line), "Saved %.1f s to %s", retroResult.seconds, retroResult.path.c_str());
+            } else {
+                std::snprintf(line, sizeof(line), "Retro save to %s failed: %s", retroResult.path.c_str(),
+                              retroResult.error.c_str());
+            }
+            retroStatus = line;
+            walkk.addLog(retroStatus);
+        }
+        if (!retroStatus.empty()) {
+            ImGui::TextUnformatted(retroStatus.c_str());
+        }
+
+        // Trace zones for diagnosing production stalls after the fact
+        ImGui::Separator();
+        static bool tracing = false;
+        static float traceSeconds = 30.0f;
+        static std::string traceStatus;
+        if (ImGui::Checkbox("Trace", &tracing)) {
+            traceSetEnabled(tracing);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120.0f);
+        ImGui::SliderFloat("seconds", &traceSeconds, 1.0f, 120.0f, "%.0f");
+        ImGui::SameLine();
+        if (ImGui::Button("Save Trace...")) {
+            static const char* filters[] = {"*.json"};
+            const char* selectedFile = tinyfd_saveFileDialog("Save Chrome Trace", "walkk_trace.json", 1, filters, "Trace JSON");
+            if (selectedFile) {
+                traceStatus = traceWriteChromeJson(selectedFile, traceSeconds)
+                    ? std::string("Trace saved to ") + selectedFile
+                    : std::string("Could not save trace (tracing compiled out or file not writable)");
+                walkk.addLog(traceStatus);
+            }
+        }
+        if (!traceStatus.empty()) {
+            ImGui::TextUnformatted(traceStatus.c_str());
+        }
+
         ImGui::End();
         ImGui::Render();
 
@@ -544,9 +875,10 @@ int main(int argc, char** argv) {
     }
 
     walkk.allFinished.store(true);
+    walkk.sink.wakeProducer();
     if (producer.joinable()) producer.join();
     if (loader.joinable()) loader.join();
-    if (stream) stopAndCloseStream(stream);
+    if (output) output->stop();
 
 #ifdef PLATFORM_WINDOWS
     ImGui_ImplDX11_Shutdown();
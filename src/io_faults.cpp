@@ -0,0 +1,67 @@
+#include <chrono>
+#include <thread>
+
+#include "io_faults.h"
+
+static size_t faultyRead(void *buf, size_t size, void *userData) {
+    FaultyFile *f = (FaultyFile *)userData;
+    if (!f->injector->inject(size)) return (size_t)-1; // minimp3's read error
+    size_t n = std::fread(buf, 1, size, f->file);
+    f->injector->bytesRead.fetch_add(n, std::memory_order_relaxed);
+    return n;
+}
+
+static int faultySeek(uint64_t position, void *userData) {
+    FaultyFile *f = (FaultyFile *)userData;
+    if (!f->injector->inject(0)) return -1;
+#ifdef _WIN32
+    return _fseeki64(f->file, (int64_t)position, SEEK_SET);
+#else
+    return fseeko(f->file, (off_t)position, SEEK_SET);
+#endif
+}
+
+bool IoFaultInjector::inject(size_t bytes) {
+    double delayMs = config.readLatencyMs;
+    if (config.bandwidthMBps > 0.0) {
+        delayMs += (double)bytes / (config.bandwidthMBps * 1e6) * 1000.0;
+    }
+
+    bool stall, fail;
+    {
+        std::lock_guard<std::mutex> lock(rngMutex);
+        std::uniform_real_distribution<double> chance(0.0, 1.0);
+        stall = config.stallMs > 0.0 && chance(rng) < config.stallProbability;
+        fail = bytes > 0 && chance(rng) < config.errorProbability;
+    }
+    if (stall) {
+        delayMs += config.stallMs;
+        stalls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (bytes > 0) reads.fetch_add(1, std::memory_order_relaxed);
+    if (delayMs > 0.0) {
+        delayNs.fetch_add((uint64_t)(delayMs * 1e6), std::memory_order_relaxed);
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(delayMs));
+    }
+    if (fail) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+int IoFaultInjector::open(mp3dec_ex_t *dec, const std::string &path, int flags, std::unique_ptr<FaultyFile> &holder) {
+    auto f = std::make_unique<FaultyFile>();
+    f->file = std::fopen(path.c_str(), "rb");
+    if (!f->file) return MP3D_E_IOERROR;
+    f->injector = this;
+    f->io.read = faultyRead;
+    f->io.read_data = f.get();
+    f->io.seek = faultySeek;
+    f->io.seek_data = f.get();
+
+    int result = mp3dec_ex_open_cb(dec, &f->io, flags);
+    if (result == 0) holder = std::move(f);
+    return result;
+}
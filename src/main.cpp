@@ -1,78 +1,671 @@
 #include <iostream>
 #include <vector>
 #include <thread>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <string>
+#include <cstdio>
 #include "pa_sink.h"
+#include "output_backend.h"
 #include "walkk.h"
+#include "trace.h"
+#include "metrics.h"
+#include "offline_render.h"
+#include "rt_check.h"
 
-// PortAudio plumbing moved to pa_sink.{h,cpp}
+static volatile std::sig_atomic_t g_interrupted = 0;
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " [--recursive|-r] <directory_with_mp3s>" << std::endl;
-        return 1;
+static void onInterrupt(int) {
+    g_interrupted = 1;
+}
+
+static volatile std::sig_atomic_t g_retroSaveRequested = 0;
+
+static void onRetroSave(int) {
+    g_retroSaveRequested = 1;
+}
+
+static void printUsage(const char *argv0) {
+    std::cerr << "Usage: " << argv0 << " [options] <directory_with_mp3s>\n"
+              << "  -r, --recursive          scan subdirectories\n"
+              << "  --output <type>          portaudio (default), null, wav, flac or pipe\n"
+              << "  --output-path <path>     wav/flac: file to write; pipe: FIFO/file, '-' for stdout (default)\n"
+              << "  --pipe-format <f32|s16>  raw sample format for the pipe output (default f32)\n"
+              << "  --wav-format <s16|s24|f32> sample format for the wav output (default s16; RF64 past 4 GB),\n"
+              << "                           s16 or s24 for flac\n"
+              << "  --dither <mode>          none, tpdf (default) or shaped, for s16/s24 wav, flac, pipe, archive, retro\n"
+              << "  --realtime               pace null/wav/flac/pipe output at the sample rate (default for null)\n"
+              << "  --free-run               pull null/wav/flac/pipe output as fast as possible (default for files/pipe)\n"
+              << "  --duration <seconds>     stop after this much wall-clock time\n"
+              << "  --list-devices           print output devices and exit\n"
+              << "  --device <index|name>    PortAudio output device (index or name substring)\n"
+              << "  --host-api <name>        PortAudio host API, e.g. ALSA or JACK\n"
+              << "  --buffer-frames <n>      frames per device buffer, 0 lets the host pick (default 256)\n"
+              << "  --latency-ms <ms>        suggested output latency (default: device low latency)\n"
+              << "  --sink-min-ms <ms>       lowest depth the adaptive sink may shrink to (default 20)\n"
+              << "  --sink-max-ms <ms>       deepest the adaptive sink may grow, its hard capacity (default 2000)\n"
+              << "  --rt-policy <p>          normal (default), fifo or rr for the producer and output threads\n"
+              << "  --rt-priority <n>        real-time priority 1-99 (default 70)\n"
+              << "  --producer-cpu <n>       pin the producer (render + decode) thread to a CPU\n"
+              << "  --output-cpu <n>         pin the null/wav/flac/pipe output thread to a CPU\n"
+              << "  --mlock                  lock the process memory in RAM\n"
+              << "  --prefault-stack         touch thread stacks up front to avoid page faults later\n"
+              << "  --quiet                  do not echo the event log (grains, loads, underruns)\n"
+              << "  --log-rate <n>           echo at most n event lines per second (default 50)\n"
+              << "  --trace <file.json>      record trace zones and write them as Chrome trace JSON on exit\n"
+              << "  --trace-seconds <s>      how much trace history to write (default 30, 0 = all buffered)\n"
+              << "  --stats-interval <s>     print an output health line every s seconds (default 10, 0 = off)\n"
+              << "  --metrics-port <n>       serve Prometheus metrics at http://127.0.0.1:<n>/metrics\n"
+              << "  --metrics-bind <addr>    address the metrics port listens on (default 127.0.0.1)\n"
+              << "  --metrics-file <path>    rewrite Prometheus metrics to this file periodically\n"
+              << "  --metrics-interval <s>   how often --metrics-file is rewritten (default 10)\n"
+              << "  --archive-dir <dir>      also archive the output there as rotating WAV segments\n"
+              << "  --archive-minutes <m>    start a new segment every m minutes (default 60, 0 = no limit)\n"
+              << "  --archive-mb <n>         ... or when a segment reaches n MB (default no limit)\n"
+              << "  --archive-format <s16|s24|f32> sample format of the segments (default s16)\n"
+              << "  --archive-no-index       skip the CSV mapping segments to the grains they contain\n"
+              << "  --retro-mb <n>           keep the last n MB of output in memory as 16-bit PCM\n"
+              << "                           (64 MB holds about 5.8 min); SIGUSR1 saves it to a WAV\n"
+              << "  --retro-minutes <m>      how much a retro save writes (default all that is held)\n"
+              << "  --retro-dir <dir>        where retro saves go (default .)\n"
+              << "  --retro-save-on-exit     also save the retro buffer when the run ends\n"
+              << "  --score <file>           log every scheduled grain and settings change to a binary score\n"
+              << "  --render-score <file>    replay a score instead of choosing grains (same library directory);\n"
+              << "                           with --output wav/flac this renders it faster than real time\n"
+              << "  --render-seconds <s>     generate a new piece of this length on all cores instead of playing\n"
+              << "                           live (use with --output wav/flac/pipe)\n"
+              << "  --render-threads <n>     threads for --render-seconds (default: one per core)\n"
+              << "  --render-segment-seconds <s> timeline split for --render-seconds (default 30); the piece\n"
+              << "                           depends on it, not on the thread count\n"
+              << "  --seed <n>               seed grain and noise choices (live or --render-seconds) to repeat a run\n"
+              << "  --render-quality <q>     live (default: identical to the session) or high (sinc resampling,\n"
+              << "                           exact envelopes) for --render-score and --render-seconds\n"
+              << "  --rt-strict              exit with status 3 if the audio callback allocated, locked or\n"
+              << "                           blocked; status 1 in builds without WALKK_RT_CHECKS"
+              << std::endl;
+}
+
+static void startRetroSave(Walkk &walkk, const std::string &directory, double minutes) {
+    std::string path = RetroCapture::timestampedPath(directory);
+    std::string error;
+    if (!walkk.retro.save(path, minutes * 60.0, error)) {
+        std::cerr << "Retro save: " << error << std::endl;
+        return;
+    }
+    std::cout << "Retro save: writing " << path << std::endl;
+}
+
+static void reportRetroSave(Walkk &walkk, uint64_t &reported) {
+    if (walkk.retro.isSaving()) return;
+    RetroCapture::SaveResult r = walkk.retro.lastSave();
+    if (r.number == reported) return;
+    reported = r.number;
+    if (r.ok) std::cout << "Retro save: " << r.seconds << " s in " << r.path << std::endl;
+    else std::cerr << "Retro save: " << r.path << ": " << r.error << " (" << r.seconds << " s written)" << std::endl;
+}
+
+static void printHealth(Walkk &walkk) {
+    AudioHealthStats s = walkk.health.stats();
+    char line[320];
+    std::snprintf(line, sizeof(line),
+                  "health: buffers=%llu xruns=%llu partial=%llu empty=%llu over-budget=%llu "
+                  "cb p50/p99/max=%.3f/%.3f/%.3f ms interval p99=%.2f ms sink=%.1f/%.1f ms",
+                  (unsigned long long)s.callbacks, (unsigned long long)s.xruns,
+                  (unsigned long long)s.partialBuffers, (unsigned long long)s.emptyBuffers,
+                  (unsigned long long)s.overBudget,
+                  s.callbackP50 * 1000.0, s.callbackP99 * 1000.0, s.callbackMax * 1000.0,
+                  s.intervalP99 * 1000.0,
+                  walkk.sink.getQueuedSamples() * 1000.0 / (Walkk::kSampleRate * Walkk::kChannels),
+                  walkk.sinkDepth.targetFrames.load() * 1000.0 / Walkk::kSampleRate);
+    std::cout << line << std::endl;
+}
+
+static void printDevices() {
+    std::vector<AudioDeviceInfo> devices = listOutputDevices();
+    if (devices.empty()) {
+        std::cout << "No output devices (PortAudio missing from this build or no sound card)" << std::endl;
+        return;
+    }
+    for (const auto &d : devices) {
+        std::cout << (d.isDefault ? "* " : "  ") << d.index << ": " << d.name
+                  << " [" << d.hostApi << "] ch=" << d.maxOutputChannels
+                  << " rate=" << d.defaultSampleRate
+                  << " low=" << d.defaultLowLatency * 1000.0 << "ms"
+                  << " high=" << d.defaultHighLatency * 1000.0 << "ms" << std::endl;
     }
+}
+
+int main(int argc, char *argv[]) {
+    // PortAudio stays initialized for the whole run
+    AudioSystemSession audioSession;
 
     bool recursive = false;
     const char *directory = nullptr;
+    OutputConfig output;
+    int realtimeOverride = -1; // -1: backend default
+    double durationSeconds = 0.0;
+    double sinkMinMs = 20.0;
+    double sinkMaxMs = 2000.0;
+    ThreadTuning tuning;
+    int producerCpu = -1;
+    int outputCpu = -1;
+    bool lockMemory = false;
+    bool quiet = false;
+    size_t logRate = 50;
+    std::string tracePath;
+    double traceSeconds = 30.0;
+    double statsInterval = 10.0;
+    MetricsConfig metricsConfig;
+    bool rtStrict = false;
+    SegmentRecorderConfig archiveConfig;
+    bool archiving = false;
+    double retroMegabytes = 0.0;
+    double retroMinutes = 0.0;
+    std::string retroDirectory = ".";
+    bool retroSaveOnExit = false;
+    std::string scorePath;
+    std::string renderScorePath;
+    GrainQuality renderQuality = GrainQuality::Live;
+    OfflineRenderConfig renderConfig;
+    bool seeded = false;
+
     for (int i = 1; i < argc; ++i) {
         std::string arg(argv[i]);
+        auto needValue = [&](const char *opt) -> const char * {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << opt << std::endl;
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
         if (arg == "--recursive" || arg == "-r") {
             recursive = true;
+        } else if (arg == "--output") {
+            const char *v = needValue("--output");
+            if (!v) { printUsage(argv[0]); return 1; }
+            if (!parseOutputBackendType(v, output.type)) {
+                std::cerr << "Unknown output type: " << v << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--output-path") {
+            const char *v = needValue("--output-path");
+            if (!v) { printUsage(argv[0]); return 1; }
+            output.path = v;
+        } else if (arg == "--pipe-format") {
+            const char *v = needValue("--pipe-format");
+            if (!v) { printUsage(argv[0]); return 1; }
+            std::string fmt(v);
+            if (fmt == "f32") output.pipeFormat = PipeSampleFormat::Float32;
+            else if (fmt == "s16") output.pipeFormat = PipeSampleFormat::S16;
+            else {
+                std::cerr << "Unknown pipe format: " << fmt << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--wav-format") {
+            const char *v = needValue("--wav-format");
+            if (!v) { printUsage(argv[0]); return 1; }
+            if (!parseWavSampleFormat(v, output.wavFormat)) {
+                std::cerr << "Unknown wav format: " << v << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--dither") {
+            const char *v = needValue("--dither");
+            if (!v) { printUsage(argv[0]); return 1; }
+            if (!parseDitherMode(v, output.dither)) {
+                std::cerr << "Unknown dither mode: " << v << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+            archiveConfig.dither = output.dither;
+        } else if (arg == "--realtime") {
+            realtimeOverride = 1;
+        } else if (arg == "--free-run") {
+            realtimeOverride = 0;
+        } else if (arg == "--duration") {
+            const char *v = needValue("--duration");
+            if (!v) { printUsage(argv[0]); return 1; }
+            durationSeconds = std::atof(v);
+        } else if (arg == "--list-devices") {
+            printDevices();
+            return 0;
+        } else if (arg == "--device") {
+            const char *v = needValue("--device");
+            if (!v) { printUsage(argv[0]); return 1; }
+            std::string dev(v);
+            if (!dev.empty() && dev.find_first_not_of("0123456789") == std::string::npos) {
+                output.device.deviceIndex = std::atoi(v);
+            } else {
+                output.device.deviceName = dev;
+            }
+        } else if (arg == "--host-api") {
+            const char *v = needValue("--host-api");
+            if (!v) { printUsage(argv[0]); return 1; }
+            output.device.hostApi = v;
+        } else if (arg == "--buffer-frames") {
+            const char *v = needValue("--buffer-frames");
+            if (!v) { printUsage(argv[0]); return 1; }
+            output.framesPerBuffer = (unsigned long)std::strtoul(v, nullptr, 10);
+        } else if (arg == "--latency-ms") {
+            const char *v = needValue("--latency-ms");
+            if (!v) { printUsage(argv[0]); return 1; }
+            output.device.suggestedLatency = std::atof(v) / 1000.0;
+        } else if (arg == "--sink-min-ms") {
+            const char *v = needValue("--sink-min-ms");
+            if (!v) { printUsage(argv[0]); return 1; }
+            sinkMinMs = std::atof(v);
+        } else if (arg == "--sink-max-ms") {
+            const char *v = needValue("--sink-max-ms");
+            if (!v) { printUsage(argv[0]); return 1; }
+            sinkMaxMs = std::atof(v);
+        } else if (arg == "--rt-policy") {
+            const char *v = needValue("--rt-policy");
+            if (!v) { printUsage(argv[0]); return 1; }
+            if (!parseRtPolicy(v, tuning.policy)) {
+                std::cerr << "Unknown scheduling policy: " << v << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--rt-priority") {
+            const char *v = needValue("--rt-priority");
+            if (!v) { printUsage(argv[0]); return 1; }
+            tuning.priority = std::atoi(v);
+        } else if (arg == "--producer-cpu") {
+            const char *v = needValue("--producer-cpu");
+            if (!v) { printUsage(argv[0]); return 1; }
+            producerCpu = std::atoi(v);
+        } else if (arg == "--output-cpu") {
+            const char *v = needValue("--output-cpu");
+            if (!v) { printUsage(argv[0]); return 1; }
+            outputCpu = std::atoi(v);
+        } else if (arg == "--mlock") {
+            lockMemory = true;
+        } else if (arg == "--prefault-stack") {
+            tuning.prefaultStack = true;
+        } else if (arg == "--quiet") {
+            quiet = true;
+        } else if (arg == "--archive-dir") {
+            const char *v = needValue("--archive-dir");
+            if (!v) { printUsage(argv[0]); return 1; }
+            archiveConfig.directory = v;
+            archiving = true;
+        } else if (arg == "--archive-minutes") {
+            const char *v = needValue("--archive-minutes");
+            if (!v) { printUsage(argv[0]); return 1; }
+            archiveConfig.segmentSeconds = std::atof(v) * 60.0;
+        } else if (arg == "--archive-mb") {
+            const char *v = needValue("--archive-mb");
+            if (!v) { printUsage(argv[0]); return 1; }
+            archiveConfig.segmentMegabytes = std::atof(v);
+        } else if (arg == "--archive-format") {
+            const char *v = needValue("--archive-format");
+            if (!v) { printUsage(argv[0]); return 1; }
+            if (!parseWavSampleFormat(v, archiveConfig.format)) {
+                std::cerr << "Unknown archive format: " << v << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--archive-no-index") {
+            archiveConfig.index = false;
+        } else if (arg == "--retro-mb") {
+            const char *v = needValue("--retro-mb");
+            if (!v) { printUsage(argv[0]); return 1; }
+            retroMegabytes = std::atof(v);
+        } else if (arg == "--retro-minutes") {
+            const char *v = needValue("--retro-minutes");
+            if (!v) { printUsage(argv[0]); return 1; }
+            retroMinutes = std::atof(v);
+        } else if (arg == "--retro-dir") {
+            const char *v = needValue("--retro-dir");
+            if (!v) { printUsage(argv[0]); return 1; }
+            retroDirectory = v;
+        } else if (arg == "--retro-save-on-exit") {
+            retroSaveOnExit = true;
+        } else if (arg == "--score") {
+            const char *v = needValue("--score");
+            if (!v) { printUsage(argv[0]); return 1; }
+            scorePath = v;
+        } else if (arg == "--render-score") {
+            const char *v = needValue("--render-score");
+            if (!v) { printUsage(argv[0]); return 1; }
+            renderScorePath = v;
+        } else if (arg == "--render-seconds") {
+            const char *v = needValue("--render-seconds");
+            if (!v) { printUsage(argv[0]); return 1; }
+            renderConfig.seconds = std::atof(v);
+        } else if (arg == "--render-threads") {
+            const char *v = needValue("--render-threads");
+            if (!v) { printUsage(argv[0]); return 1; }
+            renderConfig.threads = std::atoi(v);
+        } else if (arg == "--render-segment-seconds") {
+            const char *v = needValue("--render-segment-seconds");
+            if (!v) { printUsage(argv[0]); return 1; }
+            renderConfig.segmentSeconds = std::atof(v);
+        } else if (arg == "--seed") {
+            const char *v = needValue("--seed");
+            if (!v) { printUsage(argv[0]); return 1; }
+            renderConfig.seed = std::strtoull(v, nullptr, 10);
+            seeded = true;
+        } else if (arg == "--render-quality") {
+            const char *v = needValue("--render-quality");
+            if (!v) { printUsage(argv[0]); return 1; }
+            if (!parseGrainQuality(v, renderQuality)) {
+                std::cerr << "Unknown render quality: " << v << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--rt-strict") {
+            rtStrict = true;
+        } else if (arg == "--log-rate") {
+            const char *v = needValue("--log-rate");
+            if (!v) { printUsage(argv[0]); return 1; }
+            logRate = (size_t)std::strtoul(v, nullptr, 10);
+        } else if (arg == "--trace") {
+            const char *v = needValue("--trace");
+            if (!v) { printUsage(argv[0]); return 1; }
+            tracePath = v;
+        } else if (arg == "--trace-seconds") {
+            const char *v = needValue("--trace-seconds");
+            if (!v) { printUsage(argv[0]); return 1; }
+            traceSeconds = std::atof(v);
+        } else if (arg == "--stats-interval") {
+            const char *v = needValue("--stats-interval");
+            if (!v) { printUsage(argv[0]); return 1; }
+            statsInterval = std::atof(v);
+        } else if (arg == "--metrics-port") {
+            const char *v = needValue("--metrics-port");
+            if (!v) { printUsage(argv[0]); return 1; }
+            metricsConfig.port = std::atoi(v);
+        } else if (arg == "--metrics-bind") {
+            const char *v = needValue("--metrics-bind");
+            if (!v) { printUsage(argv[0]); return 1; }
+            metricsConfig.bindAddress = v;
+        } else if (arg == "--metrics-file") {
+            const char *v = needValue("--metrics-file");
+            if (!v) { printUsage(argv[0]); return 1; }
+            metricsConfig.filePath = v;
+        } else if (arg == "--metrics-interval") {
+            const char *v = needValue("--metrics-interval");
+            if (!v) { printUsage(argv[0]); return 1; }
+            metricsConfig.fileInterval = std::atof(v);
         } else if (arg.size() > 0 && arg[0] == '-') {
             std::cerr << "Unknown option: " << arg << std::endl;
-            std::cerr << "Usage: " << argv[0] << " [--recursive|-r] <directory_with_mp3s>" << std::endl;
+            printUsage(argv[0]);
             return 1;
         } else if (directory == nullptr) {
             directory = argv[i];
         } else {
             std::cerr << "Unexpected argument: " << arg << std::endl;
-            std::cerr << "Usage: " << argv[0] << " [--recursive|-r] <directory_with_mp3s>" << std::endl;
+            printUsage(argv[0]);
             return 1;
         }
     }
 
     if (directory == nullptr) {
-        std::cerr << "Usage: " << argv[0] << " [--recursive|-r] <directory_with_mp3s>" << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+    if ((output.type == OutputBackendType::WavFile || output.type == OutputBackendType::FlacFile) &&
+        output.path.empty()) {
+        std::cerr << "--output wav/flac needs --output-path" << std::endl;
+        return 1;
+    }
+    if (output.type == OutputBackendType::FlacFile && output.wavFormat == WavSampleFormat::Float32) {
+        std::cerr << "--output flac writes s16 or s24" << std::endl;
+        return 1;
+    }
+    if (sinkMaxMs <= 0.0 || sinkMinMs < 0.0 || sinkMinMs > sinkMaxMs) {
+        std::cerr << "Need 0 <= --sink-min-ms <= --sink-max-ms" << std::endl;
+        return 1;
+    }
+    if (renderConfig.seconds > 0.0 && !renderScorePath.empty()) {
+        std::cerr << "--render-seconds and --render-score are exclusive" << std::endl;
+        return 1;
+    }
+    if (renderConfig.seconds > 0.0 && renderConfig.segmentSeconds <= 0.0) {
+        std::cerr << "--render-segment-seconds must be positive" << std::endl;
+        return 1;
+    }
+    renderConfig.quality = renderQuality;
+
+    // Loaded up front so a bad score fails before the library scan
+    Score score;
+    if (!renderScorePath.empty()) {
+        std::string error;
+        if (!loadScore(renderScorePath, score, error)) {
+            std::cerr << "Score: " << error << std::endl;
+            return 1;
+        }
+        if (score.sampleRate != 48000 || score.channels != 2) {
+            std::cerr << "Score: recorded at " << score.sampleRate << " Hz / " << score.channels
+                      << " channels, this build renders 48000 / 2" << std::endl;
+            return 1;
+        }
+        std::cout << "Score: " << score.voices.size() << " voices, " << score.endFrame / 48000.0 << " s"
+                  << (score.complete ? "" : " (cut short)") << std::endl;
+    }
+    output.realtime = realtimeOverride >= 0 ? (realtimeOverride == 1)
+                                            : (output.type == OutputBackendType::Null);
+
+    // A CI gate must not pass just because the build cannot check
+    if (rtStrict && !rtChecksCompiledIn()) {
+        std::cerr << "--rt-strict needs a build with -DWALKK_RT_CHECKS=ON" << std::endl;
         return 1;
     }
-    // Create Walkk with fixed sink and load directory of mp3s
+
+    if (!tracePath.empty()) {
+        traceSetEnabled(true);
+        traceRegisterThread("main");
+    }
+
+    // Raw PCM on stdout: keep console chatter on stderr
+    if (outputWritesToStdout(output)) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    // Create Walkk with the sink sized for the largest allowed depth and load directory of mp3s
     const int kSinkRate = 48000;
     const int kSinkChannels = 2;
-    const size_t sinkCapacity = (size_t)kSinkRate * (size_t)kSinkChannels * 2; // ~2 seconds
+    const size_t sinkCapacity = (size_t)(sinkMaxMs / 1000.0 * kSinkRate) * (size_t)kSinkChannels;
     Walkk walkk(sinkCapacity);
-    if (loadDirectoryMp3s(directory, walkk, recursive) != 0 || walkk.files.empty()) {
+    walkk.consoleLog = !quiet;
+    walkk.consoleLinesPerSecond = logRate;
+    walkk.sinkDepth.minLatency.store(sinkMinMs / 1000.0);
+    walkk.sinkDepth.maxLatency.store(sinkMaxMs / 1000.0);
+
+    // Started before the scan so library size is visible while loading
+    MetricsExporter metrics;
+    if (metricsConfig.enabled()) {
+        std::string error;
+        if (!metrics.start(walkk, metricsConfig, error)) {
+            std::cerr << "Metrics exporter: " << error << std::endl;
+            return 1;
+        }
+    }
+
+    int loadResult = loadDirectoryMp3s(directory, walkk, recursive);
+    walkk.pumpEvents();
+    if (loadResult != 0 || walkk.files.empty()) {
         std::cerr << "No MP3 files loaded from directory: " << directory << std::endl;
         return 1;
     }
     CallbackData callbackData{ &walkk.sink, kSinkChannels, &walkk };
 
-    std::thread producer([&walkk]() {
-        granulizerLoop(&walkk);
+    // Real-time options; failures are reported and playback carries on without them
+    walkk.producerTuning = tuning;
+    walkk.producerTuning.cpu = producerCpu;
+    output.thread = tuning;
+    output.thread.cpu = outputCpu;
+    if (lockMemory) {
+        std::string error;
+        if (lockProcessMemory(error)) std::cout << "Memory locked" << std::endl;
+        else std::cerr << "Could not lock memory: " << error << std::endl;
+    }
+
+    output.channels = kSinkChannels;
+    output.sampleRate = kSinkRate;
+    std::unique_ptr<OutputBackend> backend = createOutputBackend(output, &callbackData);
+    if (!backend) {
+        std::cerr << "Output backend not available in this build" << std::endl;
+        return 1;
+    }
+
+    std::signal(SIGINT, onInterrupt);
+    std::signal(SIGTERM, onInterrupt);
+#ifdef SIGPIPE
+    // A closed pipe reader shows up as a failed write instead of killing the process
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, onRetroSave);
+#endif
+
+    if (retroMegabytes > 0.0) {
+        walkk.retro.configure(retroMegabytes, kSinkRate, kSinkChannels, output.dither);
+        std::cout << "Retro capture: last " << walkk.retro.capacitySeconds() / 60.0 << " min in memory" << std::endl;
+    }
+
+    // Before the output starts, so the archive begins with its first buffer
+    if (archiving) {
+        std::string error;
+        if (!walkk.archive.start(archiveConfig, kSinkRate, kSinkChannels, error)) {
+            std::cerr << "Archive: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Archiving to " << walkk.archive.currentSegmentPath() << std::endl;
+    }
+
+    if (!scorePath.empty()) {
+        std::string error;
+        if (!startScore(walkk, scorePath, error)) {
+            std::cerr << "Score: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Writing score to " << scorePath << std::endl;
+    }
+
+    // Unseeded runs still get a seed, printed so a good one can be repeated
+    if (!seeded) renderConfig.seed = ((uint64_t)std::random_device{}() << 32) | std::random_device{}();
+    walkk.seed(renderConfig.seed);
+
+    const bool renderingScore = !renderScorePath.empty();
+    const bool renderingPiece = renderConfig.seconds > 0.0;
+    if (renderingPiece) {
+        std::cout << "Rendering " << renderConfig.seconds << " s, seed " << renderConfig.seed << std::endl;
+    } else if (!renderingScore) {
+        std::cout << "Seed " << renderConfig.seed << std::endl;
+    }
+    std::thread producer([&walkk, &score, &renderConfig, renderingScore, renderingPiece, renderQuality]() {
+        if (renderingScore) scorePlaybackLoop(&walkk, &score, renderQuality);
+        else if (renderingPiece) parallelRenderLoop(&walkk, renderConfig);
+        else granulizerLoop(&walkk);
     });
 
-    // Open audio stream
-    PaStream *stream;
-    int err = openAndStartStream(&stream, &callbackData, kSinkChannels, kSinkRate, 256);
-    if (err != paNoError) {
-        std::cerr << "PortAudio error: " << err << std::endl;
+    // Open audio output
+    int err = backend->start();
+    if (err != 0) {
+        std::cerr << "Output error (" << backend->name() << "): " << err << std::endl;
+        walkk.allFinished.store(true);
+        walkk.sink.wakeProducer();
+        producer.join();
         return 1;
     }
-    
-    // Stream already started by openAndStartStream
-    std::cout << "Playing..." << std::endl;
-    
-    // Wait for playback to finish
-    while (Pa_IsStreamActive(stream) == 1) {
-        Pa_Sleep(100);
+
+    // Render in blocks matching what the device actually asks for
+    walkk.engineBlockFrames.store(backend->bufferFrames());
+
+    // Output already started by start()
+    std::cout << "Playing via " << backend->name() << " (" << backend->bufferFrames()
+              << " frames/buffer, " << backend->outputLatency() * 1000.0 << " ms output latency)..." << std::endl;
+
+    // Wait for playback to finish, an interrupt or the requested duration
+    uint64_t retroSavesReported = 0;
+    auto started = std::chrono::steady_clock::now();
+    auto nextStats = started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                   std::chrono::duration<double>(statsInterval));
+    while (backend->isActive() && !g_interrupted) {
+        auto now = std::chrono::steady_clock::now();
+        if (durationSeconds > 0.0 && now - started >= std::chrono::duration<double>(durationSeconds)) {
+            break;
+        }
+        if (statsInterval > 0.0 && now >= nextStats) {
+            printHealth(walkk);
+            nextStats = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                  std::chrono::duration<double>(statsInterval));
+        }
+        if (g_retroSaveRequested) {
+            g_retroSaveRequested = 0;
+            startRetroSave(walkk, retroDirectory, retroMinutes);
+        }
+        reportRetroSave(walkk, retroSavesReported);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        walkk.pumpEvents();
     }
-    
+
     // Cleanup
+    if (statsInterval > 0.0) printHealth(walkk);
     std::cout << "Playback finished." << std::endl;
-    stopAndCloseStream(stream);
+    walkk.allFinished.store(true);
+    walkk.sink.wakeProducer();
+    backend->stop();
+
+    if (retroSaveOnExit && walkk.retro.isEnabled() && !walkk.retro.isSaving()) {
+        startRetroSave(walkk, retroDirectory, retroMinutes);
+    }
+    while (walkk.retro.isSaving()) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    reportRetroSave(walkk, retroSavesReported);
+
+    if (walkk.archive.isActive()) {
+        walkk.pumpEvents(); // last grains into the index
+        walkk.archive.stop();
+        std::cout << "Archive: " << walkk.archive.segmentsWritten.load() << " segments, "
+                  << walkk.archive.framesWritten.load() / (double)kSinkRate << " s";
+        if (walkk.archive.framesDropped.load() > 0) {
+            std::cout << ", " << walkk.archive.framesDropped.load() / (double)kSinkRate << " s written as silence";
+        }
+        if (walkk.archive.writeErrors.load() > 0) std::cout << ", " << walkk.archive.writeErrors.load() << " write errors";
+        std::cout << std::endl;
+    }
 
     if (producer.joinable()) {
         producer.join();
     }
-    
+    walkk.pumpEvents();
+
+    if (walkk.score.isOpen()) {
+        const uint64_t voices = walkk.score.voicesWritten;
+        if (walkk.score.close(walkk.clock.framesConsumed.load())) {
+            std::cout << "Score: " << voices << " voices in " << scorePath << std::endl;
+        } else {
+            std::cerr << "Score: write failed, " << scorePath << " is incomplete" << std::endl;
+        }
+    }
+    if (renderingScore || renderingPiece) {
+        const double rendered = walkk.clock.framesConsumed.load() / (double)kSinkRate;
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::cout << "Rendered " << rendered << " s in " << elapsed << " s ("
+                  << (elapsed > 0.0 ? rendered / elapsed : 0.0) << "x real time)" << std::endl;
+    }
+
+    if (!tracePath.empty()) {
+        traceSetEnabled(false);
+        if (traceWriteChromeJson(tracePath, traceSeconds)) {
+            std::cout << "Trace written to " << tracePath << std::endl;
+        } else {
+            std::cerr << "Could not write trace to " << tracePath
+                      << " (tracing compiled out or file not writable)" << std::endl;
+        }
+    }
+
+    if (rtChecksCompiledIn()) {
+        std::string report = rtCheckReport();
+        std::cerr << (report.empty() ? "Real-time path: no allocations, locks or blocking calls\n" : report);
+        if (rtStrict && !report.empty()) return 3;
+    }
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+#include "metrics.h"
+#include "walkk.h"
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+static void closeSocket(intptr_t s) { closesocket((SOCKET)s); }
+#else
+using SocketHandle = int;
+static void closeSocket(intptr_t s) { close((int)s); }
+#endif
+
+size_t currentRssBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return (size_t)pmc.WorkingSetSize;
+    return 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS) {
+        return (size_t)info.resident_size;
+    }
+    return 0;
+#else
+    FILE *f = std::fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long size = 0, resident = 0;
+    int n = std::fscanf(f, "%lu %lu", &size, &resident);
+    std::fclose(f);
+    return n == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+size_t peakRssBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return (size_t)pmc.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;        // bytes
+#else
+    return (size_t)usage.ru_maxrss * 1024; // kilobytes
+#endif
+#endif
+}
+
+namespace {
+
+struct MetricsWriter {
+    std::string out;
+
+    void header(const char *name, const char *type, const char *help) {
+        out += "# HELP "; out += name; out += ' '; out += help; out += '\n';
+        out += "# TYPE "; out += name; out += ' '; out += type; out += '\n';
+    }
+
+    void sample(const char *name, double value, const char *labels = nullptr) {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%s%s%s%s %.9g\n", name, labels ? "{" : "", labels ? labels : "",
+                      labels ? "}" : "", value);
+        out += line;
+    }
+
+    void gauge(const char *name, const char *help, double value) {
+        header(name, "gauge", help);
+        sample(name, value);
+    }
+
+    void counter(const char *name, const char *help, double value) {
+        header(name, "counter", help);
+        sample(name, value);
+    }
+
+    // Summary with quantiles taken from the log-spaced histogram (bin upper edges)
+    void summary(const char *name, const char *help, const AtomicLatencyHistogram &hist) {
+        LatencyHistogram h;
+        hist.snapshot(h);
+        header(name, "summary", help);
+        for (double q : {0.5, 0.9, 0.99, 0.999}) {
+            char label[32];
+            std::snprintf(label, sizeof(label), "quantile=\"%g\"", q);
+            sample(name, h.percentile(q), label);
+        }
+        std::string base = name;
+        sample((base + "_sum").c_str(), (double)hist.sumNs.load(std::memory_order_relaxed) * 1e-9);
+        sample((base + "_count").c_str(), (double)h.total);
+    }
+};
+
+} // namespace
+
+std::string formatPrometheusMetrics(Walkk &walkk, double grainsPerSecond) {
+    MetricsWriter w;
+    const ProducerStats &ps = walkk.producerStats;
+    const double samplesPerSecond = (double)Walkk::kSampleRate * Walkk::kChannels;
+
+    w.counter("walkk_grains_total", "Grains decoded and scheduled.", (double)ps.grains.load());
+    w.counter("walkk_grain_failures_total", "Grains whose decode failed.", (double)ps.grainFailures.load());
+    w.gauge("walkk_grains_per_second", "Grains scheduled per second over the last sampling window.", grainsPerSecond);
+    w.summary("walkk_decode_seconds", "Time to open, seek, decode and resample one grain.", ps.decodeTime);
+
+    w.counter("walkk_decoder_opens_total", "Grain reads that had to open their file.", (double)ps.decoderOpens.load());
+    w.gauge("walkk_open_decoders", "MP3 decoder handles currently open.", (double)ps.openDecoders.load());
+
+    w.gauge("walkk_sink_queued_seconds", "Audio queued between producer and output.",
+            (double)walkk.sink.getQueuedSamples() / samplesPerSecond);
+    w.gauge("walkk_sink_target_seconds", "Depth the adaptive sink currently fills to.",
+            (double)walkk.sinkDepth.targetFrames.load() / Walkk::kSampleRate);
+    w.gauge("walkk_sink_capacity_seconds", "Hard capacity of the sink.", (double)walkk.sink.capacity / samplesPerSecond);
+    w.counter("walkk_sink_depth_adjustments_total", "Changes of the adaptive sink depth.",
+              (double)walkk.sinkDepth.adjustments.load());
+    w.counter("walkk_producer_wakeups_total", "Times the producer was woken by the output.",
+              (double)walkk.sink.producerWakeups.load());
+    w.counter("walkk_producer_idle_seconds_total", "Time the producer spent waiting for sink space.",
+              (double)walkk.sink.producerIdleNs.load() * 1e-9);
+
+    const AudioHealth &health = walkk.health;
+    w.counter("walkk_output_buffers_total", "Buffers delivered to the output.", (double)health.callbacks.load());
+    w.header("walkk_xruns_total", "counter", "Device-reported xruns.");
+    w.sample("walkk_xruns_total", (double)health.underflows.load(), "kind=\"underflow\"");
+    w.sample("walkk_xruns_total", (double)health.overflows.load(), "kind=\"overflow\"");
+    w.header("walkk_output_shortfalls_total", "counter", "Buffers the sink could not fill.");
+    w.sample("walkk_output_shortfalls_total", (double)health.partialBuffers.load(), "kind=\"partial\"");
+    w.sample("walkk_output_shortfalls_total", (double)health.emptyBuffers.load(), "kind=\"empty\"");
+    w.counter("walkk_output_over_budget_total", "Callbacks that took longer than their buffer lasts.",
+              (double)health.overBudget.load());
+    w.summary("walkk_callback_seconds", "Time spent filling one output buffer.", health.callbackTime);
+
+    w.counter("walkk_events_dropped_total", "Log events dropped because the ring was full.",
+              (double)walkk.events.dropped.load());
+    w.gauge("walkk_library_files", "MP3 files loaded.", (double)walkk.libraryFiles.load());
+    w.gauge("walkk_library_seconds", "Total duration of the loaded files.", walkk.librarySeconds.load());
+    w.gauge("process_resident_memory_bytes", "Resident memory size in bytes.", (double)currentRssBytes());
+    return w.out;
+}
+
+bool MetricsExporter::start(Walkk &w, const MetricsConfig &c, std::string &error) {
+    stop();
+    walkk = &w;
+    config = c;
+
+    if (config.port > 0) {
+#ifdef _WIN32
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+            error = "WSAStartup failed";
+            return false;
+        }
+#endif
+        SocketHandle s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+#ifdef _WIN32
+        if (s == INVALID_SOCKET) {
+#else
+        if (s < 0) {
+#endif
+            error = "cannot create socket";
+            return false;
+        }
+        int yes = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char *)&yes, sizeof(yes));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)config.port);
+        if (inet_pton(AF_INET, config.bindAddress.c_str(), &addr.sin_addr) != 1) {
+            closeSocket((intptr_t)s);
+            error = "invalid bind address " + config.bindAddress;
+            return false;
+        }
+        if (bind(s, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(s, 8) != 0) {
+            closeSocket((intptr_t)s);
+            error = "cannot listen on " + config.bindAddress + ":" + std::to_string(config.port);
+            return false;
+        }
+        listenSocket = (intptr_t)s;
+    }
+
+    stopping.store(false);
+    rateGrains = walkk->producerStats.grains.load();
+    rateStart = Clock::now();
+    grainsPerSecond = 0.0;
+    worker = std::thread([this]() { run(); });
+    return true;
+}
+
+void MetricsExporter::stop() {
+    stopping.store(true);
+    if (worker.joinable()) worker.join();
+    if (listenSocket != -1) {
+        closeSocket(listenSocket);
+        listenSocket = -1;
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+}
+
+void MetricsExporter::sampleRate() {
+    Clock::time_point now = Clock::now();
+    double elapsed = std::chrono::duration<double>(now - rateStart).count();
+    if (elapsed < 1.0) return;
+    uint64_t grains = walkk->producerStats.grains.load();
+    grainsPerSecond = (double)(grains - rateGrains) / elapsed;
+    rateGrains = grains;
+    rateStart = now;
+}
+
+bool MetricsExporter::writeFile() {
+    // Write beside the target and rename, so a scraper never sees a half-written file
+    std::string tmp = config.filePath + ".tmp";
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    std::string text = formatPrometheusMetrics(*walkk, grainsPerSecond);
+    bool ok = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+    ok = std::fclose(f) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp.c_str(), config.filePath.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && std::rename(tmp.c_str(), config.filePath.c_str()) == 0;
+#endif
+    return ok;
+}
+
+void MetricsExporter::serveClient(intptr_t client) {
+    // Short timeout so a stalled client cannot hold up the exporter
+#ifdef _WIN32
+    DWORD timeoutMs = 1000;
+    setsockopt((SOCKET)client, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeoutMs, sizeof(timeoutMs));
+    setsockopt((SOCKET)client, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeoutMs, sizeof(timeoutMs));
+#else
+    timeval timeout{1, 0};
+    setsockopt((int)client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt((int)client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#endif
+
+    char request[2048];
+    size_t got = 0;
+    while (got < sizeof(request) - 1) {
+        int n = (int)recv((SocketHandle)client, request + got, (int)(sizeof(request) - 1 - got), 0);
+        if (n <= 0) break;
+        got += (size_t)n;
+        request[got] = '\0';
+        if (std::strstr(request, "\r\n\r\n") || std::strstr(request, "\n\n")) break;
+    }
+    request[got] = '\0';
+
+    std::string status, type = "text/plain; charset=utf-8", body;
+    if (std::strncmp(request, "GET /metrics ", 13) == 0 || std::strncmp(request, "GET / ", 6) == 0) {
+        status = "200 OK";
+        type = "text/plain; version=0.0.4; charset=utf-8";
+        body = formatPrometheusMetrics(*walkk, grainsPerSecond);
+    } else {
+        status = "404 Not Found";
+        body = "walkk serves /metrics\n";
+    }
+
+    std::string response = "HTTP/1.0 " + status + "\r\nContent-Type: " + type +
+                           "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+        int n = (int)send((SocketHandle)client, response.data() + sent, (int)(response.size() - sent), 0);
+        if (n <= 0) break;
+        sent += (size_t)n;
+    }
+    closeSocket(client);
+}
+
+void MetricsExporter::run() {
+    Clock::time_point nextFile = Clock::now();
+    bool fileErrorReported = false;
+
+    while (!stopping.load()) {
+        sampleRate();
+
+        if (!config.filePath.empty() && Clock::now() >= nextFile) {
+            if (!writeFile() && !fileErrorReported) {
+                walkk->addLog("metrics: cannot write " + config.filePath);
+                fileErrorReported = true;
+            }
+            nextFile = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                          std::chrono::duration<double>(std::max(0.1, config.fileInterval)));
+        }
+
+        if (listenSocket == -1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            continue;
+        }
+
+        // Wake at least every 200 ms to notice stop() and the file interval
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET((SocketHandle)listenSocket, &readable);
+        timeval wait{0, 200000};
+        int ready = select((int)listenSocket + 1, &readable, nullptr, nullptr, &wait);
+        if (ready <= 0) continue;
+
+        SocketHandle client = accept((SocketHandle)listenSocket, nullptr, nullptr);
+#ifdef _WIN32
+        if (client == INVALID_SOCKET) continue;
+#else
+        if (client < 0) continue;
+#endif
+        serveClient((intptr_t)client);
+    }
+
+    // Leave a final snapshot behind
+    if (!config.filePath.empty()) writeFile();
+}
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cstring>
+
+#include "mixer.h"
+
+static void claimVoice(MixerVoice &v, MixerVoice::Type type) {
+    v.type = type;
+    v.active = true;
+    v.startFrame = 0;
+    v.lengthFrames = 0;
+    v.position = 0;
+    v.fileIndex = 0;
+}
+
+MixerVoice *Mixer::allocateVoice(MixerVoice::Type type) {
+    for (auto &v : voices) {
+        if (!v.active) {
+            claimVoice(v, type);
+            return &v;
+        }
+    }
+    return nullptr;
+}
+
+MixerVoice *Mixer::allocateVoice(MixerVoice::Type type, size_t slot) {
+    if (slot >= voices.size() || voices[slot].active) return nullptr;
+    claimVoice(voices[slot], type);
+    return &voices[slot];
+}
+
+size_t Mixer::activeVoices() const {
+    return (size_t)std::count_if(voices.begin(), voices.end(),
+                                 [](const MixerVoice &v) { return v.active; });
+}
+
+size_t Mixer::activeVoices(MixerVoice::Type type) const {
+    return (size_t)std::count_if(voices.begin(), voices.end(),
+                                 [type](const MixerVoice &v) { return v.active && v.type == type; });
+}
+
+void Mixer::reset() {
+    for (auto &v : voices) v.active = false;
+    renderFrame = 0;
+}
+
+void Mixer::render(float *out, size_t frames) {
+    frames = std::min(frames, kMaxBlockFrames);
+    const size_t ch = (size_t)channels;
+    std::memset(out, 0, frames * ch * sizeof(float));
+
+    const uint64_t blockStart = renderFrame;
+    const uint64_t blockEnd = blockStart + frames;
+    float scratch[kMaxBlockFrames * NoiseGenerator::kMaxChannels];
+
+    for (auto &v : voices) {
+        if (!v.active) continue;
+        const uint64_t vEnd = v.endFrame();
+        if (v.startFrame >= blockEnd) continue; // scheduled for a later block
+        if (vEnd <= blockStart) { v.active = false; continue; }
+
+        const uint64_t from = std::max(v.startFrame, blockStart);
+        const uint64_t to = std::min(vEnd, blockEnd);
+        const size_t outOffset = (size_t)(from - blockStart) * ch;
+        const size_t n = (size_t)(to - from) * ch;
+
+        if (v.type == MixerVoice::Type::Grain) {
+            const float *src = v.buffer.data() + v.position * ch;
+            float *dst = out + outOffset;
+            for (size_t i = 0; i < n; ++i) dst[i] += src[i];
+        } else {
+            v.noise.render(scratch, n, channels);
+            float *dst = out + outOffset;
+            for (size_t i = 0; i < n; ++i) dst[i] += scratch[i];
+        }
+
+        v.position += (size_t)(to - from);
+        if (to >= vEnd) v.active = false;
+    }
+
+    renderFrame = blockEnd;
+}
+
+void Mixer::advance(size_t frames) {
+    frames = std::min(frames, kMaxBlockFrames);
+    const uint64_t blockEnd = renderFrame + frames;
+    for (auto &v : voices) {
+        if (v.active && v.startFrame < blockEnd && v.endFrame() <= blockEnd) v.active = false;
+    }
+    renderFrame = blockEnd;
+}
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WALKK_NOISE_SSE 1
+#endif
+
+#include "noise_gen.h"
+
+namespace {
+
+inline uint32_t xorshift32(uint32_t &x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+// Top 23 bits as mantissa of a float in [1, 2), remapped to [-1, 1)
+inline float bitsToBipolar(uint32_t x) {
+    uint32_t bits = (x >> 9) | 0x3F800000u;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f * 2.0f - 3.0f;
+}
+
+// Advance all lanes once and write kLanes white samples in [-1, 1)
+inline void stepAllLanes(uint32_t *lanes, float *out) {
+#ifdef WALKK_NOISE_SSE
+    const __m128i mantissaOne = _mm_set1_epi32(0x3F800000);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 three = _mm_set1_ps(3.0f);
+    for (int i = 0; i < NoiseGenerator::kLanes; i += 4) {
+        __m128i x = _mm_load_si128((const __m128i *)(lanes + i));
+        x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+        x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+        _mm_store_si128((__m128i *)(lanes + i), x);
+        __m128 f = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(x, 9), mantissaOne));
+        _mm_storeu_ps(out + i, _mm_sub_ps(_mm_mul_ps(f, two), three));
+    }
+#else
+    for (int i = 0; i < NoiseGenerator::kLanes; ++i) {
+        out[i] = bitsToBipolar(xorshift32(lanes[i]));
+    }
+#endif
+}
+
+// Gains chosen so pink/brown peaks stay near the white source's [-1, 1) range
+constexpr float kPinkGain  = 0.125f;
+constexpr float kBrownGain = 3.5f;
+
+} // namespace
+
+const char *noiseColorName(NoiseColor color) {
+    switch (color) {
+    case NoiseColor::White: return "White";
+    case NoiseColor::Pink:  return "Pink";
+    case NoiseColor::Brown: return "Brown";
+    }
+    return "?";
+}
+
+uint64_t splitMix64(uint64_t &state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void NoiseGenerator::seed(uint64_t seedValue) {
+    uint64_t s = seedValue;
+    for (int i = 0; i < kLanes; ++i) {
+        uint32_t v = (uint32_t)(splitMix64(s) >> 32);
+        lanes[i] = v ? v : 0x9E3779B9u; // xorshift must never be seeded with zero
+    }
+    samplesRendered = 0;
+    std::memset(pinkState, 0, sizeof(pinkState));
+    std::memset(brownState, 0, sizeof(brownState));
+}
+
+void NoiseGenerator::render(float *out, size_t samples, int channels) {
+    if (!out || samples == 0) return;
+    channels = std::clamp(channels, 1, kMaxChannels);
+
+    // White source: unaligned head/tail go lane by lane, the aligned middle in full lane sweeps
+    size_t i = 0;
+    while (i < samples && (samplesRendered + i) % kLanes != 0) {
+        out[i] = bitsToBipolar(xorshift32(lanes[(samplesRendered + i) % kLanes]));
+        ++i;
+    }
+    for (; i + kLanes <= samples; i += kLanes) {
+        stepAllLanes(lanes, out + i);
+    }
+    for (; i < samples; ++i) {
+        out[i] = bitsToBipolar(xorshift32(lanes[(samplesRendered + i) % kLanes]));
+    }
+
+    // Channel of sample k is k % channels, counted from the start of the stream
+    const size_t chOffset = (size_t)(samplesRendered % (uint64_t)channels);
+    samplesRendered += samples;
+
+    switch (color) {
+    case NoiseColor::White:
+        for (size_t k = 0; k < samples; ++k) out[k] *= amplitude;
+        break;
+    case NoiseColor::Pink:
+        for (size_t k = 0; k < samples; ++k) {
+            float *b = pinkState[(k + chOffset) % (size_t)channels];
+            float w = out[k];
+            b[0] = 0.99765f * b[0] + w * 0.0990460f;
+            b[1] = 0.96300f * b[1] + w * 0.2965164f;
+            b[2] = 0.57000f * b[2] + w * 1.0526913f;
+            out[k] = (b[0] + b[1] + b[2] + w * 0.1848f) * kPinkGain * amplitude;
+        }
+        break;
+    case NoiseColor::Brown:
+        for (size_t k = 0; k < samples; ++k) {
+            float &b = brownState[(k + chOffset) % (size_t)channels];
+            b = (b + 0.02f * out[k]) / 1.02f;
+            out[k] = b * kBrownGain * amplitude;
+        }
+        break;
+    }
+}
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "offline_render.h"
+#include "trace.h"
+
+namespace {
+
+struct RenderedSegment {
+    std::vector<float> audio; // segment span, then the tail of its last grains
+    size_t spanFrames = 0;
+    uint64_t grains = 0;
+    uint64_t grainFailures = 0;
+};
+
+// What a segment inherits from the one before it, on its own timeline (frame 0 = its start):
+// when the next grain may start, and the voices that are still sounding. Its grains then take
+// turns with that tail exactly as they would have in one long run.
+struct SegmentEntry {
+    uint64_t nextStartFrame = 0;
+    struct Voice {
+        MixerVoice::Type type;
+        uint64_t startFrame;
+        uint64_t endFrame;
+    };
+    std::vector<Voice> voices;
+};
+
+// Everything a segment needs from the live engine, copied once
+struct RenderSource {
+    std::vector<StreamedFile> files; // metadata only; decoders open per grain
+    Walkk::GranularSettings settings;
+    IoFaultInjector *ioFaults = nullptr;
+};
+
+void copyLibrary(const std::vector<StreamedFile> &from, std::vector<StreamedFile> &to) {
+    to.clear();
+    to.reserve(from.size());
+    for (const StreamedFile &f : from) {
+        StreamedFile copy;
+        copy.path = f.path;
+        copy.relPath = f.relPath;
+        copy.totalFrames = f.totalFrames;
+        copy.sampleRate = f.sampleRate;
+        copy.channels = f.channels;
+        to.push_back(std::move(copy));
+    }
+}
+
+// Seed the engine for segment `index` and put the inherited tail in its mixer as silent
+// voices: they hold their slots and count against maxConcurrentGrains until they end
+void enterSegment(Walkk &engine, GranulizerState &state, const OfflineRenderConfig &config, uint64_t index,
+                  const SegmentEntry &entry) {
+    engine.seed(segmentSeed(config.seed, index));
+    engine.mixer.reset();
+    const bool planOnly = state.planOnly;
+    state = GranulizerState();
+    state.planOnly = planOnly;
+    state.nextStartFrame = entry.nextStartFrame;
+    for (const SegmentEntry::Voice &v : entry.voices) {
+        MixerVoice *voice = engine.mixer.allocateVoice(v.type);
+        if (!voice) break;
+        voice->startFrame = v.startFrame;
+        voice->lengthFrames = (size_t)(v.endFrame - v.startFrame);
+        if (v.type == MixerVoice::Type::Noise) {
+            voice->noise.amplitude = 0.0f;
+        } else if (!planOnly) {
+            voice->buffer.assign(voice->lengthFrames * (size_t)Walkk::kChannels, 0.0f);
+        }
+    }
+}
+
+// Where the next segment picks up after `spanFrames` of this one
+SegmentEntry exitSegment(const Walkk &engine, const GranulizerState &state, size_t spanFrames) {
+    SegmentEntry entry;
+    entry.nextStartFrame = state.nextStartFrame > spanFrames ? state.nextStartFrame - spanFrames : 0;
+    for (const MixerVoice &v : engine.mixer.voices) {
+        if (!v.active || v.endFrame() <= spanFrames) continue;
+        entry.voices.push_back({v.type, v.startFrame > spanFrames ? v.startFrame - spanFrames : 0,
+                                v.endFrame() - spanFrames});
+    }
+    return entry;
+}
+
+size_t segmentBlockFrames(const OfflineRenderConfig &config) {
+    return std::clamp<size_t>(config.blockFrames, 16, Mixer::kMaxBlockFrames);
+}
+
+// Schedules every segment in order without decoding anything, to learn what each one inherits.
+// Cheap next to the render (random draws only), and the same on every run. A grain that later
+// fails to decode leaves a gap the plan did not have; the segments after it are unaffected.
+std::vector<SegmentEntry> planSegments(const RenderSource &source, const OfflineRenderConfig &config,
+                                       uint64_t segmentCount, uint64_t segmentFrames, uint64_t totalFrames,
+                                       const std::atomic<bool> &stop) {
+    WALKK_TRACE_ZONE("plan segments");
+    Walkk engine(Walkk::kChannels);
+    engine.consoleLog = false;
+    copyLibrary(source.files, engine.files);
+    engine.settings = source.settings;
+
+    const size_t blockFrames = segmentBlockFrames(config);
+    GranulizerState state;
+    state.planOnly = true;
+    std::vector<SegmentEntry> entries(segmentCount);
+    for (uint64_t index = 0; index + 1 < segmentCount && !stop.load(); ++index) {
+        enterSegment(engine, state, config, index, entries[index]);
+        const size_t spanFrames = (size_t)std::min(segmentFrames, totalFrames - index * segmentFrames);
+        for (size_t done = 0; done < spanFrames;) {
+            const size_t n = std::min(blockFrames, spanFrames - done);
+            renderGranulizerBlock(&engine, state, nullptr, n);
+            done += n;
+        }
+        entries[index + 1] = exitSegment(engine, state, spanFrames);
+    }
+    return entries;
+}
+
+void renderSegment(const RenderSource &source, const OfflineRenderConfig &config, uint64_t index, size_t spanFrames,
+                   const SegmentEntry &entry, const std::atomic<bool> &stop, RenderedSegment &out) {
+    WALKK_TRACE_ZONE("render segment");
+    // A private engine: nothing is shared with the other segments but read-only metadata
+    Walkk engine(Walkk::kChannels);
+    engine.consoleLog = false;
+    copyLibrary(source.files, engine.files);
+    engine.settings = source.settings;
+    engine.ioFaults = source.ioFaults;
+    engine.grainQuality = config.quality;
+
+    const size_t ch = (size_t)Walkk::kChannels;
+    const size_t blockFrames = segmentBlockFrames(config);
+    std::vector<float> block(blockFrames * ch);
+    GranulizerState state;
+    enterSegment(engine, state, config, index, entry);
+
+    out.audio.clear();
+    out.audio.reserve(spanFrames * ch);
+    size_t done = 0;
+    while (done < spanFrames && !stop.load()) {
+        const size_t n = std::min(blockFrames, spanFrames - done);
+        renderGranulizerBlock(&engine, state, block.data(), n);
+        out.audio.insert(out.audio.end(), block.begin(), block.begin() + (std::ptrdiff_t)(n * ch));
+        done += n;
+    }
+    out.spanFrames = done;
+
+    // Tail: no new grains, render until the last voice has finished
+    while (engine.mixer.activeVoices() > 0 && !stop.load()) {
+        renderGranulizerBlock(&engine, state, block.data(), blockFrames, false);
+        out.audio.insert(out.audio.end(), block.begin(), block.end());
+    }
+
+    out.grains = engine.producerStats.grains.load();
+    out.grainFailures = engine.producerStats.grainFailures.load();
+}
+
+} // namespace
+
+uint64_t segmentSeed(uint64_t seed, uint64_t segment) {
+    uint64_t state = seed + (segment + 1) * 0x9E3779B97F4A7C15ull;
+    return splitMix64(state);
+}
+
+void renderPiece(Walkk *walkk, const OfflineRenderConfig &config,
+                 const std::function<void(const float *, size_t)> &emit) {
+    if (walkk->files.empty() || config.seconds <= 0.0) return;
+
+    RenderSource source;
+    copyLibrary(walkk->files, source.files);
+    {
+        std::lock_guard<std::mutex> lock(walkk->settingsMutex);
+        source.settings = walkk->settings;
+    }
+    source.ioFaults = walkk->ioFaults;
+
+    const uint64_t totalFrames = (uint64_t)std::llround(config.seconds * Walkk::kSampleRate);
+    const uint64_t segmentFrames = std::max<uint64_t>(
+        config.blockFrames, (uint64_t)std::llround(config.segmentSeconds * Walkk::kSampleRate));
+    const uint64_t segmentCount = (totalFrames + segmentFrames - 1) / segmentFrames;
+    unsigned threadCount = config.threads > 0 ? (unsigned)config.threads : std::thread::hardware_concurrency();
+    threadCount = (unsigned)std::clamp<uint64_t>(threadCount, 1, segmentCount);
+    const uint64_t window = 2 * (uint64_t)threadCount; // segments rendered ahead of the writer
+
+    {
+        std::string msg = "offline render: " + std::to_string(segmentCount) + " segments of " +
+                          std::to_string(segmentFrames / (double)Walkk::kSampleRate) + " s on " +
+                          std::to_string(threadCount) + " threads";
+        walkk->addLog(msg);
+    }
+
+    std::atomic<bool> stop{false};
+    const std::vector<SegmentEntry> entries =
+        planSegments(source, config, segmentCount, segmentFrames, totalFrames, walkk->allFinished);
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::map<uint64_t, RenderedSegment> ready;
+    uint64_t nextToRender = 0;
+    uint64_t written = 0;
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&, t]() {
+            traceRegisterThread(("render " + std::to_string(t)).c_str());
+            while (true) {
+                uint64_t index;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&]() {
+                        return stop.load() || nextToRender >= segmentCount || nextToRender < written + window;
+                    });
+                    if (stop.load() || nextToRender >= segmentCount) return;
+                    index = nextToRender++;
+                }
+                const uint64_t start = index * segmentFrames;
+                RenderedSegment segment;
+                renderSegment(source, config, index, (size_t)std::min(segmentFrames, totalFrames - start),
+                              entries[index], stop, segment);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ready.emplace(index, std::move(segment));
+                }
+                changed.notify_all();
+            }
+        });
+    }
+
+    // Stitch in timeline order: the tails carried so far are added onto the next segment
+    std::vector<float> carry;
+    const size_t ch = (size_t)Walkk::kChannels;
+    while (written < segmentCount && !walkk->allFinished.load()) {
+        RenderedSegment segment;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!changed.wait_for(lock, std::chrono::milliseconds(50), [&]() { return ready.count(written) > 0; })) {
+                continue; // re-check allFinished
+            }
+            auto it = ready.find(written);
+            segment = std::move(it->second);
+            ready.erase(it);
+        }
+
+        std::vector<float> &audio = segment.audio;
+        if (carry.size() > audio.size()) audio.resize(carry.size(), 0.0f);
+        for (size_t i = 0; i < carry.size(); ++i) audio[i] += carry[i];
+        const size_t span = segment.spanFrames * ch;
+        carry.assign(audio.begin() + (std::ptrdiff_t)span, audio.end());
+
+        walkk->producerStats.grains.fetch_add(segment.grains, std::memory_order_relaxed);
+        walkk->producerStats.grainFailures.fetch_add(segment.grainFailures, std::memory_order_relaxed);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            written++;
+        }
+        changed.notify_all();
+
+        emit(audio.data(), span);
+    }
+    // The piece ends when its last grains do
+    if (written == segmentCount && !walkk->allFinished.load()) {
+        emit(carry.data(), carry.size());
+    }
+
+    stop.store(true);
+    changed.notify_all();
+    for (std::thread &w : workers) w.join();
+}
+
+void parallelRenderLoop(Walkk *walkk, const OfflineRenderConfig &config) {
+    if (walkk->files.empty() || config.seconds <= 0.0) {
+        walkk->sink.finished.store(true);
+        walkk->allFinished.store(true);
+        return;
+    }
+    traceRegisterThread("producer");
+    // In engine blocks, as the live producer does: a whole segment at once would wait for the
+    // sink to drain completely, while a file output waits for a full buffer before it pulls
+    const size_t chunk = segmentBlockFrames(config) * (size_t)Walkk::kChannels;
+    renderPiece(walkk, config, [walkk, chunk](const float *samples, size_t count) {
+        for (size_t done = 0; done < count && !walkk->allFinished.load(); done += chunk) {
+            pushToSink(walkk, samples + done, std::min(chunk, count - done));
+        }
+    });
+    walkk->sink.finished.store(true);
+}
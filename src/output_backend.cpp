@@ -0,0 +1,311 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "output_backend.h"
+#include "pa_sink.h"
+#include "walkk.h"
+#include "trace.h"
+#include "wav_writer.h"
+
+namespace {
+
+#ifdef WALKK_HAVE_PORTAUDIO
+struct PortAudioBackend : OutputBackend {
+    OutputConfig config;
+    CallbackData *cb;
+    PaStream *stream = nullptr;
+    unsigned long frames = 0;
+    double latency = 0.0;
+
+    PortAudioBackend(const OutputConfig &c, CallbackData *data) : config(c), cb(data) {}
+    ~PortAudioBackend() override { stop(); }
+
+    int start() override {
+        if (stream) return paNoError;
+        int err = openAndStartStream(&stream, cb, config.channels, config.sampleRate,
+                                     config.framesPerBuffer, config.device);
+        if (err != paNoError) {
+            stream = nullptr;
+            return err;
+        }
+
+        // With an unspecified buffer size the host decides; the latency is the best hint we get
+        const PaStreamInfo *info = Pa_GetStreamInfo(stream);
+        latency = info ? info->outputLatency : 0.0;
+        cb->outputLatency = latency;
+        frames = config.framesPerBuffer;
+        if (frames == 0) {
+            frames = latency > 0.0 ? (unsigned long)(latency * config.sampleRate) : 256;
+        }
+        return paNoError;
+    }
+
+    void stop() override {
+        if (stream) {
+            stopAndCloseStream(stream, cb);
+            stream = nullptr;
+        }
+    }
+
+    bool isActive() override { return stream && Pa_IsStreamActive(stream) == 1; }
+    const char *name() const override { return "portaudio"; }
+    unsigned long bufferFrames() const override { return frames; }
+    double outputLatency() const override { return latency; }
+};
+#endif
+
+// Pulls buffers on its own thread, either paced like a device or as fast as audio arrives
+struct ThreadedBackend : OutputBackend {
+    OutputConfig config;
+    CallbackData *cb;
+    std::thread worker;
+    std::atomic<bool> stopRequested{false};
+    std::atomic<bool> active{false};
+    bool opened = false;
+
+    ThreadedBackend(const OutputConfig &c, CallbackData *data) : config(c), cb(data) {}
+
+    // Hooks for the concrete sinks; deliver() returning false ends the stream
+    virtual bool open() { return true; }
+    virtual bool deliver(const float *samples, unsigned long frames) = 0;
+    virtual void close() {}
+
+    int start() override {
+        if (opened) return 0;
+        if (!open()) return -1;
+        opened = true;
+        stopRequested.store(false);
+        active.store(true);
+        worker = std::thread([this]() { run(); });
+        return 0;
+    }
+
+    void stop() override {
+        stopRequested.store(true);
+        if (worker.joinable()) worker.join();
+        if (opened) {
+            close();
+            opened = false;
+        }
+    }
+
+    bool isActive() override { return active.load(); }
+
+    unsigned long bufferFrames() const override {
+        return config.framesPerBuffer > 0 ? config.framesPerBuffer : 256;
+    }
+
+    double outputLatency() const override {
+        return config.realtime ? (double)bufferFrames() / (double)config.sampleRate : 0.0;
+    }
+
+    // Free-running: wait until a whole buffer is queued so the output has no padding gaps
+    bool waitForAudio(size_t samplesNeeded) {
+        while (!stopRequested.load()) {
+            if (cb->sink->finished.load() || cb->sink->getQueuedSamples() >= samplesNeeded) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    }
+
+    void run() {
+        traceRegisterThread("output");
+
+        if (!config.thread.isDefault()) {
+            std::string error;
+            std::string msg = std::string(name()) + " output thread: " + describeThreadTuning(config.thread);
+            msg += applyThreadTuning(config.thread, error) ? " applied" : " failed: " + error;
+            std::cerr << msg << std::endl;
+            if (cb->walkk) cb->walkk->addLog(msg);
+        }
+
+        const unsigned long frames = bufferFrames();
+        std::vector<float> buffer(frames * (size_t)config.channels);
+        const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>((double)frames / (double)config.sampleRate));
+        auto next = std::chrono::steady_clock::now();
+        uint32_t statusFlags = 0;
+
+        while (!stopRequested.load()) {
+            if (!config.realtime && !waitForAudio(buffer.size())) break;
+            if (!renderOutputBuffer(cb, buffer.data(), frames, 0.0, statusFlags)) break;
+            if (!deliver(buffer.data(), frames)) break;
+
+            statusFlags = 0;
+            if (config.realtime) {
+                next += period;
+                auto now = std::chrono::steady_clock::now();
+                // A whole period late is what a device would report as an underflow
+                if (now > next + period) statusFlags |= kStatusOutputUnderflow;
+                if (next < now - period * 8) next = now; // fell far behind (e.g. suspended): resync
+                std::this_thread::sleep_until(next);
+            }
+        }
+        active.store(false);
+    }
+};
+
+struct NullBackend : ThreadedBackend {
+    using ThreadedBackend::ThreadedBackend;
+    ~NullBackend() override { stop(); }
+
+    bool deliver(const float *, unsigned long) override { return true; }
+    const char *name() const override { return "null"; }
+};
+
+struct WavFileBackend : ThreadedBackend {
+    WavFileWriter writer;
+
+    using ThreadedBackend::ThreadedBackend;
+    ~WavFileBackend() override { stop(); }
+
+    bool open() override {
+        if (config.path.empty()) return false;
+        writer.dither = config.dither;
+        return writer.open(config.path, (uint32_t)config.sampleRate, (uint16_t)config.channels, config.wavFormat);
+    }
+
+    bool deliver(const float *samples, unsigned long frames) override {
+        return writer.write(samples, frames);
+    }
+
+    void close() override {
+        if (!writer.close()) std::cerr << "wav output: could not finish " << config.path << std::endl;
+    }
+
+    const char *name() const override { return "wav"; }
+};
+
+struct FlacFileBackend : ThreadedBackend {
+    FlacFileWriter writer;
+
+    using ThreadedBackend::ThreadedBackend;
+    ~FlacFileBackend() override { stop(); }
+
+    bool open() override {
+        if (config.path.empty()) return false;
+        writer.dither = config.dither;
+        return writer.open(config.path, (uint32_t)config.sampleRate, (uint16_t)config.channels, config.wavFormat);
+    }
+
+    bool deliver(const float *samples, unsigned long frames) override {
+        return writer.write(samples, frames);
+    }
+
+    void close() override {
+        if (!writer.close()) std::cerr << "flac output: could not finish " << config.path << std::endl;
+    }
+
+    const char *name() const override { return "flac"; }
+};
+
+struct PipeBackend : ThreadedBackend {
+    FILE *out = nullptr;
+    bool ownsFile = false;
+    AlignedBuffer<int16_t> s16;
+    DitherState dither;
+
+    using ThreadedBackend::ThreadedBackend;
+    ~PipeBackend() override { stop(); }
+
+    bool open() override {
+        if (config.path.empty() || config.path == "-") {
+            out = stdout;
+            ownsFile = false;
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        } else {
+            // Opening a FIFO blocks until a reader attaches, which is what we want
+            out = std::fopen(config.path.c_str(), "wb");
+            ownsFile = true;
+        }
+        dither = DitherState(config.dither, config.channels);
+        return out != nullptr;
+    }
+
+    bool deliver(const float *samples, unsigned long frames) override {
+        const size_t count = (size_t)frames * (size_t)config.channels;
+        size_t written;
+        if (config.pipeFormat == PipeSampleFormat::S16) {
+            s16.reserve(count);
+            convertFloatToInt16(samples, s16.data(), count, dither);
+            written = std::fwrite(s16.data(), sizeof(int16_t), count, out);
+        } else {
+            written = std::fwrite(samples, sizeof(float), count, out);
+        }
+        // Reader went away (EPIPE) or disk full: end the stream
+        return written == count && std::fflush(out) == 0;
+    }
+
+    void close() override {
+        if (out && ownsFile) std::fclose(out);
+        else if (out) std::fflush(out);
+        out = nullptr;
+    }
+
+    const char *name() const override { return "pipe"; }
+};
+
+} // namespace
+
+std::unique_ptr<OutputBackend> createOutputBackend(const OutputConfig &config, CallbackData *cb) {
+    switch (config.type) {
+    case OutputBackendType::PortAudio:
+#ifdef WALKK_HAVE_PORTAUDIO
+        return std::make_unique<PortAudioBackend>(config, cb);
+#else
+        return nullptr;
+#endif
+    case OutputBackendType::Null:
+        return std::make_unique<NullBackend>(config, cb);
+    case OutputBackendType::WavFile:
+        return std::make_unique<WavFileBackend>(config, cb);
+    case OutputBackendType::FlacFile:
+        return std::make_unique<FlacFileBackend>(config, cb);
+    case OutputBackendType::Pipe:
+        return std::make_unique<PipeBackend>(config, cb);
+    }
+    return nullptr;
+}
+
+AudioSystemSession::AudioSystemSession() {
+#ifdef WALKK_HAVE_PORTAUDIO
+    error = acquirePortAudio();
+#endif
+}
+
+AudioSystemSession::~AudioSystemSession() {
+#ifdef WALKK_HAVE_PORTAUDIO
+    if (error == paNoError) releasePortAudio();
+#endif
+}
+
+#ifndef WALKK_HAVE_PORTAUDIO
+std::vector<AudioDeviceInfo> listOutputDevices() {
+    return {};
+}
+#endif
+
+bool parseOutputBackendType(const std::string &text, OutputBackendType &type) {
+    if (text == "portaudio" || text == "pa") type = OutputBackendType::PortAudio;
+    else if (text == "null") type = OutputBackendType::Null;
+    else if (text == "wav") type = OutputBackendType::WavFile;
+    else if (text == "flac") type = OutputBackendType::FlacFile;
+    else if (text == "pipe") type = OutputBackendType::Pipe;
+    else return false;
+    return true;
+}
+
+bool outputWritesToStdout(const OutputConfig &config) {
+    return config.type == OutputBackendType::Pipe && (config.path.empty() || config.path == "-");
+}
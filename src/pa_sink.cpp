@@ -1,17 +1,25 @@
 #include <algorithm>
-
-#include <portaudio.h>
+#include <cctype>
+#include <chrono>
+#include <string>
 
 #include "pa_sink.h"
+#include "rt_check.h"
 #include "walkk.h"
+#include "trace.h"
 
 size_t AudioSink::pop(float *out, size_t maxSamples) {
-	std::lock_guard<std::mutex> lock(mutex);
-	size_t available = queue.size();
-	size_t toCopy = std::min(maxSamples, available);
-	for (size_t i = 0; i < toCopy; i++) {
-		out[i] = queue.front();
-		queue.pop_front();
+	size_t toCopy;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t available = queue.size();
+		toCopy = std::min(maxSamples, available);
+		std::copy_n(queue.begin(), toCopy, out);
+		queue.erase(queue.begin(), queue.begin() + (std::ptrdiff_t)toCopy);
+		queued.store(queue.size());
+	}
+	if (toCopy > 0) {
+		signalSpace();
 	}
 	return toCopy;
 }
@@ -20,17 +28,145 @@ size_t AudioSink::push(const float *in, size_t numSamples) {
 	std::lock_guard<std::mutex> lock(mutex);
 	size_t space = (capacity > queue.size()) ? (capacity - queue.size()) : 0;
 	size_t toCopy = std::min(numSamples, space);
-	for (size_t i = 0; i < toCopy; i++) {
-		queue.push_back(in[i]);
-	}
+	queue.insert(queue.end(), in, in + toCopy);
+	queued.store(queue.size());
 	return toCopy;
 }
 
 size_t AudioSink::getQueuedSamples() {
+	return queued.load();
+}
+
+void AudioSink::clear() {
 	std::lock_guard<std::mutex> lock(mutex);
-	return queue.size();
+	queue.clear();
+	queued.store(0);
 }
 
+// Consumer side: post once when the free space reaches what the producer asked for.
+// Claiming the threshold first guarantees a single release per wait, so the
+// binary semaphore never overflows. Called from the audio callback, so no locks.
+void AudioSink::signalSpace() {
+	size_t threshold = wakeThreshold.load();
+	if (threshold == kNotWaiting) return;
+	if (freeSpace() >= threshold && wakeThreshold.compare_exchange_strong(threshold, kNotWaiting)) {
+		spaceAvailable.release();
+	}
+}
+
+void AudioSink::wakeProducer() {
+	size_t threshold = wakeThreshold.load();
+	if (threshold != kNotWaiting && wakeThreshold.compare_exchange_strong(threshold, kNotWaiting)) {
+		spaceAvailable.release();
+	}
+}
+
+// Producer side: withdraw a pending wait. If the consumer already claimed it, its
+// release is on the way and has to be consumed to keep the semaphore balanced.
+bool AudioSink::disarmWait() {
+	size_t threshold = wakeThreshold.load();
+	if (threshold != kNotWaiting && wakeThreshold.compare_exchange_strong(threshold, kNotWaiting)) {
+		return true;
+	}
+	spaceAvailable.acquire();
+	return false;
+}
+
+size_t AudioSink::freeSpace() const {
+	size_t limit = std::min(capacity, targetDepth.load());
+	size_t used = queued.load();
+	return limit > used ? limit - used : 0;
+}
+
+bool AudioSink::waitForSpace(size_t samples, const std::atomic<bool> &stop) {
+	// A block larger than the target depth goes in once the queue has drained below it
+	auto needed = [&]() { return std::min(samples, std::min(capacity, targetDepth.load())); };
+	if (freeSpace() >= needed()) return true;
+
+	auto idleStart = std::chrono::steady_clock::now();
+	bool ready = false;
+	while (!stop.load()) {
+		// Arm, then re-check: a pop that finished before arming would never post
+		wakeThreshold.store(needed());
+		if (freeSpace() >= needed()) {
+			disarmWait();
+			ready = true;
+			break;
+		}
+		// The timeout only covers a consumer that went away (stream stopped) without posting
+		if (!spaceAvailable.try_acquire_for(std::chrono::milliseconds(50))) {
+			disarmWait();
+		}
+		producerWakeups.fetch_add(1, std::memory_order_relaxed);
+		if (freeSpace() >= needed()) {
+			ready = true;
+			break;
+		}
+	}
+	auto idle = std::chrono::steady_clock::now() - idleStart;
+	producerIdleNs.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(idle).count(),
+							 std::memory_order_relaxed);
+	return ready;
+}
+
+bool renderOutputBuffer(CallbackData *cb, float *out, unsigned long frames, double dacDelaySeconds,
+						uint32_t statusFlags) {
+	// RT scope first: it outlives the trace zone, so the zone's teardown is checked too
+	WALKK_RT_SCOPE("output buffer");
+	WALKK_TRACE_ZONE("output buffer");
+	const auto startTime = std::chrono::steady_clock::now();
+
+	size_t samplesNeeded = frames * (unsigned long)cb->channels;
+	size_t copied = cb->sink->pop(out, samplesNeeded);
+	for (size_t i = copied; i < samplesNeeded; i++) {
+		out[i] = 0.0f;
+	}
+
+	if (copied == 0 && cb->sink->finished.load()) {
+		return false;
+	}
+
+	if (!cb->walkk) {
+		return true;
+	}
+	Walkk *walkk = cb->walkk;
+
+	// Shortfalls only count once audio has started flowing (not the pre-roll)
+	const bool started = walkk->clock.framesConsumed.load() > 0;
+	const bool finished = walkk->sink.finished.load();
+
+	// Ran dry after audio had started: note it without leaving the callback's budget
+	if (copied < samplesNeeded && !finished && started) {
+		EventRecord ev;
+		ev.type = EventType::Underrun;
+		ev.a = walkk->clock.framesConsumed.load() + copied / cb->channels;
+		ev.d = (uint32_t)((samplesNeeded - copied) / cb->channels);
+		walkk->events.push(ev);
+	}
+	if (walkk->archive.isActive()) {
+		walkk->archive.capture(out, copied / cb->channels, walkk->clock.framesConsumed.load());
+	}
+	if (walkk->retro.isEnabled()) {
+		walkk->retro.capture(out, copied / cb->channels);
+	}
+	walkk->clock.advance(frames, copied / cb->channels, dacDelaySeconds);
+
+	if (walkk->isRecording.load()) {
+		size_t framesCopied = copied / cb->channels;
+		walkk->writeRecordingData(out, framesCopied);
+	}
+
+	auto toNs = [](std::chrono::steady_clock::time_point t) {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+	};
+	walkk->health.recordBuffer(toNs(startTime), toNs(std::chrono::steady_clock::now()),
+							   (double)frames / Walkk::kSampleRate, statusFlags,
+							   copied / cb->channels, frames, started && !finished);
+
+	return true;
+}
+
+#ifdef WALKK_HAVE_PORTAUDIO
 static int paCallback(const void *inputBuffer, void *outputBuffer,
 						unsigned long framesPerBuffer,
 						const PaStreamCallbackTimeInfo* timeInfo,
@@ -38,66 +174,172 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
 						void *userData)
 {
 	(void)inputBuffer;
-	(void)timeInfo;
-	(void)statusFlags;
 
 	CallbackData *cb = (CallbackData*)userData;
-	float *out = (float*)outputBuffer;
+	traceAttachThread(cb->traceBuffer);
 
-	size_t samplesNeeded = framesPerBuffer * (unsigned long)cb->channels;
-	size_t copied = cb->sink->pop(out, samplesNeeded);
-	for (size_t i = copied; i < samplesNeeded; i++) {
-		out[i] = 0.0f;
+	uint32_t flags = 0;
+	if (statusFlags & paOutputUnderflow) flags |= kStatusOutputUnderflow;
+	if (statusFlags & paOutputOverflow) flags |= kStatusOutputOverflow;
+	if (statusFlags & paPrimingOutput) flags |= kStatusPrimingOutput;
+
+	// Prefer the host's DAC timestamp; some hosts leave it at zero
+	double dacDelay = cb->outputLatency;
+	if (timeInfo && timeInfo->outputBufferDacTime > 0.0 && timeInfo->currentTime > 0.0) {
+		dacDelay = timeInfo->outputBufferDacTime - timeInfo->currentTime;
 	}
+	return renderOutputBuffer(cb, (float*)outputBuffer, framesPerBuffer, dacDelay, flags) ? paContinue : paComplete;
+}
 
-	if (copied == 0 && cb->sink->finished.load()) {
-		return paComplete;
+static std::mutex g_paSessionMutex;
+static int g_paSessionRefs = 0;
+
+PaError acquirePortAudio() {
+	std::lock_guard<std::mutex> lock(g_paSessionMutex);
+	if (g_paSessionRefs == 0) {
+		PaError err = Pa_Initialize();
+		if (err != paNoError) {
+			return err;
+		}
 	}
+	g_paSessionRefs++;
+	return paNoError;
+}
 
-	// Check if we need to record this data
-	// We need to access the Walkk instance somehow. For now, we'll assume
-	// the CallbackData has a pointer to Walkk, but we need to modify the struct
-	if (cb->walkk && cb->walkk->isRecording.load()) {
-		size_t framesCopied = copied / cb->channels;
-		cb->walkk->writeRecordingData(out, framesCopied);
+void releasePortAudio() {
+	std::lock_guard<std::mutex> lock(g_paSessionMutex);
+	if (g_paSessionRefs > 0 && --g_paSessionRefs == 0) {
+		Pa_Terminate();
+	}
+}
+
+static bool containsNoCase(const char *haystack, const std::string &needle) {
+	if (!haystack) return false;
+	std::string h(haystack), n(needle);
+	auto lower = [](unsigned char c) { return (char)std::tolower(c); };
+	std::transform(h.begin(), h.end(), h.begin(), lower);
+	std::transform(n.begin(), n.end(), n.begin(), lower);
+	return h.find(n) != std::string::npos;
+}
+
+// Resolve host API / device index / device name to a concrete output device
+static PaDeviceIndex resolveOutputDevice(const AudioDeviceSettings &settings, int channels) {
+	PaHostApiIndex api = -1;
+	if (!settings.hostApi.empty()) {
+		for (PaHostApiIndex i = 0; i < Pa_GetHostApiCount(); i++) {
+			const PaHostApiInfo *info = Pa_GetHostApiInfo(i);
+			if (info && containsNoCase(info->name, settings.hostApi)) {
+				api = i;
+				break;
+			}
+		}
+		if (api < 0) return paNoDevice;
 	}
 
-	return paContinue;
+	auto usable = [&](PaDeviceIndex d) {
+		const PaDeviceInfo *info = Pa_GetDeviceInfo(d);
+		return info && info->maxOutputChannels >= channels && (api < 0 || info->hostApi == api);
+	};
+
+	if (settings.deviceIndex >= 0) {
+		return usable(settings.deviceIndex) ? settings.deviceIndex : paNoDevice;
+	}
+	if (!settings.deviceName.empty()) {
+		for (PaDeviceIndex d = 0; d < Pa_GetDeviceCount(); d++) {
+			if (usable(d) && containsNoCase(Pa_GetDeviceInfo(d)->name, settings.deviceName)) {
+				return d;
+			}
+		}
+		return paNoDevice;
+	}
+	if (api >= 0) {
+		return Pa_GetHostApiInfo(api)->defaultOutputDevice;
+	}
+	return Pa_GetDefaultOutputDevice();
 }
 
-int openAndStartStream(PaStream **stream, CallbackData *cb, int channels, int sampleRate, unsigned long framesPerBuffer) {
-	PaError err = Pa_Initialize();
+int openAndStartStream(PaStream **stream, CallbackData *cb, int channels, int sampleRate,
+					unsigned long framesPerBuffer, const AudioDeviceSettings &device) {
+	// Normally a no-op refcount bump: the application holds an AudioSystemSession
+	PaError err = acquirePortAudio();
 	if (err != paNoError) {
 		return err;
 	}
 
-	err = Pa_OpenDefaultStream(stream,
-					0,
-					channels,
-					paFloat32,
+	PaDeviceIndex index = resolveOutputDevice(device, channels);
+	const PaDeviceInfo *info = (index == paNoDevice) ? nullptr : Pa_GetDeviceInfo(index);
+	if (!info) {
+		releasePortAudio();
+		return paInvalidDevice;
+	}
+
+	PaStreamParameters out{};
+	out.device = index;
+	out.channelCount = channels;
+	out.sampleFormat = paFloat32;
+	out.suggestedLatency = device.suggestedLatency > 0.0 ? device.suggestedLatency : info->defaultLowOutputLatency;
+	out.hostApiSpecificStreamInfo = nullptr;
+
+	// Claimed here so the callback never locks or allocates for its trace zones
+	cb->traceBuffer = traceReserveThread("portaudio callback");
+
+	err = Pa_OpenStream(stream,
+					nullptr,
+					&out,
 					sampleRate,
 					framesPerBuffer,
+					paNoFlag,
 					paCallback,
 					cb);
 	if (err != paNoError) {
-		Pa_Terminate();
+		traceReleaseThread(cb->traceBuffer);
+		cb->traceBuffer = nullptr;
+		releasePortAudio();
 		return err;
 	}
 
 	err = Pa_StartStream(*stream);
 	if (err != paNoError) {
 		Pa_CloseStream(*stream);
-		Pa_Terminate();
+		traceReleaseThread(cb->traceBuffer);
+		cb->traceBuffer = nullptr;
+		releasePortAudio();
 		return err;
 	}
 	return paNoError;
 }
 
-void stopAndCloseStream(PaStream *stream) {
+void stopAndCloseStream(PaStream *stream, CallbackData *cb) {
 	if (!stream) return;
 	Pa_StopStream(stream);
 	Pa_CloseStream(stream);
-	Pa_Terminate();
+	// No callback runs past Pa_StopStream
+	traceReleaseThread(cb->traceBuffer);
+	cb->traceBuffer = nullptr;
+	releasePortAudio();
 }
 
-
+std::vector<AudioDeviceInfo> listOutputDevices() {
+	std::vector<AudioDeviceInfo> devices;
+	if (acquirePortAudio() != paNoError) {
+		return devices;
+	}
+	for (PaDeviceIndex d = 0; d < Pa_GetDeviceCount(); d++) {
+		const PaDeviceInfo *info = Pa_GetDeviceInfo(d);
+		if (!info || info->maxOutputChannels <= 0) continue;
+		const PaHostApiInfo *api = Pa_GetHostApiInfo(info->hostApi);
+		AudioDeviceInfo dev;
+		dev.index = d;
+		dev.name = info->name ? info->name : "";
+		dev.hostApi = (api && api->name) ? api->name : "";
+		dev.maxOutputChannels = info->maxOutputChannels;
+		dev.defaultLowLatency = info->defaultLowOutputLatency;
+		dev.defaultHighLatency = info->defaultHighOutputLatency;
+		dev.defaultSampleRate = info->defaultSampleRate;
+		dev.isDefault = (d == Pa_GetDefaultOutputDevice());
+		devices.push_back(dev);
+	}
+	releasePortAudio();
+	return devices;
+}
+#endif
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <vector>
+
+#include "retro_capture.h"
+#include "wav_writer.h"
+
+namespace fs = std::filesystem;
+
+RetroCapture::~RetroCapture() {
+    ring.close();
+    if (saver.joinable()) saver.join();
+}
+
+bool RetroCapture::configure(double megabytes, int rate, int numChannels, DitherMode ditherMode) {
+    if (saving.load()) return false;
+    if (saver.joinable()) saver.join();
+
+    ring.close();
+    ring.release();
+    if (megabytes <= 0.0 || rate <= 0 || numChannels <= 0) return true;
+
+    sampleRate = rate;
+    channels = numChannels;
+    guardSamples = (size_t)sampleRate * (size_t)channels;
+    const size_t budget = (size_t)(megabytes * 1024.0 * 1024.0) / sizeof(int16_t);
+    size_t capacity = std::max(budget, guardSamples * 2);
+    capacity -= capacity % (size_t)channels;
+    ring.allocate(capacity);
+    dither = DitherState(ditherMode, channels);
+    ring.open();
+    return true;
+}
+
+void RetroCapture::capture(const float *samples, size_t frames) {
+    CaptureRing<int16_t>::Scope scope(ring);
+    if (!scope || frames == 0) return;
+
+    ring.pushWith(frames * (size_t)channels, [&](int16_t *dst, size_t offset, size_t n) {
+        convertFloatToInt16(samples + offset, dst, n, dither);
+    });
+}
+
+double RetroCapture::capacitySeconds() const {
+    if (ring.capacity() == 0) return 0.0;
+    return (double)(ring.capacity() - guardSamples) / ((double)sampleRate * channels);
+}
+
+double RetroCapture::bufferedSeconds() const {
+    if (ring.capacity() == 0) return 0.0;
+    const uint64_t held = std::min<uint64_t>(ring.written(), ring.capacity() - guardSamples);
+    return (double)held / ((double)sampleRate * channels);
+}
+
+bool RetroCapture::save(const std::string &path, double seconds, std::string &error) {
+    if (!ring.isOpen()) {
+        error = "retro capture is off";
+        return false;
+    }
+    if (saving.exchange(true)) {
+        error = "a save is already running";
+        return false;
+    }
+    if (saver.joinable()) saver.join();
+
+    const uint64_t end = ring.written();
+    uint64_t held = std::min<uint64_t>(end, ring.capacity() - guardSamples);
+    if (seconds > 0.0) held = std::min<uint64_t>(held, (uint64_t)(seconds * sampleRate) * (uint64_t)channels);
+    if (held == 0) {
+        saving.store(false);
+        error = "nothing captured yet";
+        return false;
+    }
+    saver = std::thread([this, path, begin = end - held, end]() { writeSave(path, begin, end); });
+    return true;
+}
+
+RetroCapture::SaveResult RetroCapture::lastSave() {
+    std::lock_guard<std::mutex> lock(resultMutex);
+    return result;
+}
+
+// Oldest first: the output only overwrites behind us, and a disk slower than real time
+// is the only way it can catch up
+void RetroCapture::writeSave(std::string path, uint64_t begin, uint64_t end) {
+    SaveResult r;
+    r.path = path;
+
+    WavFileWriter writer;
+    writer.checkpointSeconds = 0.0;
+    if (!writer.open(path, (uint32_t)sampleRate, (uint16_t)channels, WavSampleFormat::Int16)) {
+        r.error = "cannot create " + path;
+    } else {
+        std::vector<int16_t> chunk((size_t)sampleRate * (size_t)channels);
+        bool ok = true;
+        for (uint64_t pos = begin; pos < end && ok;) {
+            const size_t count = (size_t)std::min<uint64_t>(chunk.size(), end - pos);
+            ring.copy(pos, chunk.data(), count);
+
+            // Still intact after the copy?
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (ring.written() + guardSamples > pos + ring.capacity()) {
+                r.error = "output overtook the save";
+                break;
+            }
+            ok = writer.writeEncoded(chunk.data(), count / (size_t)channels);
+            if (!ok) r.error = "write failed";
+            else pos += count;
+            r.seconds = (double)(pos - begin) / ((double)sampleRate * channels);
+        }
+        if (!writer.close() && r.error.empty()) r.error = "write failed";
+        r.ok = r.error.empty();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        r.number = result.number + 1;
+        result = r;
+    }
+    saving.store(false);
+}
+
+std::string RetroCapture::timestampedPath(const std::string &directory) {
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    char name[48];
+    std::strftime(name, sizeof(name), "walkk_retro_%Y%m%d-%H%M%S.wav", &local);
+    return (fs::path(directory.empty() ? "." : directory) / name).string();
+}
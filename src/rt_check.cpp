@@ -0,0 +1,579 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "rt_check.h"
+
+#ifdef WALKK_RT_CHECKS
+#if defined(__GLIBC__)
+#define WALKK_RT_INTERPOSE 1
+#include <pthread.h>
+#include <semaphore.h>
+#include <poll.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#if defined(__GLIBC__) || defined(__APPLE__)
+#define WALKK_RT_BACKTRACE 1
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#endif
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#endif
+#endif
+
+const char *rtViolationKindName(RtViolationKind kind) {
+    switch (kind) {
+    case RtViolationKind::Allocation: return "allocation";
+    case RtViolationKind::Free: return "free";
+    case RtViolationKind::Lock: return "lock";
+    case RtViolationKind::Wait: return "wait";
+    case RtViolationKind::Blocking: return "blocking";
+    case RtViolationKind::kCount: break;
+    }
+    return "?";
+}
+
+#ifdef WALKK_RT_CHECKS
+
+// The hooks run inside malloc, so thread state must never need a lazy TLS allocation
+#if defined(__GNUC__)
+#define WALKK_RT_TLS static thread_local __attribute__((tls_model("initial-exec")))
+#else
+#define WALKK_RT_TLS static thread_local
+#endif
+
+#if defined(__GNUC__)
+#define WALKK_RT_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define WALKK_RT_NOINLINE __declspec(noinline)
+#else
+#define WALKK_RT_NOINLINE
+#endif
+
+#ifdef WALKK_RT_INTERPOSE
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+#endif
+
+namespace {
+
+constexpr int kMaxFrames = 16;
+constexpr int kSkipFrames = 2; // record() and the hook that called it
+constexpr int kSlots = 256;
+
+// Distinct stacks, claimed lock-free by the thread that first hits them
+struct Slot {
+    std::atomic<int> state{0}; // 0 empty, 1 being filled, 2 ready
+    uint64_t hash = 0;
+    RtViolationKind kind = RtViolationKind::Allocation;
+    const char *call = nullptr;
+    const char *scope = nullptr;
+    int depth = 0;
+    void *frames[kMaxFrames] = {};
+    std::atomic<uint64_t> count{0};
+};
+
+Slot slots[kSlots];
+std::atomic<uint64_t> totals[(int)RtViolationKind::kCount];
+std::atomic<uint64_t> distinct{0};
+std::atomic<uint64_t> dropped{0};
+
+WALKK_RT_TLS const char *tlsScope = nullptr; // innermost RtScope label, null off the RT path
+WALKK_RT_TLS int tlsAllow = 0;
+WALKK_RT_TLS int tlsInHook = 0;
+
+int captureStack(void **frames, int maxFrames) {
+#if defined(WALKK_RT_BACKTRACE)
+    return backtrace(frames, maxFrames);
+#elif defined(_WIN32)
+    return (int)CaptureStackBackTrace(0, (DWORD)maxFrames, frames, nullptr);
+#else
+    (void)frames;
+    (void)maxFrames;
+    return 0;
+#endif
+}
+
+// backtrace() loads the unwinder (and allocates) on its first call; get that over with at startup
+struct PrimeUnwinder {
+    PrimeUnwinder() {
+        void *frames[2];
+        captureStack(frames, 2);
+    }
+} primeUnwinder;
+
+WALKK_RT_NOINLINE void record(RtViolationKind kind, const char *call) {
+    if (!tlsScope || tlsAllow > 0 || tlsInHook > 0) return;
+    tlsInHook++;
+    totals[(int)kind].fetch_add(1, std::memory_order_relaxed);
+
+    void *frames[kMaxFrames + kSkipFrames];
+    int depth = captureStack(frames, kMaxFrames + kSkipFrames);
+    int skip = depth > kSkipFrames ? kSkipFrames : 0;
+    depth -= skip;
+
+    // FNV-1a over what makes a violation distinct
+    uint64_t hash = 1469598103934665603ull;
+    auto mix = [&hash](uint64_t v) {
+        hash ^= v;
+        hash *= 1099511628211ull;
+    };
+    mix((uint64_t)kind);
+    mix((uint64_t)(uintptr_t)call);
+    for (int i = 0; i < depth; i++) mix((uint64_t)(uintptr_t)frames[skip + i]);
+
+    bool stored = false;
+    for (int probe = 0; probe < kSlots && !stored; probe++) {
+        Slot &slot = slots[(hash + (uint64_t)probe) % kSlots];
+        int state = slot.state.load(std::memory_order_acquire);
+        if (state == 0 && slot.state.compare_exchange_strong(state, 1, std::memory_order_acquire)) {
+            slot.hash = hash;
+            slot.kind = kind;
+            slot.call = call;
+            slot.scope = tlsScope;
+            slot.depth = depth;
+            for (int i = 0; i < depth; i++) slot.frames[i] = frames[skip + i];
+            slot.count.store(1, std::memory_order_relaxed);
+            slot.state.store(2, std::memory_order_release);
+            distinct.fetch_add(1, std::memory_order_relaxed);
+            stored = true;
+        } else if (state == 2 && slot.hash == hash) {
+            slot.count.fetch_add(1, std::memory_order_relaxed);
+            stored = true;
+        }
+    }
+    if (!stored) dropped.fetch_add(1, std::memory_order_relaxed);
+    tlsInHook--;
+}
+
+std::string symbolize(void *address) {
+    char line[512];
+#ifdef WALKK_RT_BACKTRACE
+    Dl_info info;
+    if (dladdr(address, &info)) {
+        const char *module = info.dli_fname ? info.dli_fname : "?";
+        if (info.dli_sname) {
+            int status = 0;
+            char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            std::snprintf(line, sizeof(line), "%s+0x%zx (%s)", status == 0 && demangled ? demangled : info.dli_sname,
+                          (size_t)((char *)address - (char *)info.dli_saddr), module);
+            std::free(demangled);
+            return line;
+        }
+        std::snprintf(line, sizeof(line), "%s+0x%zx", module, (size_t)((char *)address - (char *)info.dli_fbase));
+        return line;
+    }
+#endif
+    std::snprintf(line, sizeof(line), "%p", address);
+    return line;
+}
+
+void *rawMalloc(size_t size) {
+#ifdef WALKK_RT_INTERPOSE
+    return __libc_malloc(size ? size : 1);
+#else
+    return std::malloc(size ? size : 1);
+#endif
+}
+
+void rawFree(void *ptr) {
+#ifdef WALKK_RT_INTERPOSE
+    __libc_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void *rawAlignedAlloc(size_t size, size_t alignment) {
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, alignment);
+#else
+    void *ptr = nullptr;
+    if (alignment < sizeof(void *)) alignment = sizeof(void *);
+    return posix_memalign(&ptr, alignment, size ? size : 1) == 0 ? ptr : nullptr;
+#endif
+}
+
+void rawAlignedFree(void *ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    rawFree(ptr);
+#endif
+}
+
+void *checkedNew(size_t size, const char *call) {
+    record(RtViolationKind::Allocation, call);
+    void *ptr = rawMalloc(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *checkedAlignedNew(size_t size, std::align_val_t alignment, const char *call) {
+    record(RtViolationKind::Allocation, call);
+    void *ptr = rawAlignedAlloc(size, (size_t)alignment);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void checkedDelete(void *ptr, const char *call) {
+    if (!ptr) return;
+    record(RtViolationKind::Free, call);
+    rawFree(ptr);
+}
+
+void checkedAlignedDelete(void *ptr, const char *call) {
+    if (!ptr) return;
+    record(RtViolationKind::Free, call);
+    rawAlignedFree(ptr);
+}
+
+#ifdef WALKK_RT_INTERPOSE
+// The next definition of `name` after ours (normally libc's)
+void *resolve(std::atomic<void *> &cache, const char *name, const char *version = nullptr) {
+    void *fn = cache.load(std::memory_order_relaxed);
+    if (!fn) {
+        // pthread_cond_* exist in two ABI versions and plain dlsym can hand back the old one
+        if (version) fn = dlvsym(RTLD_NEXT, name, version);
+        if (!fn) fn = dlsym(RTLD_NEXT, name);
+        cache.store(fn, std::memory_order_relaxed);
+    }
+    return fn;
+}
+
+#if defined(__x86_64__)
+constexpr const char *kCondVersion = "GLIBC_2.3.2";
+#else
+constexpr const char *kCondVersion = nullptr;
+#endif
+#endif
+
+} // namespace
+
+bool rtChecksCompiledIn() {
+    return true;
+}
+
+bool rtIsRealtimeThread() {
+    return tlsScope != nullptr;
+}
+
+RtScope::RtScope(const char *label) : previous(tlsScope) {
+    tlsScope = label;
+}
+
+RtScope::~RtScope() {
+    tlsScope = previous;
+}
+
+RtAllowScope::RtAllowScope() {
+    tlsAllow++;
+}
+
+RtAllowScope::~RtAllowScope() {
+    tlsAllow--;
+}
+
+RtCheckStats rtCheckStats() {
+    RtCheckStats stats;
+    for (int i = 0; i < (int)RtViolationKind::kCount; i++) stats.total[i] = totals[i].load(std::memory_order_relaxed);
+    stats.distinct = distinct.load(std::memory_order_relaxed);
+    stats.dropped = dropped.load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::vector<RtViolation> rtCheckViolations() {
+    std::vector<RtViolation> violations;
+    for (Slot &slot : slots) {
+        if (slot.state.load(std::memory_order_acquire) != 2) continue;
+        RtViolation v;
+        v.kind = slot.kind;
+        v.call = slot.call;
+        v.scope = slot.scope ? slot.scope : "";
+        v.count = slot.count.load(std::memory_order_relaxed);
+        for (int i = 0; i < slot.depth; i++) v.stack.push_back(symbolize(slot.frames[i]));
+        violations.push_back(std::move(v));
+    }
+    return violations;
+}
+
+// Only while nothing is inside an RtScope (e.g. between runs)
+void rtCheckReset() {
+    for (Slot &slot : slots) {
+        slot.count.store(0, std::memory_order_relaxed);
+        slot.state.store(0, std::memory_order_release);
+    }
+    for (auto &total : totals) total.store(0, std::memory_order_relaxed);
+    distinct.store(0, std::memory_order_relaxed);
+    dropped.store(0, std::memory_order_relaxed);
+}
+
+// ---- operator new/delete: replaced for the whole program
+
+void *operator new(size_t size) { return checkedNew(size, "operator new"); }
+void *operator new[](size_t size) { return checkedNew(size, "operator new[]"); }
+void *operator new(size_t size, std::align_val_t al) { return checkedAlignedNew(size, al, "operator new"); }
+void *operator new[](size_t size, std::align_val_t al) { return checkedAlignedNew(size, al, "operator new[]"); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    record(RtViolationKind::Allocation, "operator new");
+    return rawMalloc(size);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    record(RtViolationKind::Allocation, "operator new[]");
+    return rawMalloc(size);
+}
+void *operator new(size_t size, std::align_val_t al, const std::nothrow_t &) noexcept {
+    record(RtViolationKind::Allocation, "operator new");
+    return rawAlignedAlloc(size, (size_t)al);
+}
+void *operator new[](size_t size, std::align_val_t al, const std::nothrow_t &) noexcept {
+    record(RtViolationKind::Allocation, "operator new[]");
+    return rawAlignedAlloc(size, (size_t)al);
+}
+
+void operator delete(void *ptr) noexcept { checkedDelete(ptr, "operator delete"); }
+void operator delete[](void *ptr) noexcept { checkedDelete(ptr, "operator delete[]"); }
+void operator delete(void *ptr, size_t) noexcept { checkedDelete(ptr, "operator delete"); }
+void operator delete[](void *ptr, size_t) noexcept { checkedDelete(ptr, "operator delete[]"); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { checkedDelete(ptr, "operator delete"); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { checkedDelete(ptr, "operator delete[]"); }
+void operator delete(void *ptr, std::align_val_t) noexcept { checkedAlignedDelete(ptr, "operator delete"); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { checkedAlignedDelete(ptr, "operator delete[]"); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept { checkedAlignedDelete(ptr, "operator delete"); }
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept { checkedAlignedDelete(ptr, "operator delete[]"); }
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    checkedAlignedDelete(ptr, "operator delete");
+}
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    checkedAlignedDelete(ptr, "operator delete[]");
+}
+
+#ifdef WALKK_RT_INTERPOSE
+// ---- libc: interposed by symbol name, glibc only
+
+extern "C" {
+
+void *malloc(size_t size) noexcept {
+    record(RtViolationKind::Allocation, "malloc");
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+    record(RtViolationKind::Allocation, "calloc");
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+    record(RtViolationKind::Allocation, "realloc");
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) noexcept {
+    if (ptr) record(RtViolationKind::Free, "free");
+    __libc_free(ptr);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) noexcept {
+    using Real = int (*)(pthread_mutex_t *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Lock, "pthread_mutex_lock");
+    return ((Real)resolve(real, "pthread_mutex_lock"))(mutex);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *lock) noexcept {
+    using Real = int (*)(pthread_rwlock_t *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Lock, "pthread_rwlock_rdlock");
+    return ((Real)resolve(real, "pthread_rwlock_rdlock"))(lock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *lock) noexcept {
+    using Real = int (*)(pthread_rwlock_t *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Lock, "pthread_rwlock_wrlock");
+    return ((Real)resolve(real, "pthread_rwlock_wrlock"))(lock);
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+    using Real = int (*)(pthread_cond_t *, pthread_mutex_t *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Wait, "pthread_cond_wait");
+    return ((Real)resolve(real, "pthread_cond_wait", kCondVersion))(cond, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime) {
+    using Real = int (*)(pthread_cond_t *, pthread_mutex_t *, const struct timespec *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Wait, "pthread_cond_timedwait");
+    return ((Real)resolve(real, "pthread_cond_timedwait", kCondVersion))(cond, mutex, abstime);
+}
+
+int sem_wait(sem_t *sem) {
+    using Real = int (*)(sem_t *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Wait, "sem_wait");
+    return ((Real)resolve(real, "sem_wait"))(sem);
+}
+
+int sem_timedwait(sem_t *sem, const struct timespec *abstime) {
+    using Real = int (*)(sem_t *, const struct timespec *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Wait, "sem_timedwait");
+    return ((Real)resolve(real, "sem_timedwait"))(sem, abstime);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    using Real = ssize_t (*)(int, void *, size_t);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "read");
+    return ((Real)resolve(real, "read"))(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    using Real = ssize_t (*)(int, const void *, size_t);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "write");
+    return ((Real)resolve(real, "write"))(fd, buf, count);
+}
+
+int fsync(int fd) {
+    using Real = int (*)(int);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "fsync");
+    return ((Real)resolve(real, "fsync"))(fd);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+    using Real = int (*)(const struct timespec *, struct timespec *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "nanosleep");
+    return ((Real)resolve(real, "nanosleep"))(req, rem);
+}
+
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec *req, struct timespec *rem) {
+    using Real = int (*)(clockid_t, int, const struct timespec *, struct timespec *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "clock_nanosleep");
+    return ((Real)resolve(real, "clock_nanosleep"))(clock, flags, req, rem);
+}
+
+int usleep(useconds_t usec) {
+    using Real = int (*)(useconds_t);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "usleep");
+    return ((Real)resolve(real, "usleep"))(usec);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    using Real = int (*)(struct pollfd *, nfds_t, int);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "poll");
+    return ((Real)resolve(real, "poll"))(fds, nfds, timeout);
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout) {
+    using Real = int (*)(int, fd_set *, fd_set *, fd_set *, struct timeval *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "select");
+    return ((Real)resolve(real, "select"))(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+FILE * fopen(const char *path, const char *mode) {
+    using Real = FILE *(*)(const char *, const char *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "fopen");
+    return ((Real)resolve(real, "fopen"))(path, mode);
+}
+
+size_t fread(void *ptr, size_t size, size_t count, FILE *file) {
+    using Real = size_t (*)(void *, size_t, size_t, FILE *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "fread");
+    return ((Real)resolve(real, "fread"))(ptr, size, count, file);
+}
+
+size_t fwrite(const void *ptr, size_t size, size_t count, FILE *file) {
+    using Real = size_t (*)(const void *, size_t, size_t, FILE *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "fwrite");
+    return ((Real)resolve(real, "fwrite"))(ptr, size, count, file);
+}
+
+int fflush(FILE *file) {
+    using Real = int (*)(FILE *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "fflush");
+    return ((Real)resolve(real, "fflush"))(file);
+}
+
+int fseek(FILE *file, long offset, int whence) {
+    using Real = int (*)(FILE *, long, int);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "fseek");
+    return ((Real)resolve(real, "fseek"))(file, offset, whence);
+}
+
+int fclose(FILE *file) {
+    using Real = int (*)(FILE *);
+    static std::atomic<void *> real{nullptr};
+    record(RtViolationKind::Blocking, "fclose");
+    return ((Real)resolve(real, "fclose"))(file);
+}
+
+} // extern "C"
+#endif
+
+#else
+
+bool rtChecksCompiledIn() {
+    return false;
+}
+
+bool rtIsRealtimeThread() {
+    return false;
+}
+
+RtCheckStats rtCheckStats() {
+    return {};
+}
+
+std::vector<RtViolation> rtCheckViolations() {
+    return {};
+}
+
+void rtCheckReset() {}
+
+#endif
+
+std::string rtCheckReport() {
+    const RtCheckStats stats = rtCheckStats();
+    if (stats.all() == 0) return "";
+
+    std::string report = "Real-time violations:";
+    for (int i = 0; i < (int)RtViolationKind::kCount; i++) {
+        report += (i ? ", " : " ") + std::to_string(stats.total[i]) + " " + rtViolationKindName((RtViolationKind)i);
+    }
+    report += " (" + std::to_string(stats.distinct) + " distinct stacks";
+    if (stats.dropped > 0) report += ", " + std::to_string(stats.dropped) + " not recorded";
+    report += ")\n";
+
+    for (const RtViolation &v : rtCheckViolations()) {
+        report += "[" + std::string(rtViolationKindName(v.kind)) + "] " + v.call + " in \"" + v.scope + "\", " +
+                  std::to_string(v.count) + (v.count == 1 ? " time\n" : " times\n");
+        for (size_t i = 0; i < v.stack.size(); i++) {
+            report += "    #" + std::to_string(i) + " " + v.stack[i] + "\n";
+        }
+    }
+    return report;
+}
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+#include "rt_thread.h"
+
+// Enough for the decoder and mixer call chains; well under the default thread stack
+static constexpr size_t kPrefaultStackBytes = 256 * 1024;
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((noinline))
+#elif defined(_MSC_VER)
+__declspec(noinline)
+#endif
+static void prefaultStack() {
+    volatile unsigned char pages[kPrefaultStackBytes];
+    for (size_t i = 0; i < kPrefaultStackBytes; i += 4096) {
+        pages[i] = 0;
+    }
+    // Read one back so the array is used, not just set
+    volatile unsigned char sink = pages[kPrefaultStackBytes - 4096];
+    (void)sink;
+}
+
+static void appendError(std::string &error, const std::string &what) {
+    if (!error.empty()) error += "; ";
+    error += what;
+}
+
+#ifndef _WIN32
+static std::string errnoText(int err) {
+    std::string text = std::strerror(err);
+    if (err == EPERM) text += " (needs CAP_SYS_NICE or an rtprio/memlock limit)";
+    return text;
+}
+#endif
+
+bool applyThreadTuning(const ThreadTuning &tuning, std::string &error) {
+    error.clear();
+    bool ok = true;
+
+    if (tuning.prefaultStack) {
+        prefaultStack();
+    }
+
+    if (tuning.policy != RtPolicy::Normal) {
+#ifdef _WIN32
+        if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+            appendError(error, "SetThreadPriority failed (" + std::to_string(GetLastError()) + ")");
+            ok = false;
+        }
+#else
+        int policy = tuning.policy == RtPolicy::Fifo ? SCHED_FIFO : SCHED_RR;
+        int priority = tuning.priority > 0 ? tuning.priority : ThreadTuning::kDefaultRtPriority;
+        priority = std::clamp(priority, sched_get_priority_min(policy), sched_get_priority_max(policy));
+        sched_param param{};
+        param.sched_priority = priority;
+        int err = pthread_setschedparam(pthread_self(), policy, &param);
+        if (err != 0) {
+            appendError(error, std::string(rtPolicyName(tuning.policy)) + " priority " +
+                               std::to_string(priority) + ": " + errnoText(err));
+            ok = false;
+        }
+#endif
+    }
+
+    if (tuning.cpu >= 0) {
+#if defined(_WIN32)
+        if (tuning.cpu >= 64 || !SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << tuning.cpu)) {
+            appendError(error, "cpu " + std::to_string(tuning.cpu) + ": SetThreadAffinityMask failed");
+            ok = false;
+        }
+#elif defined(__linux__)
+        int err = EINVAL;
+        if (tuning.cpu < CPU_SETSIZE) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(tuning.cpu, &set);
+            err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+        if (err != 0) {
+            appendError(error, "cpu " + std::to_string(tuning.cpu) + ": " + errnoText(err));
+            ok = false;
+        }
+#else
+        appendError(error, "cpu pinning is not supported on this platform");
+        ok = false;
+#endif
+    }
+
+    return ok;
+}
+
+bool lockProcessMemory(std::string &error) {
+    error.clear();
+#ifdef _WIN32
+    error = "memory locking is not supported on Windows";
+    return false;
+#else
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        error = "mlockall: " + errnoText(errno);
+        return false;
+    }
+    return true;
+#endif
+}
+
+std::string describeThreadTuning(const ThreadTuning &tuning) {
+    std::string text = rtPolicyName(tuning.policy);
+    if (tuning.policy != RtPolicy::Normal) {
+        text += " " + std::to_string(tuning.priority > 0 ? tuning.priority : ThreadTuning::kDefaultRtPriority);
+    }
+    if (tuning.cpu >= 0) text += ", cpu " + std::to_string(tuning.cpu);
+    if (tuning.prefaultStack) text += ", prefaulted stack";
+    return text;
+}
+
+bool parseRtPolicy(const std::string &text, RtPolicy &policy) {
+    if (text == "normal" || text == "other") policy = RtPolicy::Normal;
+    else if (text == "fifo") policy = RtPolicy::Fifo;
+    else if (text == "rr") policy = RtPolicy::RoundRobin;
+    else return false;
+    return true;
+}
+
+const char *rtPolicyName(RtPolicy policy) {
+    switch (policy) {
+    case RtPolicy::Normal:     return "normal";
+    case RtPolicy::Fifo:       return "SCHED_FIFO";
+    case RtPolicy::RoundRobin: return "SCHED_RR";
+    }
+    return "?";
+}
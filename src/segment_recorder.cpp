@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+
+#include "segment_recorder.h"
+
+namespace fs = std::filesystem;
+
+SegmentRecorder::~SegmentRecorder() {
+    stop();
+}
+
+std::string SegmentRecorder::segmentPath(uint64_t number) const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "_%s_%04llu.wav", stamp.c_str(), (unsigned long long)number + 1);
+    return (fs::path(config.directory) / (config.prefix + name)).string();
+}
+
+bool SegmentRecorder::start(const SegmentRecorderConfig &c, int rate, int numChannels, std::string &error) {
+    if (ring.isOpen()) {
+        error = "already recording";
+        return false;
+    }
+    config = c;
+    sampleRate = rate;
+    channels = numChannels;
+
+    std::error_code ec;
+    fs::create_directories(config.directory, ec);
+    if (ec) {
+        error = "cannot create " + config.directory + ": " + ec.message();
+        return false;
+    }
+
+    // Segment length in frames: whichever limit comes first
+    const uint64_t frameBytes = (uint64_t)channels * wavBytesPerSample(config.format);
+    segmentFrames = 0;
+    if (config.segmentSeconds > 0.0) segmentFrames = (uint64_t)(config.segmentSeconds * sampleRate);
+    if (config.segmentMegabytes > 0.0) {
+        uint64_t bySize = (uint64_t)(config.segmentMegabytes * 1024.0 * 1024.0) / frameBytes;
+        segmentFrames = segmentFrames ? std::min(segmentFrames, bySize) : bySize;
+    }
+    if (config.segmentSeconds > 0.0 || config.segmentMegabytes > 0.0) segmentFrames = std::max<uint64_t>(segmentFrames, 1);
+
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y%m%d-%H%M%S", &local);
+    stamp = buf;
+
+    // Capture ring
+    ring.allocate((size_t)(std::max(config.bufferSeconds, 1.0) * sampleRate) * (size_t)channels);
+    markerHead.store(0);
+    markerTail.store(0);
+    pendingSilence = 0;
+    markerNeeded = true;
+
+    framesWritten.store(0);
+    framesDropped.store(0);
+    segmentsWritten.store(0);
+    writeErrors.store(0);
+    segmentNumber = 0;
+    fileFrames = 0;
+    runs.clear();
+    chunk.assign(kBlockBytes / sizeof(float), 0.0f);
+    chunk.resize(chunk.size() - chunk.size() % (size_t)channels);
+    {
+        std::lock_guard<std::mutex> lock(notesMutex);
+        notes.clear();
+    }
+
+    // Open the first files here, so a bad directory is reported to the caller
+    if (!openSegment()) {
+        error = "cannot create " + segmentPath(0);
+        return false;
+    }
+    if (config.index) {
+        std::string indexPath = (fs::path(config.directory) / (config.prefix + "_" + stamp + "_index.csv")).string();
+        indexFile = std::fopen(indexPath.c_str(), "w");
+        if (!indexFile) {
+            segment.close();
+            error = "cannot create " + indexPath;
+            return false;
+        }
+        std::fprintf(indexFile, "segment,offset_seconds,engine_frame,source,source_frame,duration_frames,amplitude\n");
+        std::fflush(indexFile);
+    }
+
+    stopRequested.store(false);
+    ring.open();
+    writer = std::thread([this]() { run(); });
+    return true;
+}
+
+void SegmentRecorder::stop() {
+    if (!ring.isOpen()) return;
+    ring.close();
+    stopRequested.store(true);
+    if (writer.joinable()) writer.join();
+}
+
+void SegmentRecorder::capture(const float *samples, size_t frames, uint64_t engineFrame) {
+    CaptureRing<float>::Scope scope(ring);
+    if (!scope || frames == 0) return;
+
+    if (engineFrame != expectedEngineFrame) markerNeeded = true;
+    expectedEngineFrame = engineFrame + frames;
+
+    const size_t count = frames * (size_t)channels;
+    bool fits = ring.space() >= count;
+
+    if (fits && (markerNeeded || pendingSilence > 0)) {
+        const uint64_t head = markerHead.load(std::memory_order_relaxed);
+        if (head - markerTail.load(std::memory_order_acquire) < kMarkers) {
+            Marker &m = markers[head % kMarkers];
+            m.position = ring.written();
+            m.engineFrame = engineFrame;
+            m.silentFrames = pendingSilence;
+            markerHead.store(head + 1, std::memory_order_release);
+            pendingSilence = 0;
+            markerNeeded = false;
+        } else {
+            fits = false;
+        }
+    }
+
+    // Writer is too far behind: the frames become silence in the file
+    if (!fits) {
+        pendingSilence += frames;
+        framesDropped.fetch_add(frames, std::memory_order_relaxed);
+        return;
+    }
+    ring.push(samples, count);
+}
+
+void SegmentRecorder::noteGrain(uint64_t engineFrame, const std::string &source, uint64_t sourceFrame,
+                                uint32_t durationFrames, float amplitude) {
+    if (!ring.isOpen() || !config.index) return;
+    std::lock_guard<std::mutex> lock(notesMutex);
+    if (notes.size() >= 100000) return; // writer stuck; don't grow without bound
+    notes.push_back({engineFrame, source, sourceFrame, durationFrames, amplitude});
+}
+
+std::string SegmentRecorder::currentSegmentPath() {
+    std::lock_guard<std::mutex> lock(notesMutex);
+    return currentPath;
+}
+
+bool SegmentRecorder::openSegment() {
+    const uint64_t frameBytes = (uint64_t)channels * wavBytesPerSample(config.format);
+    segment.blockBytes = kBlockBytes;
+    segment.dither = config.dither;
+    segment.preallocateBytes = config.preallocate ? segmentFrames * frameBytes : 0;
+    std::string path = segmentPath(segmentNumber);
+    if (!segment.open(path, (uint32_t)sampleRate, (uint16_t)channels, config.format)) return false;
+    std::lock_guard<std::mutex> lock(notesMutex);
+    currentPath = path;
+    return true;
+}
+
+// Split at segment boundaries; the file timeline advances even if a write fails
+void SegmentRecorder::writeFrames(const float *samples, size_t frames) {
+    while (frames > 0) {
+        if (!segment.isOpen() && !openSegment()) writeErrors.fetch_add(1, std::memory_order_relaxed);
+
+        size_t take = frames;
+        if (segmentFrames > 0) take = (size_t)std::min<uint64_t>(frames, segmentFrames - fileFrames % segmentFrames);
+        if (segment.isOpen() && !segment.write(samples, take)) writeErrors.fetch_add(1, std::memory_order_relaxed);
+        samples += take * (size_t)channels;
+        frames -= take;
+        fileFrames += take;
+        framesWritten.fetch_add(take, std::memory_order_relaxed);
+
+        if (segmentFrames > 0 && fileFrames % segmentFrames == 0) {
+            if (segment.isOpen() && !segment.close()) writeErrors.fetch_add(1, std::memory_order_relaxed);
+            segmentsWritten.fetch_add(1, std::memory_order_relaxed);
+            segmentNumber++;
+        }
+    }
+}
+
+// Grains whose start has been written go to the index with their segment and offset
+void SegmentRecorder::writeIndex(bool flushAll) {
+    if (!indexFile) return;
+    std::lock_guard<std::mutex> lock(notesMutex);
+    bool wrote = false;
+    while (!notes.empty()) {
+        const GrainNote &note = notes.front();
+
+        // Latest run at or before the grain (runs restart when the output does)
+        const Run *run = nullptr;
+        for (auto it = runs.rbegin(); it != runs.rend(); ++it) {
+            if (note.engineFrame >= it->engineFrame) {
+                run = &*it;
+                break;
+            }
+        }
+        if (run) {
+            const uint64_t fileFrame = run->fileFrame + (note.engineFrame - run->engineFrame);
+            if (fileFrame >= fileFrames && !flushAll) break; // not recorded yet
+            if (fileFrame < fileFrames) {
+                const uint64_t number = segmentFrames > 0 ? fileFrame / segmentFrames : 0;
+                const uint64_t offset = segmentFrames > 0 ? fileFrame % segmentFrames : fileFrame;
+                std::string source = note.source;
+                for (size_t i = source.find('"'); i != std::string::npos; i = source.find('"', i + 2)) {
+                    source.insert(i, "\"");
+                }
+                std::fprintf(indexFile, "%s,%.6f,%llu,\"%s\",%llu,%u,%.4f\n",
+                             fs::path(segmentPath(number)).filename().string().c_str(), (double)offset / sampleRate,
+                             (unsigned long long)note.engineFrame, source.c_str(),
+                             (unsigned long long)note.sourceFrame, note.durationFrames, note.amplitude);
+                wrote = true;
+            }
+        } else if (!flushAll && runs.empty()) {
+            break; // nothing captured yet
+        }
+        notes.pop_front();
+    }
+    if (wrote) std::fflush(indexFile);
+}
+
+void SegmentRecorder::run() {
+    while (true) {
+        const bool stopping = stopRequested.load();
+
+        // Drain the ring; once stopping, the output has handed over all it will
+        uint64_t r = ring.consumed();
+        while (true) {
+            const uint64_t w = ring.written();
+
+            uint64_t tail = markerTail.load(std::memory_order_relaxed);
+            while (tail < markerHead.load(std::memory_order_acquire) && markers[tail % kMarkers].position <= r) {
+                const Marker &m = markers[tail % kMarkers];
+                for (uint64_t left = m.silentFrames; left > 0;) {
+                    size_t n = (size_t)std::min<uint64_t>(left, chunk.size() / (size_t)channels);
+                    std::fill(chunk.begin(), chunk.begin() + n * (size_t)channels, 0.0f);
+                    writeFrames(chunk.data(), n);
+                    left -= n;
+                }
+                runs.push_back({fileFrames, m.engineFrame});
+                markerTail.store(++tail, std::memory_order_release);
+            }
+            if (r == w) break;
+
+            uint64_t limit = w;
+            if (tail < markerHead.load(std::memory_order_acquire)) {
+                limit = std::min(limit, markers[tail % kMarkers].position);
+            }
+            const size_t count = ring.pop(chunk.data(), chunk.size(), limit);
+            r += count;
+            writeFrames(chunk.data(), count / (size_t)channels);
+        }
+
+        writeIndex(stopping);
+        if (stopping) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    if (segment.isOpen()) {
+        if (!segment.close()) writeErrors.fetch_add(1, std::memory_order_relaxed);
+        segmentsWritten.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (indexFile) {
+        std::fclose(indexFile);
+        indexFile = nullptr;
+    }
+}
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cmath>
+
+#include "sink_depth.h"
+
+// Depth used until the first measurements come in
+static constexpr double kInitialLatency = 0.25;
+
+int LatencyHistogram::binFor(double seconds) {
+    double us = seconds * 1e6;
+    int bin = us > 1.0 ? (int)(kBinsPerOctave * std::log2(us)) : 0;
+    return std::clamp(bin, 0, kBins - 1);
+}
+
+double LatencyHistogram::binUpperEdge(int bin) {
+    return std::exp2((double)(bin + 1) / kBinsPerOctave) * 1e-6;
+}
+
+void LatencyHistogram::add(double seconds) {
+    counts[binFor(seconds)]++;
+    total++;
+}
+
+void LatencyHistogram::clear() {
+    std::fill(std::begin(counts), std::end(counts), 0u);
+    total = 0;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (int i = 0; i < kBins; i++) counts[i] += other.counts[i];
+    total += other.total;
+}
+
+double LatencyHistogram::percentile(double p) const {
+    if (total == 0) return 0.0;
+    uint64_t rank = (uint64_t)std::ceil(std::clamp(p, 0.0, 1.0) * (double)total);
+    uint64_t seen = 0;
+    for (int i = 0; i < kBins; i++) {
+        seen += counts[i];
+        if (seen >= rank && counts[i] > 0) {
+            return binUpperEdge(i);
+        }
+    }
+    return binUpperEdge(kBins - 1);
+}
+
+void SinkDepthController::reset(size_t capacity) {
+    capacityFrames = capacity;
+    lateness.clear();
+    latenessPrev.clear();
+    decode.clear();
+    decodePrev.clear();
+    windowStart = Clock::now();
+    latenessP99.store(0.0);
+    decodeP99.store(0.0);
+    targetFrames.store(clampFrames(kInitialLatency, 0));
+}
+
+void SinkDepthController::addDecode(double seconds) {
+    decode.add(seconds);
+}
+
+// Depth covering `seconds` of stall plus the block being rendered and the one being played
+size_t SinkDepthController::clampFrames(double seconds, size_t blockFrames) const {
+    double lo = minLatency.load() * sampleRate;
+    double hi = std::min(maxLatency.load() * sampleRate, (double)capacityFrames);
+    lo = std::min(lo, hi);
+    double frames = seconds * sampleRate + 2.0 * (double)blockFrames;
+    return (size_t)std::clamp(frames, lo, hi);
+}
+
+bool SinkDepthController::setTarget(size_t frames) {
+    size_t current = targetFrames.load();
+    if (frames == current) return false;
+    lastAdjustFrom.store((double)current / sampleRate);
+    lastAdjustTo.store((double)frames / sampleRate);
+    adjustments.fetch_add(1);
+    targetFrames.store(frames);
+    return true;
+}
+
+bool SinkDepthController::addBlock(double latenessSeconds, size_t blockFrames) {
+    lateness.add(latenessSeconds);
+    size_t target = targetFrames.load();
+
+    // A stall the current depth would not have covered: grow right away
+    size_t needed = clampFrames(latenessSeconds * safetyFactor, blockFrames);
+    if (needed > target) {
+        return setTarget(needed);
+    }
+
+    Clock::time_point now = Clock::now();
+    if (std::chrono::duration<double>(now - windowStart).count() < windowSeconds) {
+        return false;
+    }
+    windowStart = now;
+
+    LatencyHistogram late = lateness, dec = decode;
+    late.merge(latenessPrev);
+    dec.merge(decodePrev);
+    latenessPrev = lateness;
+    decodePrev = decode;
+    lateness.clear();
+    decode.clear();
+
+    double lateP99 = late.percentile(0.99);
+    double decP99 = dec.percentile(0.99);
+    latenessP99.store(lateP99);
+    decodeP99.store(decP99);
+
+    size_t desired = clampFrames(std::max(lateP99, decP99) * safetyFactor, blockFrames);
+    if (desired >= target) {
+        return setTarget(desired);
+    }
+
+    // Shrink part of the way; snap once within a block
+    size_t gap = target - desired;
+    size_t step = gap <= blockFrames ? gap : (size_t)((double)gap * shrinkRate);
+    return setTarget(target - std::max<size_t>(step, 1));
+}
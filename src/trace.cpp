@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "trace.h"
+
+#ifdef WALKK_TRACING
+
+// Single writer (its thread), read concurrently by the exporter. Fields are relaxed
+// atomics so a slot being overwritten mid-export is detected, not undefined.
+struct TraceBuffer {
+    static constexpr size_t kCapacity = 1 << 15; // zones per thread
+
+    struct Entry {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> beginNs{0};
+        std::atomic<uint64_t> endNs{0};
+    };
+
+    uint32_t tid = 0;
+    char threadName[32] = {};
+    bool inUse = false;                 // guarded by the registry mutex
+    std::atomic<uint64_t> written{0};
+    std::unique_ptr<Entry[]> entries{new Entry[kCapacity]};
+};
+
+namespace {
+
+std::atomic<bool> traceEnabled{false};
+
+uint64_t nowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<TraceBuffer>> registry;
+
+// The buffer zones on this thread record into. A plain pointer: reading it never allocates or
+// registers a thread-exit destructor, so it is safe on the audio callback.
+thread_local TraceBuffer *threadBuffer = nullptr;
+
+// A buffer claimed by traceRegisterThread, returned to the pool when the thread exits so
+// threads restarted on every play do not grow the registry
+struct ThreadSlot {
+    TraceBuffer *buffer = nullptr;
+
+    ~ThreadSlot() {
+        if (threadBuffer == buffer) threadBuffer = nullptr;
+        traceReleaseThread(buffer);
+    }
+};
+
+thread_local ThreadSlot threadSlot;
+
+} // namespace
+
+TraceZone::TraceZone(const char *zoneName) : name(zoneName), beginNs(0) {
+    if (threadBuffer && traceEnabled.load(std::memory_order_relaxed)) beginNs = nowNs();
+}
+
+TraceZone::~TraceZone() {
+    TraceBuffer *b = threadBuffer;
+    if (beginNs == 0 || !b) return;
+    const uint64_t endNs = nowNs();
+    const uint64_t index = b->written.load(std::memory_order_relaxed);
+    TraceBuffer::Entry &e = b->entries[index % TraceBuffer::kCapacity];
+    e.name.store(name, std::memory_order_relaxed);
+    e.beginNs.store(beginNs, std::memory_order_relaxed);
+    e.endNs.store(endNs, std::memory_order_relaxed);
+    b->written.store(index + 1, std::memory_order_release);
+}
+
+TraceBuffer *traceReserveThread(const char *name) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    TraceBuffer *buffer = nullptr;
+    for (auto &b : registry) {
+        if (!b->inUse) {
+            buffer = b.get();
+            break;
+        }
+    }
+    if (!buffer) {
+        registry.push_back(std::make_unique<TraceBuffer>());
+        buffer = registry.back().get();
+        buffer->tid = (uint32_t)registry.size();
+    }
+    buffer->inUse = true;
+    buffer->written.store(0, std::memory_order_release);
+    std::snprintf(buffer->threadName, sizeof(buffer->threadName), "%s", name);
+    return buffer;
+}
+
+void traceAttachThread(TraceBuffer *buffer) {
+    threadBuffer = buffer;
+}
+
+void traceReleaseThread(TraceBuffer *buffer) {
+    if (!buffer) return;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buffer->inUse = false;
+}
+
+void traceRegisterThread(const char *name) {
+    if (threadSlot.buffer) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        std::snprintf(threadSlot.buffer->threadName, sizeof(threadSlot.buffer->threadName), "%s", name);
+    } else {
+        threadSlot.buffer = traceReserveThread(name);
+    }
+    threadBuffer = threadSlot.buffer;
+}
+
+void traceSetEnabled(bool enabled) {
+    traceEnabled.store(enabled);
+}
+
+bool traceIsEnabled() {
+    return traceEnabled.load();
+}
+
+bool traceWriteChromeJson(const std::string &path, double lastSeconds) {
+    struct Zone {
+        const char *name;
+        uint64_t beginNs, endNs;
+        uint32_t tid;
+    };
+    std::vector<Zone> zones;
+    std::vector<std::pair<uint32_t, std::string>> threads;
+
+    const uint64_t now = nowNs();
+    const uint64_t cutoff = lastSeconds > 0.0 ? now - std::min<uint64_t>(now, (uint64_t)(lastSeconds * 1e9)) : 0;
+
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (auto &b : registry) {
+            threads.emplace_back(b->tid, b->threadName);
+            const uint64_t end = b->written.load(std::memory_order_acquire);
+            const uint64_t begin = end > TraceBuffer::kCapacity ? end - TraceBuffer::kCapacity : 0;
+            std::vector<Zone> copied;
+            copied.reserve((size_t)(end - begin));
+            for (uint64_t i = begin; i < end; i++) {
+                const TraceBuffer::Entry &e = b->entries[i % TraceBuffer::kCapacity];
+                copied.push_back({e.name.load(std::memory_order_relaxed), e.beginNs.load(std::memory_order_relaxed),
+                                  e.endNs.load(std::memory_order_relaxed), b->tid});
+            }
+            // Skip whatever the writer lapped while we copied
+            const uint64_t after = b->written.load(std::memory_order_acquire);
+            const uint64_t valid = after > TraceBuffer::kCapacity ? after - TraceBuffer::kCapacity : 0;
+            for (uint64_t i = std::max(begin, valid); i < end; i++) {
+                const Zone &z = copied[(size_t)(i - begin)];
+                if (z.name && z.endNs >= cutoff) zones.push_back(z);
+            }
+        }
+    }
+
+    FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) return false;
+
+    uint64_t origin = now;
+    for (const Zone &z : zones) origin = std::min(origin, z.beginNs);
+
+    std::fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const auto &t : threads) {
+        std::fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                     first ? "" : ",\n", t.first, t.second.c_str());
+        first = false;
+    }
+    for (const Zone &z : zones) {
+        std::fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                     first ? "" : ",\n", z.name, z.tid,
+                     (double)(z.beginNs - origin) / 1000.0, (double)(z.endNs - z.beginNs) / 1000.0);
+        first = false;
+    }
+    std::fprintf(f, "\n]}\n");
+    return std::fclose(f) == 0;
+}
+
+#else
+
+void traceSetEnabled(bool) {}
+bool traceIsEnabled() { return false; }
+void traceRegisterThread(const char *) {}
+TraceBuffer *traceReserveThread(const char *) { return nullptr; }
+void traceAttachThread(TraceBuffer *) {}
+void traceReleaseThread(TraceBuffer *) {}
+bool traceWriteChromeJson(const std::string &, double) { return false; }
+
+#endif
@@ -0,0 +1,54 @@
+#include <cstring>
+#include <type_traits>
+
+#include "voice_telemetry.h"
+
+static_assert(std::is_trivially_copyable_v<VoiceInfo>, "VoiceInfo is copied word by word");
+
+void VoiceTelemetry::publish(VoiceInfo info) {
+    const uint64_t serial = nextSerial.load(std::memory_order_relaxed);
+    info.serial = serial;
+
+    uint64_t words[kWords] = {};
+    std::memcpy(words, &info, sizeof(info));
+
+    Slot &slot = slots[(serial - 1) % kSlots];
+    slot.seq.fetch_add(1, std::memory_order_acq_rel); // odd: update in progress
+    for (size_t i = 0; i < kWords; i++) {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.seq.fetch_add(1, std::memory_order_release); // even: consistent again
+
+    nextSerial.store(serial + 1, std::memory_order_release);
+}
+
+void VoiceTelemetry::reset() {
+    for (Slot &slot : slots) {
+        slot.seq.fetch_add(1, std::memory_order_acq_rel);
+        for (auto &w : slot.words) w.store(0, std::memory_order_relaxed);
+        slot.seq.fetch_add(1, std::memory_order_release);
+    }
+    nextSerial.store(1, std::memory_order_release);
+}
+
+size_t VoiceTelemetry::snapshot(VoiceInfo *out, size_t maxCount) const {
+    size_t count = 0;
+    for (const Slot &slot : slots) {
+        if (count >= maxCount) break;
+        uint64_t words[kWords];
+        uint32_t before, after;
+        do {
+            before = slot.seq.load(std::memory_order_acquire);
+            for (size_t i = 0; i < kWords; i++) {
+                words[i] = slot.words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = slot.seq.load(std::memory_order_relaxed);
+        } while ((before & 1u) || before != after);
+
+        VoiceInfo info;
+        std::memcpy(&info, words, sizeof(info));
+        if (info.serial != 0) out[count++] = info;
+    }
+    return count;
+}
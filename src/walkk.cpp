@@ -9,12 +9,17 @@
 #include <numbers>
 #include <fstream>
 #include <iterator>
+#include <cstdio>
+#include <numeric>
+#include <unordered_map>
 
 #ifdef _WIN32
 #define NOMINMAX
 #include <windows.h>
 #endif
 #include "minimp3_ex.h"
+#include "mixer.h"
+#include "trace.h"
 #include "wav_writer.h"
 #include "walkk.h"
 
@@ -28,6 +33,77 @@ void Walkk::addLog(const std::string &line) {
     }
 }
 
+std::string Walkk::formatEvent(const EventRecord &e) const {
+    char buf[256];
+    switch (e.type) {
+    case EventType::GrainStart: {
+        const char *name = e.c < files.size() ? files[e.c].relPath.c_str() : "?";
+        std::snprintf(buf, sizeof(buf), "next>>>%u (%s) start=%llu dur=%uf amp=%f loop=%s reverse=%s",
+                      e.c, name, (unsigned long long)e.b, e.d, e.value,
+                      (e.flags & EventRecord::kFlagLoop) ? "on" : "off",
+                      (e.flags & EventRecord::kFlagReverse) ? "on" : "off");
+        break;
+    }
+    case EventType::GrainReadFailed: {
+        const char *name = e.c < files.size() ? files[e.c].relPath.c_str() : "?";
+        std::snprintf(buf, sizeof(buf), "Failed to read grain from %u (%s)", e.c, name);
+        break;
+    }
+    case EventType::Underrun:
+        std::snprintf(buf, sizeof(buf), "underrun at frame %llu: %u frames of silence",
+                      (unsigned long long)e.a, e.d);
+        break;
+    case EventType::SinkDepth:
+        std::snprintf(buf, sizeof(buf), "sink depth %.1f -> %.1f ms (p99 lateness %.2f ms, decode %.2f ms)",
+                      e.a * 1000.0 / kSampleRate, e.b * 1000.0 / kSampleRate, e.value, e.c / 1000.0);
+        break;
+    default:
+        std::snprintf(buf, sizeof(buf), "event %d", (int)e.type);
+        break;
+    }
+    return buf;
+}
+
+size_t Walkk::pumpEvents() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - consoleWindowStart >= std::chrono::seconds(1)) {
+        if (consoleSuppressed > 0) {
+            std::cout << "(" << consoleSuppressed << " log lines suppressed)" << std::endl;
+        }
+        consoleWindowStart = now;
+        consoleWindowLines = 0;
+        consoleSuppressed = 0;
+    }
+
+    size_t drained = 0;
+    EventRecord e;
+    while (events.pop(e)) {
+        if (e.type == EventType::GrainStart && archive.isActive() && e.c < files.size()) {
+            archive.noteGrain(e.a, files[e.c].relPath, e.b, e.d, e.value);
+        }
+        std::string line = formatEvent(e);
+        if (consoleLog) {
+            if (consoleWindowLines < consoleLinesPerSecond) {
+                bool isError = e.type == EventType::GrainReadFailed || e.type == EventType::Underrun;
+                (isError ? std::cerr : std::cout) << line << '\n';
+                consoleWindowLines++;
+            } else {
+                consoleSuppressed++;
+            }
+        }
+        addLog(line);
+        drained++;
+    }
+    if (drained > 0 && consoleLog) std::cout.flush();
+
+    uint64_t dropped = events.dropped.load();
+    if (dropped != droppedReported) {
+        addLog("(" + std::to_string(dropped - droppedReported) + " events dropped, log ring full)");
+        droppedReported = dropped;
+    }
+    return drained;
+}
+
 int loadDirectoryMp3s(const char *directoryPath, Walkk &walkk, bool recursive) {
     try {
         // ----- Windows: keep a wide version of the directory path so we can iterate safely
@@ -51,8 +127,17 @@ int loadDirectoryMp3s(const char *directoryPath, Walkk &walkk, bool recursive) {
             walkk.filesAttemptedLastLoad = 0;
             walkk.filesLoadedLast = 0;
         }
+        {
+            double seconds = 0.0;
+            for (const StreamedFile &f : walkk.files) {
+                if (f.sampleRate > 0) seconds += (double)f.totalFrames / f.sampleRate;
+            }
+            walkk.libraryFiles.store(walkk.files.size());
+            walkk.librarySeconds.store(seconds);
+        }
 
         auto handleEntry = [&](const fs::directory_entry &entry) {
+            WALKK_TRACE_ZONE("load file");
             std::error_code ec;
             if (!entry.is_regular_file(ec)) return;
 
@@ -135,23 +220,30 @@ int loadDirectoryMp3s(const char *directoryPath, Walkk &walkk, bool recursive) {
                 file.channels    = file.decoder.info.channels;
                 file.totalFrames = file.decoder.samples / std::max(1, file.channels);
                 file.isOpen = true;
+                walkk.producerStats.openDecoders.fetch_add(1, std::memory_order_relaxed);
 
                 // Close immediately; reopen on-demand later when playing/reading grains
                 mp3dec_ex_close(&file.decoder);
                 file.isOpen = false;
+                walkk.producerStats.openDecoders.fetch_sub(1, std::memory_order_relaxed);
 
                 walkk.files.push_back(std::move(file));
+                walkk.libraryFiles.store(walkk.files.size());
+                if (walkk.files.back().sampleRate > 0) {
+                    walkk.librarySeconds.store(walkk.librarySeconds.load() +
+                        (double)walkk.files.back().totalFrames / walkk.files.back().sampleRate);
+                }
                 {
                     std::lock_guard<std::mutex> lk(walkk.loadStatsMutex);
                     walkk.filesLoadedLast++;
                 }
                 std::string msg = std::string("Loaded: ") + walkk.files.back().relPath +
                                   " (" + std::to_string(walkk.files.back().totalFrames) + " frames)";
-                std::cout << msg << std::endl;
+                if (walkk.consoleLog) std::cout << msg << std::endl;
                 walkk.addLog(msg);
             } else {
                 std::string msg = std::string("Failed to load: ") + file.relPath;
-                std::cerr << msg << std::endl;
+                if (walkk.consoleLog) std::cerr << msg << std::endl;
                 walkk.addLog(msg);
             }
         };
@@ -189,7 +281,7 @@ int loadDirectoryMp3s(const char *directoryPath, Walkk &walkk, bool recursive) {
         }
         std::string sum = "Scan complete. Tried=" + std::to_string(tried) +
                           " loaded=" + std::to_string(loaded);
-        std::cout << sum << std::endl;
+        if (walkk.consoleLog) std::cout << sum << std::endl;
         walkk.addLog(sum);
 
         return walkk.files.empty() ? 1 : 0;
@@ -202,19 +294,234 @@ int loadDirectoryMp3s(const char *directoryPath, Walkk &walkk, bool recursive) {
 }
 
 
-static bool readGrain(StreamedFile &file, GrainParams &params, std::vector<float> &output, int targetRate) {
+static void closeDecoder(StreamedFile &file, ProducerStats &stats) {
+    mp3dec_ex_close(&file.decoder);
+    file.faultyIo.reset();
+    file.isOpen = false;
+    stats.openDecoders.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// Where output frame `dstFrame` of a grain reads from: a whole file frame plus the fraction
+// past it (linear, looping with drag, or reversed)
+namespace {
+struct GrainSourceMap {
+    const GrainParams &params;
+    double rateRatio;
+    size_t fileFrames;
+    size_t winLen;  // loop window in source frames
+    bool useLoop;
+
+    GrainSourceMap(const GrainParams &p, double ratio, size_t frames, size_t windowLen)
+        : params(p), rateRatio(ratio), fileFrames(frames), winLen(windowLen),
+          useLoop(p.loopEnabled && p.loopWindowFrames >= 2) {}
+
+    void at(size_t dstFrame, int64_t &srcFileFrame, double &frac) const {
+        // Position in *source* frames if we were reading linearly
+        double srcPosLin = (double)dstFrame * rateRatio; // [0..nominalSrcFrames)
+
+        // If reverse playback, flip the position within the grain
+        if (params.reversePlayback) {
+            srcPosLin = (double)(params.durationFrames - 1 - dstFrame) * rateRatio;
+        }
+
+        if (useLoop) {
+            // Reduce srcPosLin into repeated windows, shifting by drag on each wrap
+            // Compute wraps and remainder without a loop (fast math)
+            double wrapsD   = std::floor(srcPosLin / (double)winLen);
+            size_t wraps    = (wrapsD < 0) ? 0 : (size_t)wrapsD;
+            double inWinPos = srcPosLin - (double)wraps * (double)winLen;
+            if (inWinPos < 0.0) inWinPos = 0.0; // safety
+
+            // Window start after `wraps` shifts
+            int64_t shiftedStart = (int64_t)params.startFrame + (int64_t)wraps * (int64_t)params.loopDragFrames;
+
+            // Clamp window start to file
+            if (shiftedStart < 0) shiftedStart = 0;
+            if (shiftedStart + (int64_t)winLen >= (int64_t)fileFrames)
+                shiftedStart = std::max<int64_t>(0, (int64_t)fileFrames - (int64_t)winLen - 1);
+
+            srcFileFrame = shiftedStart + (int64_t)inWinPos;
+            frac = inWinPos - std::floor(inWinPos);
+        } else {
+            srcFileFrame = (int64_t)params.startFrame + (int64_t)srcPosLin;
+            frac = srcPosLin - std::floor(srcPosLin);
+        }
+    }
+};
+
+// Zeroth-order modified Bessel function of the first kind (Kaiser window)
+double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 40; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-17) break;
+    }
+    return sum;
+}
+
+// Kaiser-windowed sinc taps for kPhases fractional positions (plus one guard row), each row
+// normalized to unity gain. Tap k of a row weighs source frame (frame - kSincTaps/2 + 1 + k).
+struct SincTable {
+    static constexpr int kPhases = 256;
+    static constexpr double kBeta = 8.6;      // about 90 dB stopband
+    static constexpr double kRolloff = 0.94;  // passband edge relative to the lower Nyquist
+
+    double cutoff = -1.0;
+    std::vector<float> taps; // (kPhases + 1) * kSincTaps
+
+    void build(double newCutoff) {
+        cutoff = newCutoff;
+        taps.assign((size_t)(kPhases + 1) * kSincTaps, 0.0f);
+        const double fc = newCutoff * kRolloff;
+        const double half = kSincTaps / 2;
+        for (int phase = 0; phase <= kPhases; ++phase) {
+            const double frac = (double)phase / kPhases;
+            double row[kSincTaps];
+            double sum = 0.0;
+            for (int k = 0; k < kSincTaps; ++k) {
+                double d = (double)(k - (kSincTaps / 2 - 1)) - frac;
+                double x = std::numbers::pi * fc * d;
+                double sinc = std::abs(x) < 1e-12 ? 1.0 : std::sin(x) / x;
+                double t = d / half;
+                double window = std::abs(t) >= 1.0 ? 0.0 : besselI0(kBeta * std::sqrt(1.0 - t * t)) / besselI0(kBeta);
+                row[k] = fc * sinc * window;
+                sum += row[k];
+            }
+            for (int k = 0; k < kSincTaps; ++k) {
+                taps[(size_t)phase * kSincTaps + (size_t)k] = (float)(row[k] / sum);
+            }
+        }
+    }
+};
+} // namespace
+
+void interpolateGrain(const mp3d_sample_t *src, size_t framesRead, int channels, int64_t readStart, size_t fileFrames,
+                      double rateRatio, size_t windowLen, const GrainParams &params, float *out) {
+    // Helpers to clamp mapped indices into [0, framesRead-1] of our local buffer
+    auto clampLocal = [&](int64_t f) -> size_t {
+        if (f < 0) return 0;
+        if (f >= (int64_t)framesRead - 1) return framesRead - 2; // leave room for i1
+        return (size_t)f;
+    };
+
+    auto readSample = [&](size_t frame, int ch) -> float {
+        int srcCh = (channels == 1) ? 0 : ch;
+        return (float)src[frame * (size_t)channels + (size_t)srcCh] / 32768.0f;
+    };
+
+    // Precompute where "our local zero" is relative to file start
+    const int64_t localZeroFileFrame = readStart;
+    const GrainSourceMap map(params, rateRatio, fileFrames, windowLen);
+
+    for (size_t dstFrame = 0; dstFrame < params.durationFrames; ++dstFrame) {
+        int64_t srcFileFrame;
+        double unusedFrac;
+        map.at(dstFrame, srcFileFrame, unusedFrac);
+
+        // Map to local buffer coordinates
+        int64_t localFrame = srcFileFrame - localZeroFileFrame;
+        size_t i0 = clampLocal(localFrame);
+        size_t i1 = i0 + 1;
+        double frac = (double)localFrame - (double)i0;
+
+        float l0 = readSample(i0, 0);
+        float l1 = readSample(i1, 0);
+        float r0 = readSample(i0, 1);
+        float r1 = readSample(i1, 1);
+
+        float L = (float)((1.0 - frac) * l0 + frac * l1) * params.amplitude;
+        float R = (float)((1.0 - frac) * r0 + frac * r1) * params.amplitude;
+
+        out[dstFrame * 2 + 0] = L;
+        out[dstFrame * 2 + 1] = R;
+    }
+
+}
+
+void interpolateGrainSinc(const mp3d_sample_t *src, size_t framesRead, int channels, int64_t readStart,
+                          size_t fileFrames, double rateRatio, size_t windowLen, const GrainParams &params, float *out) {
+    // Same rate: every position is a whole source frame, nothing to interpolate
+    if (rateRatio == 1.0) {
+        interpolateGrain(src, framesRead, channels, readStart, fileFrames, rateRatio, windowLen, params, out);
+        return;
+    }
+
+    // Downsampling low-passes at the output's Nyquist; the table is rebuilt only when that changes
+    thread_local SincTable table;
+    const double cutoff = std::min(1.0, 1.0 / rateRatio);
+    if (table.cutoff != cutoff) table.build(cutoff);
+
+    const GrainSourceMap map(params, rateRatio, fileFrames, windowLen);
+    const size_t ch = (size_t)channels;
+    const size_t right = channels == 1 ? 0 : 1;
+    const float scale = params.amplitude / 32768.0f;
+
+    for (size_t dstFrame = 0; dstFrame < params.durationFrames; ++dstFrame) {
+        int64_t srcFileFrame;
+        double frac;
+        map.at(dstFrame, srcFileFrame, frac);
+
+        const double phase = frac * SincTable::kPhases;
+        const int p = std::min((int)phase, SincTable::kPhases - 1);
+        const float t = (float)(phase - p);
+        const float *row0 = table.taps.data() + (size_t)p * kSincTaps;
+        const float *row1 = row0 + kSincTaps;
+
+        // Local index of the first tap; frames outside the decoded slice count as silence
+        const int64_t first = srcFileFrame - readStart - (kSincTaps / 2 - 1);
+        float accL = 0.0f, accR = 0.0f;
+        if (first >= 0 && first + kSincTaps <= (int64_t)framesRead) {
+            const mp3d_sample_t *s = src + (size_t)first * ch;
+            for (int k = 0; k < kSincTaps; ++k) {
+                const float c = row0[k] + t * (row1[k] - row0[k]);
+                accL += c * (float)s[(size_t)k * ch];
+                accR += c * (float)s[(size_t)k * ch + right];
+            }
+        } else {
+            for (int k = 0; k < kSincTaps; ++k) {
+                const int64_t i = first + k;
+                if (i < 0 || i >= (int64_t)framesRead) continue;
+                const float c = row0[k] + t * (row1[k] - row0[k]);
+                accL += c * (float)src[(size_t)i * ch];
+                accR += c * (float)src[(size_t)i * ch + right];
+            }
+        }
+
+        out[dstFrame * 2 + 0] = accL * scale;
+        out[dstFrame * 2 + 1] = accR * scale;
+    }
+}
+
+bool readGrain(StreamedFile &file, GrainParams &params, std::vector<float> &output, int targetRate,
+               ProducerStats &stats, IoFaultInjector *faults, GrainQuality quality) {
     // Lazily open decoder if needed to keep memory footprint low across many files
     bool openedHere = false;
     if (!file.isOpen) {
-        if (mp3dec_ex_open(&file.decoder, file.path.c_str(), MP3D_SEEK_TO_SAMPLE) != 0) {
+        WALKK_TRACE_ZONE("open");
+        stats.decoderOpens.fetch_add(1, std::memory_order_relaxed);
+        int opened = faults ? faults->open(&file.decoder, file.path, MP3D_SEEK_TO_SAMPLE, file.faultyIo)
+                            : mp3dec_ex_open(&file.decoder, file.path.c_str(), MP3D_SEEK_TO_SAMPLE);
+        if (opened != 0) {
             return false;
         }
         file.sampleRate = file.decoder.info.hz;
         file.channels = file.decoder.info.channels;
         file.totalFrames = file.decoder.samples / std::max(1, file.channels);
         file.isOpen = true;
+        stats.openDecoders.fetch_add(1, std::memory_order_relaxed);
         openedHere = true;
     }
+    // Every exit below closes a decoder opened for this grain (and drops its fault wrapper),
+    // so short or truncated files do not leak one per grain
+    struct CloseOnExit {
+        StreamedFile &file;
+        ProducerStats &stats;
+        bool active;
+        ~CloseOnExit() {
+            if (active) closeDecoder(file, stats);
+        }
+    } closeOnExit{file, stats, openedHere};
 
     // Resample ratio: src -> dst
     double rateRatio = (double)file.sampleRate / (double)targetRate;
@@ -236,10 +543,12 @@ static bool readGrain(StreamedFile &file, GrainParams &params, std::vector<float
     int64_t drag = (int64_t)params.loopDragFrames;
     int64_t worstDisp = (int64_t)estWraps * (int64_t)std::llabs(drag);
 
-    // Build a read window with head/tail margins to survive scrubbing
+    // Build a read window with head/tail margins to survive scrubbing (and feed the sinc taps)
+    const bool highQuality = quality == GrainQuality::High;
+    const int64_t sincMargin = highQuality ? kSincTaps / 2 + 1 : 0;
     int64_t baseStart = (int64_t)params.startFrame;
-    int64_t headroom  = useLoop ? worstDisp + 8 : 0; // allow backward drags
-    int64_t tailroom  = useLoop ? (int64_t)nominalSrcFrames + worstDisp + 8 : (int64_t)nominalSrcFrames + 8;
+    int64_t headroom  = (useLoop ? worstDisp + 8 : 0) + sincMargin; // allow backward drags
+    int64_t tailroom  = (useLoop ? (int64_t)nominalSrcFrames + worstDisp + 8 : (int64_t)nominalSrcFrames + 8) + sincMargin;
 
     // Clamp the read range to the file
     int64_t readStart = std::max<int64_t>(0, baseStart - headroom);
@@ -250,107 +559,50 @@ static bool readGrain(StreamedFile &file, GrainParams &params, std::vector<float
 
     // Seek & read the contiguous source slice
     uint64_t seekSample = (uint64_t)readStart * (uint64_t)file.channels;
-    if (mp3dec_ex_seek(&file.decoder, seekSample) != 0) {
-        if (openedHere) {
-            mp3dec_ex_close(&file.decoder);
-            file.isOpen = false;
-        }
-        return false;
+    int seekResult;
+    {
+        WALKK_TRACE_ZONE("seek");
+        seekResult = mp3dec_ex_seek(&file.decoder, seekSample);
     }
+    if (seekResult != 0) return false;
 
     std::vector<mp3d_sample_t> srcBuffer(readFrames * (size_t)file.channels);
-    size_t samplesRead = mp3dec_ex_read(&file.decoder, srcBuffer.data(), readFrames * (size_t)file.channels);
-    size_t framesRead  = samplesRead / (size_t)file.channels;
-    if (framesRead < 2) {
-        if (openedHere) {
-            mp3dec_ex_close(&file.decoder);
-            file.isOpen = false;
-        }
-        return false;
+    size_t samplesRead;
+    {
+        WALKK_TRACE_ZONE("decode");
+        samplesRead = mp3dec_ex_read(&file.decoder, srcBuffer.data(), readFrames * (size_t)file.channels);
     }
-
-    // Helpers to clamp mapped indices into [0, framesRead-1] of our local buffer
-    auto clampLocal = [&](int64_t f) -> size_t {
-        if (f < 0) return 0;
-        if (f >= (int64_t)framesRead - 1) return framesRead - 2; // leave room for i1
-        return (size_t)f;
-    };
-
-    auto readSample = [&](size_t frame, int ch) -> float {
-        int srcCh = (file.channels == 1) ? 0 : ch;
-        return (float)srcBuffer[frame * (size_t)file.channels + (size_t)srcCh] / 32768.0f;
-    };
-
-    // Precompute where "our local zero" is relative to file start
-    const int64_t localZeroFileFrame = readStart;
+    size_t framesRead  = samplesRead / (size_t)file.channels;
+    if (framesRead < 2) return false;
 
     output.resize(params.durationFrames * (size_t)Walkk::kChannels);
-
-    // State for loop window
-    int64_t winStartFileFrame = baseStart;  // in file frames
-    size_t  winLen            = windowLen;  // in source frames
-
-    for (size_t dstFrame = 0; dstFrame < params.durationFrames; ++dstFrame) {
-        // Position in *source* frames if we were reading linearly
-        double srcPosLin = (double)dstFrame * rateRatio; // [0..nominalSrcFrames)
-
-        // If reverse playback, flip the position within the grain
-        if (params.reversePlayback) {
-            srcPosLin = (double)(params.durationFrames - 1 - dstFrame) * rateRatio;
-        }
-
-        int64_t srcFileFrame;
-        if (useLoop) {
-            // Reduce srcPosLin into repeated windows, shifting by drag on each wrap
-            // Compute wraps and remainder without a loop (fast math)
-            double wrapsD   = std::floor(srcPosLin / (double)winLen);
-            size_t wraps    = (wrapsD < 0) ? 0 : (size_t)wrapsD;
-            double inWinPos = srcPosLin - (double)wraps * (double)winLen;
-            if (inWinPos < 0.0) inWinPos = 0.0; // safety
-
-            // Window start after `wraps` shifts
-            int64_t shiftedStart = winStartFileFrame + (int64_t)wraps * drag;
-
-            // Clamp window start to file
-            if (shiftedStart < 0) shiftedStart = 0;
-            if (shiftedStart + (int64_t)winLen >= (int64_t)file.totalFrames)
-                shiftedStart = std::max<int64_t>(0, (int64_t)file.totalFrames - (int64_t)winLen - 1);
-
-            srcFileFrame = shiftedStart + (int64_t)inWinPos;
+    {
+        WALKK_TRACE_ZONE("resample");
+        if (highQuality) {
+            interpolateGrainSinc(srcBuffer.data(), framesRead, file.channels, readStart, file.totalFrames, rateRatio,
+                                 windowLen, params, output.data());
         } else {
-            srcFileFrame = baseStart + (int64_t)srcPosLin;
+            interpolateGrain(srcBuffer.data(), framesRead, file.channels, readStart, file.totalFrames, rateRatio,
+                             windowLen, params, output.data());
         }
-
-        // Map to local buffer coordinates
-        int64_t localFrame = srcFileFrame - localZeroFileFrame;
-        size_t i0 = clampLocal(localFrame);
-        size_t i1 = i0 + 1;
-        double frac = (double)localFrame - (double)i0;
-
-        float l0 = readSample(i0, 0);
-        float l1 = readSample(i1, 0);
-        float r0 = readSample(i0, 1);
-        float r1 = readSample(i1, 1);
-
-        float L = (float)((1.0 - frac) * l0 + frac * l1) * params.amplitude;
-        float R = (float)((1.0 - frac) * r0 + frac * r1) * params.amplitude;
-
-        output[dstFrame * 2 + 0] = L;
-        output[dstFrame * 2 + 1] = R;
     }
 
-    // applyGrainEnvelope(output.data(), params.durationFrames, 2);
-
-    // Close decoder if we opened it for this grain to avoid keeping many files mapped
-    if (openedHere) {
-        mp3dec_ex_close(&file.decoder);
-        file.isOpen = false;
+    {
+        WALKK_TRACE_ZONE("envelope");
+        if (highQuality) {
+            applyGrainEnvelopeExact(output.data(), params.durationFrames, Walkk::kChannels,
+                                    params.envelopeShape, params.attackFrames, params.releaseFrames);
+        } else {
+            applyGrainEnvelope(output.data(), params.durationFrames, Walkk::kChannels,
+                               params.envelopeShape, params.attackFrames, params.releaseFrames);
+        }
     }
     return true;
 }
 
 
-static GrainParams generateRandomGrain(Walkk &walkk) {
+GrainParams generateRandomGrain(Walkk &walkk) {
+    WALKK_TRACE_ZONE("select grain");
     GrainParams grain{};
 
     std::uniform_int_distribution<size_t> fileDist(0, walkk.files.size() - 1);
@@ -419,148 +671,470 @@ static GrainParams generateRandomGrain(Walkk &walkk) {
     std::bernoulli_distribution bouncebackDist(std::clamp(settingsSnapshot.bouncebackProbability, 0.0f, 1.0f));
     grain.reversePlayback = bouncebackDist(walkk.rng);
 
+    grain.envelopeShape = settingsSnapshot.envelopeShape;
+    grain.attackFrames  = (settingsSnapshot.envelopeAttackMs * (size_t)Walkk::kSampleRate) / 1000;
+    grain.releaseFrames = (settingsSnapshot.envelopeReleaseMs * (size_t)Walkk::kSampleRate) / 1000;
+
     return grain;
 }
 
-void granulizerLoop(Walkk *walkk) {
-    if (walkk->files.empty()) {
-        walkk->sink.finished.store(true);
-        walkk->allFinished.store(true);
-        return;
+void pushToSink(Walkk *walkk, const float *data, size_t samples) {
+    WALKK_TRACE_ZONE("push");
+    size_t pushed = 0;
+    while (pushed < samples) {
+        if (!walkk->sink.waitForSpace(samples - pushed, walkk->allFinished)) break;
+        pushed += walkk->sink.push(data + pushed, samples - pushed);
+    }
+}
+
+void Walkk::seed(uint64_t value) {
+    uint64_t state = value;
+    const uint64_t rngSeed = splitMix64(state);
+    std::seed_seq seq{(uint32_t)rngSeed, (uint32_t)(rngSeed >> 32)};
+    rng.seed(seq);
+    noiseSeed = splitMix64(state);
+}
+
+void Walkk::resetPlayback() {
+    sink.clear();
+    sink.finished.store(false);
+    clock.reset();
+    voiceTelemetry.reset();
+    health.reset();
+}
+
+// Push the controller's target into the sink and report the change
+static void applySinkDepth(Walkk *walkk, bool log) {
+    SinkDepthController &depth = walkk->sinkDepth;
+    walkk->sink.targetDepth.store(depth.targetFrames.load() * (size_t)Walkk::kChannels);
+    if (!log) return;
+
+    EventRecord ev;
+    ev.type = EventType::SinkDepth;
+    ev.a = (uint64_t)(depth.lastAdjustFrom.load() * Walkk::kSampleRate + 0.5);
+    ev.b = depth.targetFrames.load();
+    ev.value = (float)(depth.latenessP99.load() * 1000.0);
+    ev.c = (uint32_t)(depth.decodeP99.load() * 1e6);
+    walkk->events.push(ev);
+}
+
+static void applyProducerTuning(Walkk *walkk) {
+    if (walkk->producerTuning.isDefault()) return;
+    std::string error;
+    std::string msg = "producer thread: " + describeThreadTuning(walkk->producerTuning);
+    msg += applyThreadTuning(walkk->producerTuning, error) ? " applied" : " failed: " + error;
+    std::cerr << msg << std::endl;
+    walkk->addLog(msg);
+}
+
+// Log a scheduled grain and show it to the voice display
+static void publishGrain(Walkk *walkk, const MixerVoice &voice, const GrainParams &grain) {
+    EventRecord ev;
+    ev.type = EventType::GrainStart;
+    ev.a = voice.startFrame;
+    ev.b = grain.startFrame;
+    ev.c = (uint32_t)grain.fileIndex;
+    ev.d = (uint32_t)grain.durationFrames;
+    ev.value = grain.amplitude;
+    ev.flags = (grain.loopEnabled ? EventRecord::kFlagLoop : 0) |
+               (grain.reversePlayback ? EventRecord::kFlagReverse : 0);
+    walkk->events.push(ev);
+
+    VoiceInfo info;
+    info.engineStartFrame = voice.startFrame;
+    info.engineEndFrame = voice.endFrame();
+    info.fileStartFrame = grain.startFrame;
+    info.fileIndex = (uint32_t)grain.fileIndex;
+    info.durationFrames = (uint32_t)grain.durationFrames;
+    info.loopWindowFrames = (uint32_t)grain.loopWindowFrames;
+    info.loopDragFrames = grain.loopDragFrames;
+    info.amplitude = grain.amplitude;
+    info.type = (uint8_t)MixerVoice::Type::Grain;
+    info.loopEnabled = grain.loopEnabled;
+    info.reversePlayback = grain.reversePlayback;
+    walkk->voiceTelemetry.publish(info);
+}
+
+static void publishNoise(Walkk *walkk, const MixerVoice &voice) {
+    VoiceInfo info;
+    info.engineStartFrame = voice.startFrame;
+    info.engineEndFrame = voice.endFrame();
+    info.durationFrames = (uint32_t)voice.lengthFrames;
+    info.amplitude = voice.noise.amplitude;
+    info.type = (uint8_t)MixerVoice::Type::Noise;
+    info.noiseColor = (uint8_t)voice.noise.color;
+    walkk->voiceTelemetry.publish(info);
+}
+
+static size_t voiceSlot(const Mixer &mixer, const MixerVoice *voice) {
+    return (size_t)(voice - mixer.voices.data());
+}
+
+static ScoreVoice scoreGrain(const Mixer &mixer, const MixerVoice *voice, const GrainParams &grain) {
+    ScoreVoice v;
+    v.type = ScoreRecordType::Grain;
+    v.engineFrame = voice->startFrame;
+    v.sourceFrame = grain.startFrame;
+    v.fileIndex = (uint32_t)grain.fileIndex;
+    v.lengthFrames = (uint32_t)grain.durationFrames;
+    v.loopWindowFrames = (uint32_t)grain.loopWindowFrames;
+    v.loopDragFrames = grain.loopDragFrames;
+    v.attackFrames = (uint32_t)grain.attackFrames;
+    v.releaseFrames = (uint32_t)grain.releaseFrames;
+    v.amplitude = grain.amplitude;
+    v.slot = (uint8_t)voiceSlot(mixer, voice);
+    v.flags = (grain.loopEnabled ? ScoreVoice::kFlagLoop : 0) | (grain.reversePlayback ? ScoreVoice::kFlagReverse : 0);
+    v.shape = (uint8_t)grain.envelopeShape;
+    return v;
+}
+
+static GrainParams grainFromScore(const ScoreVoice &v, size_t fileIndex) {
+    GrainParams grain{};
+    grain.fileIndex = fileIndex;
+    grain.startFrame = (size_t)v.sourceFrame;
+    grain.durationFrames = v.lengthFrames;
+    grain.amplitude = v.amplitude;
+    grain.loopEnabled = (v.flags & ScoreVoice::kFlagLoop) != 0;
+    grain.loopWindowFrames = v.loopWindowFrames;
+    grain.loopDragFrames = v.loopDragFrames;
+    grain.reversePlayback = (v.flags & ScoreVoice::kFlagReverse) != 0;
+    grain.envelopeShape = (EnvelopeShape)v.shape;
+    grain.attackFrames = v.attackFrames;
+    grain.releaseFrames = v.releaseFrames;
+    return grain;
+}
+
+static ScoreSettings scoreSettings(const Walkk::GranularSettings &s, uint64_t engineFrame) {
+    ScoreSettings r;
+    r.engineFrame = engineFrame;
+    r.minGrainMs = (uint32_t)s.minGrainMs;
+    r.maxGrainMs = (uint32_t)s.maxGrainMs;
+    r.grainOverlapMs = (uint32_t)s.grainOverlapMs;
+    r.maxConcurrentGrains = (uint32_t)s.maxConcurrentGrains;
+    r.minLoopWindowMs = (uint32_t)s.minLoopWindowMs;
+    r.maxLoopWindowMs = (uint32_t)s.maxLoopWindowMs;
+    r.maxLoopDragMs = s.maxLoopDragMs;
+    r.whiteNoiseMs = (uint32_t)s.whiteNoiseMs;
+    r.envelopeAttackMs = (uint32_t)s.envelopeAttackMs;
+    r.envelopeReleaseMs = (uint32_t)s.envelopeReleaseMs;
+    r.loopProbability = s.loopProbability;
+    r.bouncebackProbability = s.bouncebackProbability;
+    r.whiteNoiseAmplitude = s.whiteNoiseAmplitude;
+    r.noiseColor = (uint8_t)s.noiseColor;
+    r.envelopeShape = (uint8_t)s.envelopeShape;
+    return r;
+}
+
+static Walkk::GranularSettings settingsFromScore(const ScoreSettings &r) {
+    Walkk::GranularSettings s;
+    s.minGrainMs = r.minGrainMs;
+    s.maxGrainMs = r.maxGrainMs;
+    s.grainOverlapMs = r.grainOverlapMs;
+    s.maxConcurrentGrains = r.maxConcurrentGrains;
+    s.minLoopWindowMs = r.minLoopWindowMs;
+    s.maxLoopWindowMs = r.maxLoopWindowMs;
+    s.maxLoopDragMs = r.maxLoopDragMs;
+    s.whiteNoiseMs = r.whiteNoiseMs;
+    s.envelopeAttackMs = r.envelopeAttackMs;
+    s.envelopeReleaseMs = r.envelopeReleaseMs;
+    s.loopProbability = r.loopProbability;
+    s.bouncebackProbability = r.bouncebackProbability;
+    s.whiteNoiseAmplitude = r.whiteNoiseAmplitude;
+    s.noiseColor = (NoiseColor)r.noiseColor;
+    s.envelopeShape = (EnvelopeShape)r.envelopeShape;
+    return s;
+}
+
+bool parseGrainQuality(const std::string &text, GrainQuality &quality) {
+    if (text == "live") quality = GrainQuality::Live;
+    else if (text == "high") quality = GrainQuality::High;
+    else return false;
+    return true;
+}
+
+bool startScore(Walkk &walkk, const std::string &path, std::string &error) {
+    std::vector<ScoreFile> files;
+    files.reserve(walkk.files.size());
+    for (const StreamedFile &f : walkk.files) {
+        ScoreFile sf;
+        sf.path = f.relPath;
+        sf.totalFrames = f.totalFrames;
+        sf.sampleRate = (uint32_t)f.sampleRate;
+        sf.channels = (uint32_t)f.channels;
+        files.push_back(std::move(sf));
     }
+    return walkk.score.open(path, Walkk::kSampleRate, Walkk::kChannels, files, error);
+}
 
-    // Snapshot overlap once; could also be sampled per-grain if desired
-    size_t overlapMsSnapshot;
+void renderGranulizerBlock(Walkk *walkk, GranulizerState &state, float *out, size_t blockFrames, bool schedule) {
+    Mixer &mixer = walkk->mixer;
+
+    Walkk::GranularSettings settingsSnapshot;
     {
         std::lock_guard<std::mutex> lock(walkk->settingsMutex);
-        overlapMsSnapshot = walkk->settings.grainOverlapMs;
+        settingsSnapshot = walkk->settings;
     }
-    const size_t overlapFrames = (overlapMsSnapshot * (size_t)Walkk::kSampleRate) / 1000;
-    (void)overlapFrames;
+    if (walkk->score.isOpen() && (!state.settingsScored || !(settingsSnapshot == state.scoredSettings))) {
+        walkk->score.addSettings(scoreSettings(settingsSnapshot, mixer.renderFrame));
+        state.scoredSettings = settingsSnapshot;
+        state.settingsScored = true;
+    }
+    const size_t overlapFrames = (settingsSnapshot.grainOverlapMs * (size_t)Walkk::kSampleRate) / 1000;
+    const size_t maxGrainVoices = std::max<size_t>(1, settingsSnapshot.maxConcurrentGrains);
 
-    std::vector<float> grainBuffer;
-    std::vector<float> noiseBuffer;
+    // Schedule every grain (and its trailing noise gap) that starts within the next block
+    while (schedule && state.nextStartFrame < mixer.renderFrame + blockFrames &&
+           mixer.activeVoices(MixerVoice::Type::Grain) < maxGrainVoices &&
+           !walkk->allFinished.load()) {
+        WALKK_TRACE_ZONE("schedule grain");
+        MixerVoice *voice = mixer.allocateVoice(MixerVoice::Type::Grain);
+        if (!voice) break;
 
-    while (!walkk->allFinished.load()) {
         GrainParams grain = generateRandomGrain(*walkk);
 
-        {
-            std::string fname = (grain.fileIndex < walkk->files.size()) ? walkk->files[grain.fileIndex].relPath : std::string("?");
-            std::string gmsg = "next>>>" + std::to_string(grain.fileIndex) +
-                               " (" + fname + ") start=" + std::to_string(grain.startFrame) +
-                               " dur=" + std::to_string(grain.durationFrames) + "f" +
-                               " amp=" + std::to_string(grain.amplitude) +
-                               (grain.loopEnabled ? " loop=on" : " loop=off") +
-                               (grain.reversePlayback ? " reverse=on" : " reverse=off");
-            std::cout << gmsg << std::endl;
-            walkk->addLog(gmsg);
+        if (!state.planOnly) {
+            auto decodeStart = std::chrono::steady_clock::now();
+            ProducerStats &stats = walkk->producerStats;
+            bool decoded = readGrain(walkk->files[grain.fileIndex], grain, voice->buffer, Walkk::kSampleRate, stats,
+                                     walkk->ioFaults, walkk->grainQuality);
+            auto decodeTime = std::chrono::steady_clock::now() - decodeStart;
+            walkk->sinkDepth.addDecode(std::chrono::duration<double>(decodeTime).count());
+            stats.decodeTime.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(decodeTime).count());
+            if (!decoded) {
+                stats.grainFailures.fetch_add(1, std::memory_order_relaxed);
+                voice->active = false;
+                EventRecord ev;
+                ev.type = EventType::GrainReadFailed;
+                ev.c = (uint32_t)grain.fileIndex;
+                walkk->events.push(ev);
+                continue;
+            }
+            stats.grains.fetch_add(1, std::memory_order_relaxed);
         }
 
-        // Update last grain debug info for GUI
-        {
-            std::lock_guard<std::mutex> g(walkk->lastGrainMutex);
-            walkk->lastGrain.fileIndex = grain.fileIndex;
-            if (grain.fileIndex < walkk->files.size()) {
-                const auto &sf = walkk->files[grain.fileIndex];
-                if (!sf.relPath.empty()) {
-                    walkk->lastGrain.relPath = sf.relPath;
-                } else {
-                    // Fallback to basename if relPath missing
-                    try {
-                        walkk->lastGrain.relPath = fs::path(sf.path).filename().string();
-                    } catch (...) {
-                        walkk->lastGrain.relPath = sf.path;
-                    }
-                }
-            } else {
-                walkk->lastGrain.relPath.clear();
+        voice->fileIndex = grain.fileIndex;
+        voice->startFrame = std::max(state.nextStartFrame, mixer.renderFrame);
+        voice->lengthFrames = grain.durationFrames;
+
+        publishGrain(walkk, *voice, grain);
+        if (walkk->score.isOpen()) walkk->score.addVoice(scoreGrain(mixer, voice, grain));
+
+        // Optional noise gap after the grain; the next grain waits for it instead of overlapping
+        size_t noiseMs = std::min<size_t>(5000, settingsSnapshot.whiteNoiseMs);
+        size_t noiseFrames = (noiseMs * (size_t)Walkk::kSampleRate) / 1000;
+        MixerVoice *noiseVoice = noiseFrames > 0 ? mixer.allocateVoice(MixerVoice::Type::Noise) : nullptr;
+        if (noiseVoice) {
+            noiseVoice->startFrame = voice->endFrame();
+            noiseVoice->lengthFrames = noiseFrames;
+            const uint64_t seed = splitMix64(walkk->noiseSeed);
+            noiseVoice->noise.seed(seed);
+            noiseVoice->noise.color = settingsSnapshot.noiseColor;
+            noiseVoice->noise.amplitude = std::clamp(settingsSnapshot.whiteNoiseAmplitude, 0.0f, 1.0f);
+            state.nextStartFrame = noiseVoice->endFrame();
+            publishNoise(walkk, *noiseVoice);
+
+            if (walkk->score.isOpen()) {
+                ScoreVoice v;
+                v.type = ScoreRecordType::Noise;
+                v.engineFrame = noiseVoice->startFrame;
+                v.noiseSeed = seed;
+                v.lengthFrames = (uint32_t)noiseFrames;
+                v.amplitude = noiseVoice->noise.amplitude;
+                v.slot = (uint8_t)voiceSlot(mixer, noiseVoice);
+                v.shape = (uint8_t)noiseVoice->noise.color;
+                walkk->score.addVoice(v);
             }
-            walkk->lastGrain.startFrame = grain.startFrame;
-            walkk->lastGrain.durationFrames = grain.durationFrames;
-            walkk->lastGrain.amplitude = grain.amplitude;
-            walkk->lastGrain.loopEnabled = grain.loopEnabled;
-            walkk->lastGrain.loopWindowFrames = grain.loopWindowFrames;
-            walkk->lastGrain.loopDragFrames = grain.loopDragFrames;
-            walkk->lastGrain.reversePlayback = grain.reversePlayback;
+        } else {
+            state.nextStartFrame = voice->endFrame() - std::min<uint64_t>(overlapFrames, voice->lengthFrames);
         }
+    }
 
-        if (!readGrain(walkk->files[grain.fileIndex], grain, grainBuffer, Walkk::kSampleRate)) {
-            std::cerr << "Failed to read grain" << std::endl;
-            continue;
+    if (state.planOnly) {
+        mixer.advance(blockFrames);
+        return;
+    }
+    WALKK_TRACE_ZONE("mix");
+    mixer.render(out, blockFrames);
+}
+
+void granulizerLoop(Walkk *walkk) {
+    if (walkk->files.empty()) {
+        walkk->sink.finished.store(true);
+        walkk->allFinished.store(true);
+        return;
+    }
+
+    traceRegisterThread("producer");
+    applyProducerTuning(walkk);
+
+    walkk->mixer.reset();
+
+    walkk->sinkDepth.reset(walkk->sink.capacity / (size_t)Walkk::kChannels);
+    applySinkDepth(walkk, false);
+
+    // Lateness: time from the sink having room for a block until that block is pushed
+    auto blockStart = std::chrono::steady_clock::now();
+
+    std::vector<float> block;
+    GranulizerState state;
+
+    while (!walkk->allFinished.load()) {
+        const size_t blockFrames = std::clamp<size_t>(walkk->engineBlockFrames.load(), 16, Mixer::kMaxBlockFrames);
+        block.resize(blockFrames * (size_t)Walkk::kChannels);
+
+        renderGranulizerBlock(walkk, state, block.data(), blockFrames);
+
+        double lateness = std::chrono::duration<double>(std::chrono::steady_clock::now() - blockStart).count();
+        if (walkk->sinkDepth.addBlock(lateness, blockFrames)) {
+            applySinkDepth(walkk, true);
         }
 
-        const size_t chunkFrames = 512;
-        size_t framesPushed = 0;
-
-        // On first push, estimate when these samples will reach audio out based on queue depth
-        bool startEstimated = false;
-        while (framesPushed < grain.durationFrames) {
-            size_t framesToPush = std::min(chunkFrames, grain.durationFrames - framesPushed);
-            size_t sampleOffset = framesPushed * (size_t)Walkk::kChannels;
-            size_t samplesToPush = framesToPush * (size_t)Walkk::kChannels;
-
-            size_t pushed = 0;
-            while (pushed < samplesToPush) {
-                if (!startEstimated) {
-                    size_t queued = walkk->sink.getQueuedSamples();
-                    double secondsQueue = (double)queued / (double)(Walkk::kSampleRate * Walkk::kChannels);
-                    auto eta = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
-                        std::chrono::duration<double>(secondsQueue));
-                    {
-                        std::lock_guard<std::mutex> g(walkk->lastGrainMutex);
-                        walkk->lastGrain.expectedStartTime = eta;
-                        walkk->lastGrain.hasExpectedStart = true;
-                        walkk->lastGrain.hasStarted = false;
-                        // Estimated end time = start + duration
-                        double secondsDur = (double)grain.durationFrames / (double)Walkk::kSampleRate;
-                        walkk->lastGrain.expectedEndTime = eta + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
-                            std::chrono::duration<double>(secondsDur));
-                    }
-                    startEstimated = true;
-                }
-                pushed += walkk->sink.push(grainBuffer.data() + sampleOffset + pushed,
-                                           samplesToPush - pushed);
-                if (pushed < samplesToPush) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                }
-            }
+        pushToSink(walkk, block.data(), block.size());
+        blockStart = std::chrono::steady_clock::now();
+    }
 
-            framesPushed += framesToPush;
+    walkk->sink.finished.store(true);
+}
+
+// Put one score voice into its recorded mixer slot; false if it could not be played
+static bool scheduleScoreVoice(Walkk *walkk, const ScoreVoice &v, const std::vector<int64_t> &fileMap,
+                               GrainQuality quality, size_t &slotConflicts) {
+    Mixer &mixer = walkk->mixer;
+    const MixerVoice::Type type = v.type == ScoreRecordType::Noise ? MixerVoice::Type::Noise : MixerVoice::Type::Grain;
+    if (type == MixerVoice::Type::Grain && (v.fileIndex >= fileMap.size() || fileMap[v.fileIndex] < 0)) return false;
+
+    MixerVoice *voice = mixer.allocateVoice(type, v.slot);
+    if (!voice) {
+        // Only a damaged score gets here; any slot still plays it, summed in a different order
+        slotConflicts++;
+        voice = mixer.allocateVoice(type);
+        if (!voice) return false;
+    }
+    voice->startFrame = v.engineFrame;
+    voice->lengthFrames = v.lengthFrames;
+
+    if (type == MixerVoice::Type::Noise) {
+        voice->noise.seed(v.noiseSeed);
+        voice->noise.color = (NoiseColor)v.shape;
+        voice->noise.amplitude = v.amplitude;
+        publishNoise(walkk, *voice);
+        return true;
+    }
+
+    GrainParams grain = grainFromScore(v, (size_t)fileMap[v.fileIndex]);
+    ProducerStats &stats = walkk->producerStats;
+    auto decodeStart = std::chrono::steady_clock::now();
+    bool decoded = readGrain(walkk->files[grain.fileIndex], grain, voice->buffer, Walkk::kSampleRate, stats,
+                             walkk->ioFaults, quality);
+    auto decodeTime = std::chrono::steady_clock::now() - decodeStart;
+    walkk->sinkDepth.addDecode(std::chrono::duration<double>(decodeTime).count());
+    stats.decodeTime.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(decodeTime).count());
+    if (!decoded || voice->buffer.size() < (size_t)v.lengthFrames * Walkk::kChannels) {
+        stats.grainFailures.fetch_add(1, std::memory_order_relaxed);
+        voice->active = false;
+        EventRecord ev;
+        ev.type = EventType::GrainReadFailed;
+        ev.c = (uint32_t)grain.fileIndex;
+        walkk->events.push(ev);
+        return false;
+    }
+    stats.grains.fetch_add(1, std::memory_order_relaxed);
+    voice->fileIndex = grain.fileIndex;
+    publishGrain(walkk, *voice, grain);
+    return true;
+}
+
+void scorePlaybackLoop(Walkk *walkk, const Score *score, GrainQuality quality) {
+    traceRegisterThread("producer");
+    applyProducerTuning(walkk);
+
+    // Score files -> library, by relative path
+    std::unordered_map<std::string, size_t> byPath;
+    for (size_t i = 0; i < walkk->files.size(); ++i) byPath[walkk->files[i].relPath] = i;
+    std::vector<int64_t> fileMap(score->files.size(), -1);
+    size_t missing = 0, changed = 0;
+    for (size_t i = 0; i < score->files.size(); ++i) {
+        auto it = byPath.find(score->files[i].path);
+        if (it == byPath.end()) {
+            missing++;
+            continue;
         }
+        fileMap[i] = (int64_t)it->second;
+        if (walkk->files[it->second].totalFrames != score->files[i].totalFrames) changed++;
+    }
+    if (missing > 0 || changed > 0) {
+        std::string msg = "score: " + std::to_string(missing) + " files missing from the library, " +
+                          std::to_string(changed) + " differ in length (their grains will not match)";
+        std::cerr << msg << std::endl;
+        walkk->addLog(msg);
+    }
 
-        // Optional white noise between grains
-        size_t noiseMsSnapshot = 0;
-        float noiseAmpSnapshot = 0.25f;
-        {
+    // Voices in timeline order (a noise gap is logged before the grain that overlaps its start)
+    std::vector<size_t> order(score->voices.size());
+    std::iota(order.begin(), order.end(), (size_t)0);
+    std::stable_sort(order.begin(), order.end(), [score](size_t a, size_t b) {
+        return score->voices[a].engineFrame < score->voices[b].engineFrame;
+    });
+
+    Mixer &mixer = walkk->mixer;
+    mixer.reset();
+    walkk->sinkDepth.reset(walkk->sink.capacity / (size_t)Walkk::kChannels);
+    applySinkDepth(walkk, false);
+
+    auto blockStart = std::chrono::steady_clock::now();
+    std::vector<float> block;
+    size_t next = 0, nextSettings = 0;
+    size_t failed = 0, slotConflicts = 0;
+
+    while (!walkk->allFinished.load() && mixer.renderFrame < score->endFrame) {
+        // The settings follow the session as it went, for the GUI, a --score of the replay and
+        // anything else that reads them; the voices themselves are fully described by the score
+        if (nextSettings < score->settings.size() && score->settings[nextSettings].engineFrame <= mixer.renderFrame) {
+            while (nextSettings + 1 < score->settings.size() &&
+                   score->settings[nextSettings + 1].engineFrame <= mixer.renderFrame) {
+                nextSettings++;
+            }
             std::lock_guard<std::mutex> lock(walkk->settingsMutex);
-            noiseMsSnapshot = std::min<size_t>(5000, walkk->settings.whiteNoiseMs);
-            noiseAmpSnapshot = std::max(0.0f, std::min(1.0f, walkk->settings.whiteNoiseAmplitude));
+            walkk->settings = settingsFromScore(score->settings[nextSettings++]);
         }
 
-        if (noiseMsSnapshot > 0) {
-            size_t noiseFrames = (noiseMsSnapshot * (size_t)Walkk::kSampleRate) / 1000;
-            noiseBuffer.resize(noiseFrames * (size_t)Walkk::kChannels);
-
-            std::uniform_real_distribution<float> noiseDist(-noiseAmpSnapshot, noiseAmpSnapshot);
-            for (size_t f = 0; f < noiseFrames; ++f) {
-                float nL = noiseDist(walkk->rng);
-                float nR = noiseDist(walkk->rng);
-                noiseBuffer[f * 2 + 0] = nL;
-                noiseBuffer[f * 2 + 1] = nR;
+        const size_t blockFrames = std::clamp<size_t>(walkk->engineBlockFrames.load(), 16, Mixer::kMaxBlockFrames);
+        const size_t frames = (size_t)std::min<uint64_t>(blockFrames, score->endFrame - mixer.renderFrame);
+        block.resize(frames * (size_t)Walkk::kChannels);
+
+        // Split the block at every voice start: a voice enters its slot exactly when it begins, by
+        // which time the slot's previous voice has finished, as it had live
+        size_t done = 0;
+        while (done < frames) {
+            while (next < order.size() && score->voices[order[next]].engineFrame <= mixer.renderFrame) {
+                WALKK_TRACE_ZONE("schedule grain");
+                if (!scheduleScoreVoice(walkk, score->voices[order[next]], fileMap, quality, slotConflicts)) failed++;
+                next++;
             }
+            uint64_t until = mixer.renderFrame + (frames - done);
+            if (next < order.size()) until = std::min(until, score->voices[order[next]].engineFrame);
+            const size_t n = (size_t)(until - mixer.renderFrame);
+            WALKK_TRACE_ZONE("mix");
+            mixer.render(block.data() + done * (size_t)Walkk::kChannels, n);
+            done += n;
+        }
 
-            size_t pushed = 0;
-            size_t samplesToPush = noiseFrames * (size_t)Walkk::kChannels;
-            while (pushed < samplesToPush) {
-                pushed += walkk->sink.push(noiseBuffer.data() + pushed,
-                                           samplesToPush - pushed);
-                if (pushed < samplesToPush) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                }
-            }
-            walkk->sink.finished.store(true);
+        double lateness = std::chrono::duration<double>(std::chrono::steady_clock::now() - blockStart).count();
+        if (walkk->sinkDepth.addBlock(lateness, frames)) {
+            applySinkDepth(walkk, true);
         }
+
+        pushToSink(walkk, block.data(), block.size());
+        blockStart = std::chrono::steady_clock::now();
     }
+
+    if (failed > 0 || slotConflicts > 0) {
+        std::string msg = "score: " + std::to_string(failed) + " voices not played, " +
+                          std::to_string(slotConflicts) + " out of their recorded slot";
+        std::cerr << msg << std::endl;
+        walkk->addLog(msg);
+    }
+    walkk->sink.finished.store(true);
 }
 
 double Walkk::getRecordingDurationSeconds() {
@@ -573,38 +1147,26 @@ double Walkk::getRecordingDurationSeconds() {
     return duration.count();
 }
 
-bool Walkk::startRecording(const std::string& outputPath) {
+bool Walkk::startRecording(const std::string& outputPath, WavSampleFormat format, RecordingCodec codec) {
     std::lock_guard<std::mutex> lock(recordingMutex);
 
     if (isRecording.load()) {
         return false; // Already recording
     }
 
-    // Open WAV file for writing
-    recordingFile = fopen(outputPath.c_str(), "wb");
-    if (!recordingFile) {
-        addLog("Failed to open recording file: " + outputPath);
-        return false;
-    }
-
-    // Initialize WAV header
-    WavHeader header;
-    initWavHeader(&header, kSampleRate, kChannels, 16);
-
-    // Write header with placeholder sizes
-    if (!writeWavHeader(recordingFile, &header)) {
-        fclose(recordingFile);
-        recordingFile = nullptr;
-        addLog("Failed to write WAV header");
+    // Opens the file and writes the header with placeholder sizes
+    std::string error;
+    if (!recorder.start(outputPath, kSampleRate, kChannels, format, codec, error)) {
+        addLog("Failed to start recording: " + error);
         return false;
     }
 
     recordingOutputPath = outputPath;
-    recordingDataSize = 0;
     recordingStartTime = std::chrono::steady_clock::now();
     isRecording.store(true);
 
-    addLog("Started recording to: " + outputPath);
+    addLog("Started recording to: " + outputPath + " (" + recordingCodecName(codec) + ", " +
+           wavSampleFormatName(format) + ")");
     return true;
 }
 
@@ -615,27 +1177,18 @@ void Walkk::stopRecording() {
         return;
     }
 
-    // Update WAV header with actual data size
-    if (recordingFile) {
-        if (fseek(recordingFile, 0, SEEK_SET) == 0) {
-            updateWavHeader(recordingFile, recordingDataSize);
-        }
-        fclose(recordingFile);
-        recordingFile = nullptr;
-    }
-
+    // Drains what the output handed over, then the final header
     isRecording.store(false);
-    addLog("Stopped recording. Total size: " + std::to_string(recordingDataSize) + " bytes");
+    if (!recorder.stop()) {
+        addLog("Recording to " + recordingOutputPath + " did not complete: write failed");
+    }
+    if (recorder.framesDropped.load() > 0) {
+        addLog("Recording lost " + std::to_string(recorder.framesDropped.load()) + " frames: the disk fell behind");
+    }
+    addLog("Stopped recording. Total size: " + std::to_string(recorder.bytesWritten.load()) + " bytes" +
+           (recorder.rf64.load() ? " (RF64)" : ""));
 }
 
 void Walkk::writeRecordingData(const float* data, size_t frames) {
-    if (!isRecording.load() || !recordingFile) {
-        return;
-    }
-
-    std::lock_guard<std::mutex> lock(recordingMutex);
-
-    if (writeWavAudioData(recordingFile, data, frames, kChannels)) {
-        recordingDataSize += frames * kChannels * sizeof(int16_t);
-    }
+    recorder.capture(data, frames);
 }
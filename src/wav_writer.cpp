@@ -1,17 +1,45 @@
 #include "wav_writer.h"
+#include <cstddef>
 #include <cstring>
 #include <algorithm>
 
-void initWavHeader(WavHeader* header, uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample) {
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Audio offset in blockBytes mode
+static constexpr uint32_t kAlignedDataOffset = 4096;
+
+// 64-bit file positions: recordings outgrow a 32-bit long on Windows
+static int seekFile(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (int64_t)offset, SEEK_SET);
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+void initWavHeader(WavHeader* header, uint32_t sampleRate, uint16_t channels, WavSampleFormat format) {
+    const uint16_t bitsPerSample = wavBytesPerSample(format) * 8;
+
     // Initialize RIFF header
     std::memcpy(header->riff, "RIFF", 4);
     header->fileSize = 0; // Will be updated later
     std::memcpy(header->wave, "WAVE", 4);
 
+    // Room for the ds64 chunk; readers skip JUNK
+    std::memcpy(header->ds64, "JUNK", 4);
+    header->ds64Size = 28;
+    header->riffSize64 = 0;
+    header->dataSize64 = 0;
+    header->sampleCount64 = 0;
+    header->tableLength = 0;
+
     // Initialize format chunk
     std::memcpy(header->fmt, "fmt ", 4);
     header->chunkSize = 16;
-    header->audioFormat = 1; // PCM
+    header->audioFormat = format == WavSampleFormat::Float32 ? 3 : 1; // IEEE float : PCM
     header->numChannels = channels;
     header->sampleRate = sampleRate;
     header->bitsPerSample = bitsPerSample;
@@ -25,44 +53,190 @@ void initWavHeader(WavHeader* header, uint32_t sampleRate, uint16_t channels, ui
     header->dataSize = 0; // Will be updated later
 }
 
-bool writeWavHeader(FILE* file, const WavHeader* header) {
-    return fwrite(header, sizeof(WavHeader), 1, file) == 1;
+void setWavDataSize(WavHeader* header, uint64_t dataBytes, uint32_t dataOffset) {
+    // An odd data chunk is followed by a pad byte, which the RIFF size counts
+    const uint64_t riffSize = dataBytes + (dataBytes & 1) + dataOffset - 8;
+    if (riffSize <= 0xFFFFFFFFull) {
+        std::memcpy(header->riff, "RIFF", 4);
+        std::memcpy(header->ds64, "JUNK", 4);
+        header->fileSize = (uint32_t)riffSize;
+        header->dataSize = (uint32_t)dataBytes;
+        header->riffSize64 = header->dataSize64 = header->sampleCount64 = 0;
+        return;
+    }
+
+    // RF64: the 32-bit fields say "see ds64"
+    std::memcpy(header->riff, "RF64", 4);
+    std::memcpy(header->ds64, "ds64", 4);
+    header->fileSize = 0xFFFFFFFF;
+    header->dataSize = 0xFFFFFFFF;
+    header->riffSize64 = riffSize;
+    header->dataSize64 = dataBytes;
+    header->sampleCount64 = header->blockAlign ? dataBytes / header->blockAlign : 0;
 }
 
-bool updateWavHeader(FILE* file, uint32_t dataSize) {
-    WavHeader header;
-    if (fread(&header, sizeof(WavHeader), 1, file) != 1) {
+bool writeWavHeader(FILE* file, const WavHeader* header, uint32_t dataOffset) {
+    if (dataOffset < sizeof(WavHeader) + 8) {
+        return fwrite(header, sizeof(WavHeader), 1, file) == 1;
+    }
+
+    // Everything up to the data chunk, a JUNK chunk over the gap, then the data chunk header
+    std::vector<uint8_t> bytes(dataOffset, 0);
+    const size_t beforeData = offsetof(WavHeader, data);
+    std::memcpy(bytes.data(), header, beforeData);
+    const uint32_t padSize = dataOffset - (uint32_t)sizeof(WavHeader) - 8;
+    std::memcpy(bytes.data() + beforeData, "JUNK", 4);
+    std::memcpy(bytes.data() + beforeData + 4, &padSize, 4);
+    std::memcpy(bytes.data() + dataOffset - 8, header->data, 8);
+    return fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+}
+
+uint16_t wavBytesPerSample(WavSampleFormat format) {
+    switch (format) {
+    case WavSampleFormat::Int24: return 3;
+    case WavSampleFormat::Float32: return 4;
+    default: return 2;
+    }
+}
+
+bool parseWavSampleFormat(const std::string& text, WavSampleFormat& format) {
+    if (text == "s16") format = WavSampleFormat::Int16;
+    else if (text == "s24") format = WavSampleFormat::Int24;
+    else if (text == "f32") format = WavSampleFormat::Float32;
+    else return false;
+    return true;
+}
+
+const char* wavSampleFormatName(WavSampleFormat format) {
+    switch (format) {
+    case WavSampleFormat::Int24: return "s24";
+    case WavSampleFormat::Float32: return "f32";
+    default: return "s16";
+    }
+}
+
+bool WavFileWriter::open(const std::string& path, uint32_t sampleRate, uint16_t numChannels, WavSampleFormat sampleFormat) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    format = sampleFormat;
+    channels = numChannels;
+    dataBytes = 0;
+    checkpointBytes = 0;
+    blocksWritten = 0;
+    staged.clear();
+    failed = false;
+    ditherState = DitherState(dither, numChannels);
+    dataOffset = sizeof(WavHeader);
+    if (blockBytes > 0) {
+        // We do our own buffering in whole blocks
+        setvbuf(file, nullptr, _IONBF, 0);
+        dataOffset = kAlignedDataOffset;
+        staged.reserve(blockBytes);
+    }
+    initWavHeader(&header, sampleRate, numChannels, sampleFormat);
+
+#ifdef __linux__
+    // Best effort: not every filesystem supports it
+    if (preallocateBytes > 0) {
+        fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, 0, (off_t)(dataOffset + preallocateBytes));
+    }
+#endif
+
+    // Header with placeholder sizes
+    if (!writeWavHeader(file, &header, dataOffset)) {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool WavFileWriter::writeStaged(size_t count) {
+    if (seekFile(file, dataOffset + blocksWritten) != 0 || fwrite(staged.data(), 1, count, file) != count) {
+        failed = true;
         return false;
     }
+    return true;
+}
 
-    // Update sizes
-    header.dataSize = dataSize;
-    header.fileSize = dataSize + sizeof(WavHeader) - 8;
+bool WavFileWriter::append(const void* bytes, size_t count) {
+    if (blockBytes == 0) {
+        failed = fwrite(bytes, 1, count, file) != count;
+        return !failed;
+    }
 
-    // Seek back to beginning and write updated header
-    fseek(file, 0, SEEK_SET);
-    return fwrite(&header, sizeof(WavHeader), 1, file) == 1;
+    const uint8_t* in = (const uint8_t*)bytes;
+    while (count > 0) {
+        size_t take = std::min(count, blockBytes - staged.size());
+        staged.insert(staged.end(), in, in + take);
+        in += take;
+        count -= take;
+        if (staged.size() == blockBytes) {
+            if (!writeStaged(blockBytes)) return false;
+            blocksWritten += blockBytes;
+            staged.clear();
+        }
+    }
+    return true;
 }
 
-bool writeWavAudioData(FILE* file, const float* audioData, size_t frameCount, uint16_t channels) {
-    const size_t sampleCount = frameCount * channels;
+bool WavFileWriter::write(const float* audioData, size_t frameCount) {
+    if (!file || failed) return false;
+    if (format == WavSampleFormat::Float32) return writeEncoded(audioData, frameCount);
 
-    // Convert float samples to 16-bit integers
-    int16_t* intData = new int16_t[sampleCount];
-    convertFloatToInt16(audioData, intData, sampleCount);
+    const size_t sampleCount = frameCount * channels;
+    converted.reserve(sampleCount * wavBytesPerSample(format));
+    if (format == WavSampleFormat::Int24) {
+        convertFloatToInt24(audioData, converted.data(), sampleCount, ditherState);
+    } else {
+        convertFloatToInt16(audioData, (int16_t*)converted.data(), sampleCount, ditherState);
+    }
+    return writeEncoded(converted.data(), frameCount);
+}
 
-    // Write the data
-    const size_t bytesToWrite = sampleCount * sizeof(int16_t);
-    const bool success = fwrite(intData, 1, bytesToWrite, file) == bytesToWrite;
+bool WavFileWriter::writeEncoded(const void* samples, size_t frameCount) {
+    if (!file || failed) return false;
+    const size_t bytes = frameCount * channels * wavBytesPerSample(format);
+    if (!append(samples, bytes)) return false;
+    dataBytes += bytes;
 
-    delete[] intData;
-    return success;
+    if (checkpointSeconds > 0.0 &&
+        dataBytes - checkpointBytes >= (uint64_t)(checkpointSeconds * header.byteRate)) {
+        return checkpoint();
+    }
+    return true;
 }
 
-void convertFloatToInt16(const float* input, int16_t* output, size_t sampleCount) {
-    for (size_t i = 0; i < sampleCount; ++i) {
-        // Clamp to [-1.0, 1.0] and convert to 16-bit
-        float sample = std::max(-1.0f, std::min(1.0f, input[i]));
-        output[i] = static_cast<int16_t>(sample * 32767.0f);
+bool WavFileWriter::checkpoint() {
+    if (!file) return false;
+    // A partial block goes out now and again (complete) later, at the same offset
+    if (!staged.empty() && !writeStaged(staged.size())) return false;
+
+    setWavDataSize(&header, dataBytes, dataOffset);
+    // Odd data (s24 mono, odd frame count): the pad byte goes in now so every checkpoint is a
+    // complete file; the next write starts on top of it
+    static const uint8_t pad = 0;
+    const bool padded = (dataBytes & 1) != 0;
+    if (seekFile(file, 0) != 0 || !writeWavHeader(file, &header, dataOffset) ||
+        seekFile(file, dataOffset + dataBytes) != 0 || (padded && fwrite(&pad, 1, 1, file) != 1) ||
+        (padded && seekFile(file, dataOffset + dataBytes) != 0) || fflush(file) != 0) {
+        failed = true;
+        return false;
     }
+    checkpointBytes = dataBytes;
+    return true;
+}
+
+bool WavFileWriter::close() {
+    if (!file) return !failed;
+    bool ok = checkpoint() && !failed;
+#ifdef __linux__
+    // Hand back the preallocated space that was not used
+    if (preallocateBytes > 0 && ftruncate(fileno(file), (off_t)(dataOffset + dataBytes + (dataBytes & 1))) != 0) ok = false;
+#endif
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    return ok;
 }